@@ -0,0 +1,412 @@
+#include "Animation.hpp"
+#include "AssetPack.hpp"
+#include "Utils.hpp"
+#include "scene_lua.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#define ANIMATION_FILE_MAGIC "ANIM"
+#define ANIMATION_FILE_VERSION 1
+
+static float clipTime(const AnimationClip* clip, float time) {
+    if (clip->loop && clip->duration > 0) {
+        time = fmod(time, clip->duration);
+        return time < 0 ? time + clip->duration : time;
+    }
+    return time;
+}
+
+// Keys are few per curve, so a linear search beats a binary one
+static float sampleCurve(const float* times, const float* angles, int numKeys, float time) {
+    if (time <= times[0]) {
+        return angles[0];
+    }
+    for (int k = 1; k < numKeys; k++) {
+        if (time < times[k]) {
+            float t = (time - times[k - 1]) / (times[k] - times[k - 1]);
+            return angles[k - 1] + (angles[k] - angles[k - 1]) * t;
+        }
+    }
+    return angles[numKeys - 1];
+}
+
+AnimationClip::AnimationClip(const std::string& name, float duration, bool loop)
+    : name(name), duration(duration), loop(loop) {
+}
+
+void AnimationClip::addChannel(const std::string& joint, JointAxis axis,
+        const std::vector<float>& times, const std::vector<float>& angles) {
+    int numKeys = std::min(times.size(), angles.size());
+    if (numKeys == 0) {
+        std::cerr << "Animation " << name << ": no keys for " << joint << std::endl;
+        return;
+    }
+
+    Channel channel;
+    channel.joint = joint;
+    channel.axis = axis;
+    channel.firstKey = this->times.size();
+    channel.numKeys = numKeys;
+    channels.push_back(channel);
+
+    this->times.insert(this->times.end(), times.begin(), times.begin() + numKeys);
+    this->angles.insert(this->angles.end(), angles.begin(), angles.begin() + numKeys);
+}
+
+float AnimationClip::sample(int channel, float time) const {
+    const Channel& c = channels[channel];
+    return sampleCurve(&times[c.firstKey], &angles[c.firstKey], c.numKeys, clipTime(this, time));
+}
+
+static void writeBytes(std::vector<char>& out, const void* data, size_t size) {
+    out.insert(out.end(), (const char*)data, (const char*)data + size);
+}
+
+static void writeU32(std::vector<char>& out, uint32_t value) {
+    writeBytes(out, &value, sizeof(value));
+}
+
+static void writeString(std::vector<char>& out, const std::string& s) {
+    writeU32(out, s.size());
+    writeBytes(out, s.data(), s.size());
+}
+
+// Reads from a byte range, every read fails once one has run past the end
+struct ByteReader {
+    const char* p;
+    const char* end;
+
+    bool read(void* data, size_t size) {
+        if ((size_t)(end - p) < size) {
+            p = end;
+            return false;
+        }
+        if (size > 0) {
+            memcpy(data, p, size);
+        }
+        p += size;
+        return true;
+    }
+
+    bool readU32(uint32_t& value) {
+        return read(&value, sizeof(value));
+    }
+
+    bool readString(std::string& s) {
+        uint32_t size;
+        if (!readU32(size) || size > 1024 || (size_t)(end - p) < size) {
+            return false;
+        }
+        s.assign(p, size);
+        p += size;
+        return true;
+    }
+};
+
+// Little endian, as written by the machine that cooked it:
+//   "ANIM" u32:version str:name f32:duration u8:loop u32:channels
+//   { str:joint u8:axis u32:keys }*  f32:times[keys]  f32:angles[keys]
+// where str is a u32 length followed by the bytes
+void AnimationClip::toBytes(std::vector<char>& out) const {
+    writeBytes(out, ANIMATION_FILE_MAGIC, 4);
+    writeU32(out, ANIMATION_FILE_VERSION);
+    writeString(out, name);
+    writeBytes(out, &duration, sizeof(float));
+    uint8_t looping = loop;
+    writeBytes(out, &looping, 1);
+
+    writeU32(out, channels.size());
+    for (const Channel& c : channels) {
+        writeString(out, c.joint);
+        uint8_t axis = (uint8_t)c.axis;
+        writeBytes(out, &axis, 1);
+        writeU32(out, c.numKeys);
+    }
+    writeBytes(out, times.data(), times.size() * sizeof(float));
+    writeBytes(out, angles.data(), angles.size() * sizeof(float));
+}
+
+bool AnimationClip::save(const std::string& path) const {
+    FILE* out = fopen(path.c_str(), "wb");
+    if (out == NULL) {
+        return false;
+    }
+
+    std::vector<char> bytes;
+    toBytes(bytes);
+    fwrite(bytes.data(), 1, bytes.size(), out);
+
+    bool ok = !ferror(out);
+    fclose(out);
+    return ok;
+}
+
+AnimationClip* AnimationClip::fromBytes(const void* data, size_t size, size_t& used, const std::string& source) {
+    ByteReader in = {(const char*)data, (const char*)data + size};
+
+    char magic[4];
+    uint32_t version = 0;
+    std::string name;
+    float duration = 0;
+    uint8_t looping = 0;
+    uint32_t numChannels = 0;
+    bool ok = in.read(magic, 4) && memcmp(magic, ANIMATION_FILE_MAGIC, 4) == 0
+        && in.readU32(version) && version == ANIMATION_FILE_VERSION
+        && in.readString(name)
+        && in.read(&duration, sizeof(float))
+        && in.read(&looping, 1)
+        && in.readU32(numChannels);
+
+    AnimationClip* clip = new AnimationClip(name, duration, looping != 0);
+    uint32_t numKeys = 0;
+    for (uint32_t i = 0; ok && i < numChannels; i++) {
+        Channel c;
+        uint8_t axis;
+        uint32_t keys;
+        // Every key still needs a time and an angle behind the channel table
+        ok = in.readString(c.joint) && in.read(&axis, 1) && axis <= (uint8_t)JointAxis::Y
+            && in.readU32(keys) && keys > 0
+            && (uint64_t)numKeys + keys <= (uint64_t)(in.end - in.p) / (2 * sizeof(float));
+        if (!ok) {
+            break;
+        }
+        c.axis = (JointAxis)axis;
+        c.firstKey = numKeys;
+        c.numKeys = keys;
+        numKeys += keys;
+        clip->channels.push_back(c);
+    }
+
+    if (ok) {
+        clip->times.resize(numKeys);
+        clip->angles.resize(numKeys);
+        ok = in.read(clip->times.data(), numKeys * sizeof(float))
+            && in.read(clip->angles.data(), numKeys * sizeof(float));
+    }
+
+    if (!ok) {
+        std::cerr << "Error loading " << source << ": not an animation clip" << std::endl;
+        delete clip;
+        return NULL;
+    }
+    used = in.p - (const char*)data;
+    return clip;
+}
+
+AnimationClip* AnimationClip::load(const std::string& path) {
+    FILE* in = fopen(path.c_str(), "rb");
+    if (in == NULL) {
+        return NULL;
+    }
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+
+    std::vector<char> data(size > 0 ? size : 0);
+    bool ok = size > 0 && fread(&data[0], 1, size, in) == (size_t)size;
+    fclose(in);
+    if (!ok) {
+        std::cerr << "Error loading " << path << ": not an animation clip" << std::endl;
+        return NULL;
+    }
+    size_t used;
+    return fromBytes(data.data(), data.size(), used, path);
+}
+
+std::vector<AnimationClip*> AnimationClip::loadAll(const std::string& file) {
+    const AssetPack* pack = AssetPack::getGamePack();
+    const AssetPack::Entry* cooked = pack != NULL
+        ? pack->find(file, AssetType::Clips, getFileModifiedTime(file)) : NULL;
+    if (cooked == NULL) {
+        return import_lua_clips(file);
+    }
+
+    std::vector<AnimationClip*> clips;
+    const char* data = (const char*)pack->getData(cooked);
+    size_t offset = 0;
+    for (uint32_t i = 0; i < cooked->info[0]; i++) {
+        size_t used;
+        AnimationClip* clip = fromBytes(data + offset, cooked->size - offset, used, file);
+        if (clip == NULL) {
+            break;
+        }
+        clips.push_back(clip);
+        offset += used;
+    }
+    return clips;
+}
+
+AnimationBatch::AnimationBatch() : numInstances(0) {
+}
+
+static void collectJoints(SceneNode* node, std::vector<JointNode*>& joints) {
+    if (node->m_nodeType == NodeType::JointNode) {
+        joints.push_back(static_cast<JointNode*>(node));
+    }
+    for (SceneNode* child : node->children) {
+        collectJoints(child, joints);
+    }
+}
+
+int AnimationBatch::add(SceneNode* root) {
+    std::vector<JointNode*> found;
+    collectJoints(root, found);
+
+    if (numInstances == 0 && jointNames.empty()) {
+        for (JointNode* joint : found) {
+            jointNames.push_back(joint->m_name);
+            restAngles[0].push_back(joint->m_joint_x.init);
+            restAngles[1].push_back(joint->m_joint_y.init);
+        }
+    }
+    if (found.size() != jointNames.size()) {
+        std::cerr << "Animation: " << root->m_name << " does not match the batch's joints" << std::endl;
+        return -1;
+    }
+
+    joints.insert(joints.end(), found.begin(), found.end());
+    for (int layer = 0; layer < ANIMATION_LAYERS; layer++) {
+        playing[layer].push_back(0);
+        playTimes[layer].push_back(0);
+        weights[layer].push_back(0);
+    }
+    return numInstances++;
+}
+
+void AnimationBatch::clear() {
+    numInstances = 0;
+    joints.clear();
+    for (int layer = 0; layer < ANIMATION_LAYERS; layer++) {
+        playing[layer].clear();
+        playTimes[layer].clear();
+        weights[layer].clear();
+    }
+}
+
+int AnimationBatch::bindClip(const AnimationClip* clip) {
+    BoundClip bound;
+    bound.clip = clip;
+    for (const AnimationClip::Channel& channel : clip->channels) {
+        int joint = -1;
+        for (size_t j = 0; j < jointNames.size(); j++) {
+            if (jointNames[j] == channel.joint) {
+                joint = j;
+                break;
+            }
+        }
+        if (joint < 0) {
+            std::cerr << "Animation " << clip->name << ": unknown joint " << channel.joint << std::endl;
+        }
+        bound.joints.push_back(joint);
+    }
+    clips.push_back(bound);
+    return clips.size() - 1;
+}
+
+void AnimationBatch::play(int instance, int layer, int clip, float time, float weight) {
+    if (instance < 0) {
+        return;
+    }
+    playing[layer][instance] = clip;
+    playTimes[layer][instance] = time;
+    weights[layer][instance] = weight;
+}
+
+void AnimationBatch::evaluate() {
+    int numJoints = jointNames.size();
+    for (int axis = 0; axis < 2; axis++) {
+        results[axis].resize(numJoints * numInstances);
+        for (int j = 0; j < numJoints; j++) {
+            std::fill(results[axis].begin() + j * numInstances,
+                results[axis].begin() + (j + 1) * numInstances, restAngles[axis][j]);
+        }
+    }
+
+    int numClips = clips.size();
+    grouped.resize(numInstances);
+    sampleTimes.resize(numInstances);
+    for (int layer = 0; layer < ANIMATION_LAYERS; layer++) {
+        // Counting sort of the active instances by clip
+        clipStarts.assign(numClips + 1, 0);
+        for (int i = 0; i < numInstances; i++) {
+            if (weights[layer][i] > 0) {
+                clipStarts[playing[layer][i] + 1]++;
+            }
+        }
+        for (int c = 0; c < numClips; c++) {
+            clipStarts[c + 1] += clipStarts[c];
+        }
+        for (int i = 0; i < numInstances; i++) {
+            if (weights[layer][i] > 0) {
+                grouped[clipStarts[playing[layer][i]]++] = i;
+            }
+        }
+        // The fill moved every start to the next clip's
+        for (int c = numClips; c > 0; c--) {
+            clipStarts[c] = clipStarts[c - 1];
+        }
+        clipStarts[0] = 0;
+
+        const float* layerWeights = &weights[layer][0];
+        for (int c = 0; c < numClips; c++) {
+            int begin = clipStarts[c];
+            int end = clipStarts[c + 1];
+            if (begin == end) {
+                continue;
+            }
+
+            const BoundClip& bound = clips[c];
+            const AnimationClip* clip = bound.clip;
+            for (int k = begin; k < end; k++) {
+                sampleTimes[k] = clipTime(clip, playTimes[layer][grouped[k]]);
+            }
+
+            for (size_t ch = 0; ch < clip->channels.size(); ch++) {
+                if (bound.joints[ch] < 0) {
+                    continue;
+                }
+                const AnimationClip::Channel& channel = clip->channels[ch];
+                const float* keyTimes = &clip->times[channel.firstKey];
+                const float* keyAngles = &clip->angles[channel.firstKey];
+                float* out = &results[(int)channel.axis][bound.joints[ch] * numInstances];
+
+                for (int k = begin; k < end; k++) {
+                    int i = grouped[k];
+                    float angle = sampleCurve(keyTimes, keyAngles, channel.numKeys, sampleTimes[k]);
+                    out[i] += (angle - out[i]) * layerWeights[i];
+                }
+            }
+        }
+    }
+}
+
+void AnimationBatch::apply() {
+    int numJoints = jointNames.size();
+    if (results[0].size() != (size_t)(numJoints * numInstances)) {
+        return;
+    }
+    for (int i = 0; i < numInstances; i++) {
+        JointNode** instanceJoints = &joints[i * numJoints];
+        for (int j = 0; j < numJoints; j++) {
+            instanceJoints[j]->set_x_rotate(results[0][j * numInstances + i]);
+            instanceJoints[j]->set_y_rotate(results[1][j * numInstances + i]);
+        }
+    }
+}
+
+int AnimationBatch::getNumInstances() const {
+    return numInstances;
+}
+
+int AnimationBatch::getNumJoints() const {
+    return jointNames.size();
+}
+
+float AnimationBatch::getAngle(int instance, int joint, JointAxis axis) const {
+    return results[(int)axis][joint * numInstances + instance];
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "JointNode.hpp"
+#include "SceneNode.hpp"
+
+#include <string>
+#include <vector>
+
+// Clips playing on top of each other per instance, later layers blend over
+// earlier ones
+#define ANIMATION_LAYERS 2
+
+enum class JointAxis {
+    X,
+    Y
+};
+
+/*
+ * Keyframed joint angles, one linearly interpolated curve per animated joint
+ * axis. The keys of all curves share two flat arrays so a clip is a handful
+ * of allocations however many joints it moves.
+ *
+ * Clips come from Lua (see import_lua_clips) or from the binary format
+ * written by save() and cooked into asset packs.
+ */
+class AnimationClip {
+public:
+    struct Channel {
+        std::string joint;
+        JointAxis axis;
+        int firstKey;
+        int numKeys;
+    };
+
+    AnimationClip(const std::string& name, float duration, bool loop);
+
+    // Times must be increasing, angles are in degrees like JointNode's
+    void addChannel(const std::string& joint, JointAxis axis,
+        const std::vector<float>& times, const std::vector<float>& angles);
+
+    // Looping clips wrap the time, others hold their first and last keys
+    float sample(int channel, float time) const;
+
+    bool save(const std::string& path) const;
+    // NULL if the file is missing or not a clip
+    static AnimationClip* load(const std::string& path);
+
+    // The binary format in memory. fromBytes sets used to the bytes the clip
+    // took up, source names them in error messages.
+    void toBytes(std::vector<char>& out) const;
+    static AnimationClip* fromBytes(const void* data, size_t size, size_t& used, const std::string& source);
+
+    // Every clip of a Lua clip file, from the game's asset pack if cooked
+    static std::vector<AnimationClip*> loadAll(const std::string& file);
+
+    std::string name;
+    float duration;
+    bool loop;
+    std::vector<Channel> channels;
+    std::vector<float> times;
+    std::vector<float> angles;
+};
+
+/*
+ * Poses many instances of the same scene file at once. Angles are kept per
+ * joint axis as arrays over the instances, so each clip channel is evaluated
+ * for every instance playing it in one pass over contiguous memory before
+ * the results are written back to the joints.
+ *
+ *     int i = batch.add(model->getRoot());
+ *     int walk = batch.bindClip(walkClip);
+ *     batch.play(i, 0, walk, time, 1);   // per instance and layer
+ *     batch.evaluate();
+ *     batch.apply();                     // then MeshModel::update()
+ */
+class AnimationBatch {
+public:
+    AnimationBatch();
+
+    // The first instance added sets the joint layout, every other one must
+    // have been loaded from the same scene file
+    int add(SceneNode* root);
+    // Drops the instances, the layout and bound clips are kept
+    void clear();
+
+    // Resolves the clip's joints against the layout set by the first add(),
+    // the clip must outlive the batch. Returns the handle for play().
+    int bindClip(const AnimationClip* clip);
+    // A weight of 0 turns the layer off
+    void play(int instance, int layer, int clip, float time, float weight);
+
+    void evaluate();
+    // Writes the evaluated angles to the instances' joints
+    void apply();
+
+    int getNumInstances() const;
+    int getNumJoints() const;
+    float getAngle(int instance, int joint, JointAxis axis) const;
+
+private:
+    struct BoundClip {
+        const AnimationClip* clip;
+        // Per channel, into the layout or -1 if the joint does not exist
+        std::vector<int> joints;
+    };
+
+    int numInstances;
+    std::vector<std::string> jointNames;
+    std::vector<float> restAngles[2];
+    // Per instance, then per joint
+    std::vector<JointNode*> joints;
+
+    std::vector<BoundClip> clips;
+
+    // Per layer, then per instance
+    std::vector<int> playing[ANIMATION_LAYERS];
+    std::vector<float> playTimes[ANIMATION_LAYERS];
+    std::vector<float> weights[ANIMATION_LAYERS];
+
+    // Per axis, then per joint, then per instance
+    std::vector<float> results[2];
+
+    // Scratch for grouping the instances of a layer by clip
+    std::vector<int> clipStarts;
+    std::vector<int> grouped;
+    std::vector<float> sampleTimes;
+};
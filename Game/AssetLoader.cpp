@@ -0,0 +1,294 @@
+#include "AssetLoader.hpp"
+#include "Profiler.hpp"
+
+#include <imgui/imgui.h>
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+std::vector<AssetLoader::Task> AssetLoader::lastRun;
+int AssetLoader::lastRunThreads = 0;
+uint64_t AssetLoader::lastRunStart = 0;
+uint64_t AssetLoader::lastRunEnd = 0;
+
+static const char* workerNames[ASSET_LOADER_MAX_THREADS] = {
+    "loader 1", "loader 2", "loader 3", "loader 4"
+};
+
+int AssetLoader::add(const char* name, std::function<void()> work, std::function<void()> upload,
+        std::vector<int> dependsOn) {
+    int id = tasks.size();
+    Task task;
+    task.name = name;
+    task.work = work;
+    task.upload = upload;
+    task.waitingFor = 0;
+    task.uploaded = false;
+    task.thread = -1;
+    task.workStart = task.workEnd = task.uploadStart = task.uploadEnd = 0;
+    for (int dependency : dependsOn) {
+        // Only earlier tasks, so there can be no cycle
+        if (dependency < 0 || dependency >= id) {
+            std::cerr << "Asset loader: " << name << " depends on unknown task " << dependency << std::endl;
+            continue;
+        }
+        task.dependsOn.push_back(dependency);
+        tasks[dependency].dependents.push_back(id);
+        task.waitingFor++;
+    }
+    tasks.push_back(task);
+    return id;
+}
+
+// Called under the lock. A task without work is done as soon as it is ready.
+void AssetLoader::makeReady(int task) {
+    if (tasks[task].work) {
+        ready.push_back(task);
+        workReady.notify_one();
+    } else {
+        tasks[task].workStart = tasks[task].workEnd = Profiler::now();
+        finishWork(task);
+    }
+}
+
+void AssetLoader::finishWork(int task) {
+    finished.push_back(task);
+    workFinished.notify_one();
+    for (int dependent : tasks[task].dependents) {
+        if (--tasks[dependent].waitingFor == 0) {
+            makeReady(dependent);
+        }
+    }
+}
+
+void AssetLoader::runWorker(int index) {
+    Profiler::setThreadName(workerNames[index]);
+    while (true) {
+        int task;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            workReady.wait(guard, [this]() { return stopping || !ready.empty(); });
+            if (stopping) {
+                return;
+            }
+            // In the order the tasks were added
+            auto first = std::min_element(ready.begin(), ready.end());
+            task = *first;
+            ready.erase(first);
+        }
+
+        uint64_t start = Profiler::now();
+        try {
+            tasks[task].work();
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!error) {
+                error = std::current_exception();
+            }
+            stopping = true;
+            workReady.notify_all();
+            workFinished.notify_one();
+            return;
+        }
+        uint64_t end = Profiler::now();
+        Profiler::record(tasks[task].name, start, end, 0);
+
+        std::lock_guard<std::mutex> guard(lock);
+        tasks[task].thread = index;
+        tasks[task].workStart = start;
+        tasks[task].workEnd = end;
+        finishWork(task);
+    }
+}
+
+// Called under the lock, the first finished task whose dependencies are all
+// uploaded
+bool AssetLoader::takeUploadable(int& task) {
+    for (auto it = finished.begin(); it != finished.end(); ++it) {
+        bool uploadable = true;
+        for (int dependency : tasks[*it].dependsOn) {
+            uploadable = uploadable && tasks[dependency].uploaded;
+        }
+        if (uploadable) {
+            task = *it;
+            finished.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+void AssetLoader::run() {
+    uint64_t runStart = Profiler::now();
+    stopping = false;
+    error = std::exception_ptr();
+
+    int numThreads = std::max(1, std::min<int>(std::thread::hardware_concurrency() - 1, ASSET_LOADER_MAX_THREADS));
+    {
+        // Collected first, making a task without work ready readies its
+        // dependents too
+        std::vector<int> roots;
+        for (size_t i = 0; i < tasks.size(); i++) {
+            if (tasks[i].waitingFor == 0) {
+                roots.push_back(i);
+            }
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        for (int task : roots) {
+            makeReady(task);
+        }
+    }
+    std::vector<std::thread> workers;
+    for (int i = 0; i < numThreads; i++) {
+        workers.push_back(std::thread(&AssetLoader::runWorker, this, i));
+    }
+
+    // The main thread owns the GL context, it only uploads
+    size_t uploaded = 0;
+    std::exception_ptr uploadError;
+    while (uploaded < tasks.size()) {
+        int task;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            workFinished.wait(guard, [&]() { return error || takeUploadable(task); });
+            if (error) {
+                break;
+            }
+        }
+
+        uint64_t start = Profiler::now();
+        uint64_t end = start;
+        if (tasks[task].upload) {
+            try {
+                tasks[task].upload();
+            } catch (...) {
+                uploadError = std::current_exception();
+                break;
+            }
+            end = Profiler::now();
+            Profiler::record(tasks[task].name, start, end, Profiler::threadDepth());
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        tasks[task].uploadStart = start;
+        tasks[task].uploadEnd = end;
+        tasks[task].uploaded = true;
+        uploaded++;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    workReady.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    // The steps hold references into the caller's frame
+    for (Task& task : tasks) {
+        task.work = nullptr;
+        task.upload = nullptr;
+    }
+    lastRun = tasks;
+    lastRunThreads = numThreads;
+    lastRunStart = runStart;
+    lastRunEnd = Profiler::now();
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    if (uploadError) {
+        std::rethrow_exception(uploadError);
+    }
+}
+
+void AssetLoader::drawTimeline(bool* open) {
+    // Same title as the CPU profiler so both end up in one window
+    ImGui::Begin("Profiler", open, ImVec2(600, 400));
+
+    if (ImGui::CollapsingHeader("Startup", NULL, true, true)) {
+        if (lastRun.empty()) {
+            ImGui::Text("No assets loaded");
+            ImGui::End();
+            return;
+        }
+
+        double totalMs = (lastRunEnd - lastRunStart) / 1e6;
+        double workMs = 0;
+        for (const Task& task : lastRun) {
+            workMs += (task.workEnd - task.workStart) / 1e6;
+        }
+        ImGui::Text("%d assets in %.1f ms, %.1f ms of work on %d loader threads",
+            (int)lastRun.size(), totalMs, workMs, lastRunThreads);
+
+        // Walk back from the last upload through whichever dependency
+        // finished last
+        std::vector<bool> critical(lastRun.size(), false);
+        std::vector<int> path;
+        int last = 0;
+        for (size_t i = 1; i < lastRun.size(); i++) {
+            if (lastRun[i].uploadEnd > lastRun[last].uploadEnd) {
+                last = i;
+            }
+        }
+        for (int task = last; task >= 0; ) {
+            critical[task] = true;
+            path.push_back(task);
+            int blocker = -1;
+            for (int dependency : lastRun[task].dependsOn) {
+                if (blocker < 0 || lastRun[dependency].uploadEnd > lastRun[blocker].uploadEnd) {
+                    blocker = dependency;
+                }
+            }
+            task = blocker;
+        }
+
+        // One lane for the uploads on the main thread, one per loader
+        const float rowHeight = ImGui::GetTextLineHeight() + 4;
+        float width = ImGui::GetContentRegionAvailWidth();
+        ImDrawList* drawList = ImGui::GetWindowDrawList();
+        double span = std::max<double>(lastRunEnd - lastRunStart, 1);
+
+        for (int lane = -1; lane < lastRunThreads; lane++) {
+            ImGui::Text("%s", lane < 0 ? "main" : workerNames[lane]);
+            ImVec2 origin = ImGui::GetCursorScreenPos();
+            drawList->AddRectFilled(origin, ImVec2(origin.x + width, origin.y + rowHeight), 0x40000000);
+
+            for (size_t i = 0; i < lastRun.size(); i++) {
+                const Task& task = lastRun[i];
+                uint64_t start = lane < 0 ? task.uploadStart : task.workStart;
+                uint64_t end = lane < 0 ? task.uploadEnd : task.workEnd;
+                if ((lane < 0 && end == start) || (lane >= 0 && task.thread != lane)) {
+                    continue;
+                }
+                float x0 = origin.x + width * (float)((start - lastRunStart) / span);
+                float x1 = std::max(origin.x + width * (float)((end - lastRunStart) / span), x0 + 1);
+                ImVec2 a = ImVec2(x0, origin.y);
+                ImVec2 b = ImVec2(x1, origin.y + rowHeight - 1);
+
+                drawList->AddRectFilled(a, b, critical[i] ? 0xFF4080E0 : 0xFFC09060);
+                if (x1 - x0 > 40) {
+                    drawList->PushClipRect(ImVec4(a.x, a.y, b.x, b.y));
+                    drawList->AddText(ImVec2(x0 + 2, origin.y + 2), 0xFF000000, task.name);
+                    drawList->PopClipRect();
+                }
+                if (ImGui::IsMouseHoveringRect(a, b)) {
+                    ImGui::SetTooltip("%s\n%.3f ms\nready after %.3f ms", task.name, (end - start) / 1e6,
+                        (start - lastRunStart) / 1e6);
+                }
+            }
+            ImGui::Dummy(ImVec2(width, rowHeight));
+        }
+
+        ImGui::Text("Critical path");
+        for (auto it = path.rbegin(); it != path.rend(); ++it) {
+            const Task& task = lastRun[*it];
+            ImGui::Text("%8.3f ms work  %8.3f ms upload  %s", (task.workEnd - task.workStart) / 1e6,
+                (task.uploadEnd - task.uploadStart) / 1e6, task.name);
+        }
+    }
+
+    ImGui::End();
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/*
+ * Loads startup assets on a pool of worker threads.
+ *
+ * Every task has a work step that runs on a worker (decoding, parsing, no GL)
+ * and an upload step the main thread runs once the work is done (GL calls),
+ * either may be empty. A task waits for its dependencies: its work starts
+ * after theirs has finished and its upload after theirs, so the main thread
+ * uploads the mesh buffer before it builds a model that draws from it.
+ *
+ *     AssetLoader loader;
+ *     int mesh = loader.add("meshes", [&]() { Mesh::load(data); }, [&]() { Mesh::create(data); });
+ *     loader.add("player", NULL, [&]() { player.loadModel(); }, {mesh});
+ *     loader.run();
+ *
+ * Each run is recorded into the profiler and kept for the startup timeline.
+ */
+
+#define ASSET_LOADER_MAX_THREADS 4
+
+class AssetLoader {
+public:
+    // name must outlive the profiler, like zone names. Returns the task's id
+    // for the dependency lists of later tasks.
+    int add(const char* name, std::function<void()> work, std::function<void()> upload,
+        std::vector<int> dependsOn = std::vector<int>());
+
+    // Returns once every task is uploaded. An exception thrown by a step is
+    // rethrown here after the workers have stopped.
+    void run();
+
+    // Adds the timeline of the last run to the profiler window
+    static void drawTimeline(bool* open);
+
+private:
+    struct Task {
+        const char* name;
+        std::function<void()> work;
+        std::function<void()> upload;
+        std::vector<int> dependsOn;
+        std::vector<int> dependents;
+
+        int waitingFor; // Dependencies whose work is not done
+        bool uploaded;
+        int thread;     // Worker that ran the work, -1 if there was none
+        uint64_t workStart, workEnd;
+        uint64_t uploadStart, uploadEnd;
+    };
+
+    void makeReady(int task);
+    void finishWork(int task);
+    void runWorker(int index);
+    bool takeUploadable(int& task);
+
+    std::vector<Task> tasks;
+
+    // Only touched under the lock while run() is going
+    std::mutex lock;
+    std::condition_variable workReady;
+    std::condition_variable workFinished;
+    std::vector<int> ready;
+    std::vector<int> finished;
+    bool stopping;
+    std::exception_ptr error;
+
+    static std::vector<Task> lastRun;
+    static int lastRunThreads;
+    static uint64_t lastRunStart;
+    static uint64_t lastRunEnd;
+};
@@ -0,0 +1,173 @@
+#include "AssetPack.hpp"
+#include "Utils.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#define ASSET_PACK_MAGIC "PACK"
+#define ASSET_PACK_VERSION 2
+
+struct PackHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t numEntries;
+    uint32_t reserved;
+};
+
+static size_t alignUp(size_t value) {
+    return (value + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+}
+
+AssetPack::AssetPack() : data(NULL), size(0), entries(NULL), numEntries(0) {
+}
+
+AssetPack* AssetPack::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(PackHeader)) {
+        mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping keeps the file alive
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Error loading " << path << ": cannot map asset pack" << std::endl;
+        return NULL;
+    }
+
+    AssetPack* pack = new AssetPack();
+    pack->data = (const char*)mapping;
+    pack->size = info.st_size;
+
+    const PackHeader* header = (const PackHeader*)pack->data;
+    bool ok = memcmp(header->magic, ASSET_PACK_MAGIC, 4) == 0
+        && header->version == ASSET_PACK_VERSION
+        && header->numEntries <= (pack->size - sizeof(PackHeader)) / sizeof(Entry);
+    if (ok) {
+        pack->entries = (const Entry*)(pack->data + sizeof(PackHeader));
+        pack->numEntries = header->numEntries;
+    }
+    for (int i = 0; ok && i < pack->numEntries; i++) {
+        const Entry& entry = pack->entries[i];
+        ok = memchr(entry.name, '\0', sizeof(entry.name)) != NULL
+            && entry.offset % ASSET_PACK_ALIGNMENT == 0
+            && entry.offset <= pack->size && entry.size <= pack->size - entry.offset;
+    }
+    if (!ok) {
+        std::cerr << "Error loading " << path << ": not an asset pack" << std::endl;
+        delete pack;
+        return NULL;
+    }
+    return pack;
+}
+
+AssetPack::~AssetPack() {
+    munmap((void*)data, size);
+}
+
+const AssetPack::Entry* AssetPack::find(const std::string& name, AssetType type, time_t sourceTime) const {
+    for (int i = 0; i < numEntries; i++) {
+        const Entry& entry = entries[i];
+        if (entry.type == (uint32_t)type && name == entry.name) {
+            if (sourceTime != 0 && entry.sourceTime != sourceTime) {
+                return NULL;
+            }
+            return &entry;
+        }
+    }
+    return NULL;
+}
+
+const void* AssetPack::getData(const Entry* entry) const {
+    return data + entry->offset;
+}
+
+int AssetPack::getNumEntries() const {
+    return numEntries;
+}
+
+const AssetPack::Entry* AssetPack::getEntry(int index) const {
+    return &entries[index];
+}
+
+const AssetPack* AssetPack::getGamePack() {
+    static AssetPack* pack = open(getAssetFilePath(GAME_ASSET_PACK));
+    return pack;
+}
+
+void AssetPackWriter::add(const std::string& name, AssetType type, const uint32_t* info, time_t sourceTime,
+        const void* payload, size_t size) {
+    AssetPack::Entry entry;
+    memset(&entry, 0, sizeof(entry));
+    if (name.size() >= sizeof(entry.name)) {
+        std::cerr << "Asset pack: name too long, skipping " << name << std::endl;
+        return;
+    }
+    strcpy(entry.name, name.c_str());
+    entry.type = (uint32_t)type;
+    if (info != NULL) {
+        memcpy(entry.info, info, sizeof(entry.info));
+    }
+    entry.sourceTime = sourceTime;
+    // Relative to the first payload until save() knows the table's size
+    entry.offset = payloads.size();
+    entry.size = size;
+    entries.push_back(entry);
+
+    payloads.insert(payloads.end(), (const char*)payload, (const char*)payload + size);
+    payloads.resize(alignUp(payloads.size()), 0);
+}
+
+// Written next to the pack and renamed over it, so a game that has the old
+// pack mapped keeps reading intact data
+bool AssetPackWriter::save(const std::string& path) const {
+    std::string temporary = path + ".tmp";
+    FILE* out = fopen(temporary.c_str(), "wb");
+    if (out == NULL) {
+        return false;
+    }
+
+    PackHeader header;
+    memcpy(header.magic, ASSET_PACK_MAGIC, 4);
+    header.version = ASSET_PACK_VERSION;
+    header.numEntries = entries.size();
+    header.reserved = 0;
+
+    size_t tableEnd = sizeof(header) + entries.size() * sizeof(AssetPack::Entry);
+    size_t payloadStart = alignUp(tableEnd);
+    std::vector<AssetPack::Entry> table = entries;
+    for (AssetPack::Entry& entry : table) {
+        entry.offset += payloadStart;
+    }
+
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(table.data(), sizeof(AssetPack::Entry), table.size(), out);
+    std::vector<char> padding(payloadStart - tableEnd, 0);
+    fwrite(padding.data(), 1, padding.size(), out);
+    fwrite(payloads.data(), 1, payloads.size(), out);
+
+    bool ok = !ferror(out);
+    ok = fclose(out) == 0 && ok;
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+int AssetPackWriter::getNumEntries() const {
+    return entries.size();
+}
+
+size_t AssetPackWriter::getPayloadBytes() const {
+    return payloads.size();
+}
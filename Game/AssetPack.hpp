@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+// The pack the game looks in before decoding any source file
+#define GAME_ASSET_PACK "assets.pack"
+
+// Payloads start on this boundary, so they can be handed to GL or read as
+// arrays of any type straight from the mapping
+#define ASSET_PACK_ALIGNMENT 64
+
+// What an entry holds, and what its four info words mean
+enum class AssetType : uint32_t {
+    // RGBA8 pixels laid out as in TextureImage. info: width, height, layers, levels
+    Texture,
+    // Mesh's interleaved vertex and index block behind a batch table.
+    // info: batches, vertex stride, MeshConsolidatorFlags, index offset
+    Meshes,
+    // A SceneTemplate snapshot
+    Scene,
+    // AnimationClips back to back in their binary format. info: clips
+    Clips
+};
+
+/*
+ * Assets cooked offline by the Cooker tool into one file, a table of
+ * entries followed by their payloads. The file is memory mapped, so finding
+ * an asset is a lookup in the table and its bytes are only read from disk
+ * when they are first touched, typically by the GL upload.
+ *
+ * Entries are keyed by the path the game loads the source from (e.g.
+ * "Assets/tileSet.png", the meshes share MESH_PACK_ENTRY) and remember when
+ * their sources were last modified.
+ * An entry whose sources changed since is ignored, so edited assets are
+ * picked up without recooking.
+ */
+class AssetPack {
+public:
+    struct Entry {
+        char name[48];
+        uint32_t type;     // AssetType
+        uint32_t info[4];  // Per type, see AssetType
+        uint32_t pad;
+        int64_t sourceTime;
+        uint64_t offset;   // From the start of the file
+        uint64_t size;
+    };
+
+    // NULL if the file is missing or not a pack of this version
+    static AssetPack* open(const std::string& path);
+    ~AssetPack();
+
+    // NULL if there is no such entry or its sources changed after cooking.
+    // A sourceTime of 0 (no source file) accepts any entry.
+    const Entry* find(const std::string& name, AssetType type, time_t sourceTime) const;
+    const void* getData(const Entry* entry) const;
+
+    int getNumEntries() const;
+    const Entry* getEntry(int index) const;
+
+    // GAME_ASSET_PACK in the asset directory, mapped on first use. NULL if
+    // the game's assets have not been cooked.
+    static const AssetPack* getGamePack();
+
+private:
+    AssetPack();
+
+    const char* data;
+    size_t size;
+    const Entry* entries;
+    int numEntries;
+};
+
+/*
+ * Builds a pack in memory, the Cooker's side of AssetPack.
+ *
+ *     AssetPackWriter writer;
+ *     writer.add("Assets/dudv.png", AssetType::Texture, info, time, pixels, bytes);
+ *     writer.save(getAssetFilePath(GAME_ASSET_PACK));
+ */
+class AssetPackWriter {
+public:
+    // info may be NULL for types that do not use it
+    void add(const std::string& name, AssetType type, const uint32_t* info, time_t sourceTime,
+        const void* payload, size_t size);
+    bool save(const std::string& path) const;
+
+    int getNumEntries() const;
+    size_t getPayloadBytes() const;
+
+private:
+    std::vector<AssetPack::Entry> entries;
+    std::vector<char> payloads;
+};
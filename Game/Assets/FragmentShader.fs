@@ -1,13 +1,20 @@
 #version 330
 
 // uniform vec3 colour;
-uniform sampler2D tex;
+// One layer per tile of tileSet.png
+uniform sampler2DArray tex;
 uniform sampler2D texShadow;
 uniform sampler2D texWater;
 uniform sampler2D texDUDV;
 uniform vec3 ambientIntensity;
 uniform vec2 moveFactor;
 
+// Shadow cascades, side by side in texShadow. Each maps eye space to the
+// cascade's [0, 1] shadow map coordinates and covers eye depths up to its end.
+const int SHADOW_CASCADES = 3;
+uniform mat4 cascadeFromView[SHADOW_CASCADES];
+uniform float cascadeEnds[SHADOW_CASCADES];
+
 struct LightSource {
     vec3 position;
     vec3 rgbIntensity;
@@ -19,7 +26,6 @@ in VsOutFsIn {
 	vec3 position_ES; // Eye-space position
 	vec3 normal_ES;   // Eye-space normal
 	LightSource light;
-    vec4 shadowCoord;
 } fs_in;
 
 out vec4 fragColor;
@@ -63,8 +69,6 @@ void main() {
     int texNum = int(texcoord.w);
     bool sides = texNum >= 0;
     texNum = abs(texNum);
-    int texCol = texNum % 16;
-    int texRow = texNum / 16;
 
     vec4 color;
 
@@ -87,19 +91,30 @@ void main() {
         }
 
         // Normal
+        // The layers repeat, so the coordinates need no fract() and the mip
+        // level does not jump at block edges
         if (sides) {
-            color = texture(tex, vec2((fract(texcoord.x + texcoord.z) + texCol) / 16.0, ((1 - fract(texcoord.y)) + texRow) / 16.0)) * vec4(0.85, 0.85, 0.85, 1.0);
+            color = texture(tex, vec3(texcoord.x + texcoord.z, 1 - texcoord.y, texNum)) * vec4(0.85, 0.85, 0.85, 1.0);
         } else {
-            color = texture(tex, vec2((fract(texcoord.y + texcoord.x) + texCol) / 16.0, ((1 - fract(texcoord.z)) + texRow) / 16.0));
+            color = texture(tex, vec3(texcoord.y + texcoord.x, 1 - texcoord.z, texNum));
         }
     }
 
 
     // Check Shadow
     float visibility = 1.0;
-    if (fs_in.shadowCoord.x >= 0 && fs_in.shadowCoord.x <= 1 && fs_in.shadowCoord.y >= 0 && fs_in.shadowCoord.y <= 1) {
-        if ( texture( texShadow, fs_in.shadowCoord.xy ).r  <  fs_in.shadowCoord.z - bias) {
-            visibility = 0.5;
+    float depth = -fs_in.position_ES.z;
+    int cascade = 0;
+    while (cascade < SHADOW_CASCADES && depth > cascadeEnds[cascade]) {
+        cascade++;
+    }
+    if (cascade < SHADOW_CASCADES) {
+        vec4 shadowCoord = cascadeFromView[cascade] * vec4(fs_in.position_ES, 1.0);
+        if (shadowCoord.x >= 0 && shadowCoord.x <= 1 && shadowCoord.y >= 0 && shadowCoord.y <= 1) {
+            vec2 atlasCoord = vec2((cascade + shadowCoord.x) / SHADOW_CASCADES, shadowCoord.y);
+            if ( texture( texShadow, atlasCoord ).r  <  shadowCoord.z - bias) {
+                visibility = 0.5;
+            }
         }
     }
 
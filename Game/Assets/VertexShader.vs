@@ -3,10 +3,16 @@
 uniform mat4 P;
 uniform mat4 VM;
 uniform mat3 NormalMatrix;
-uniform mat4 depthBiasMVP;
+// Tile that mesh models are textured with, 0 for chunks which carry their
+// tile in position.w
+uniform int meshTile;
 
-in vec4 position;
-in vec3 normal;
+// Locations shared with shadow_VertexShader.vs
+layout(location = 0) in vec4 position;
+layout(location = 1) in vec3 normal;
+// Per instance for models, a one instance identity for chunks
+layout(location = 2) in mat4 model;
+layout(location = 6) in mat3 modelNormal;
 
 // The light source right now is the Sun
 struct LightSource {
@@ -23,21 +29,18 @@ out VsOutFsIn {
 	vec3 position_ES; // Eye-space position
 	vec3 normal_ES;   // Eye-space normal
 	LightSource light;
-    vec4 shadowCoord;
 } vs_out;
 
 void main() {
-    vs_out.texcoord = position;
-    vs_out.normal_ES = normalize(NormalMatrix * normal);
+    vs_out.texcoord = meshTile != 0 ? vec4(position.xyz, meshTile) : position;
+    vs_out.normal_ES = normalize(NormalMatrix * modelNormal * normal);
     vs_out.light = light;
 
-    vec4 shadowCoord = depthBiasMVP * vec4(position.xyz, 1.0);
-    vs_out.shadowCoord = vec4(shadowCoord.xyz / shadowCoord.w, 1.0);
-
-    vec4 pos4 = VM * vec4(position.xyz, 1.0);
+    vec4 modelPosition = model * vec4(position.xyz, 1.0);
+    vec4 pos4 = VM * modelPosition;
     vs_out.position_ES = pos4.xyz;
     vs_out.clipCoord = P * pos4;
 	gl_Position = vs_out.clipCoord;
 
-    gl_ClipDistance[0] = dot(waterPlane, vec4(position.xyz, 1));
+    gl_ClipDistance[0] = dot(waterPlane, modelPosition);
 }
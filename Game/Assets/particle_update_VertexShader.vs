@@ -0,0 +1,28 @@
+#version 330
+
+// Advances one particle by one tick, the result is captured with transform
+// feedback. Dead particles keep a size of 0 so their quads collapse.
+
+uniform float delta;
+uniform float gravity;
+
+layout (location = 0) in vec4 position; // xyz, size
+layout (location = 1) in vec4 velocity; // xyz, remaining life
+layout (location = 2) in vec4 color;
+
+out vec4 outPosition;
+out vec4 outVelocity;
+out vec4 outColor;
+
+void main() {
+    float life = velocity.w - delta;
+    if (velocity.w <= 0.0 || life <= 0.0) {
+        outPosition = vec4(position.xyz, 0.0);
+        outVelocity = vec4(0.0);
+    } else {
+        vec3 v = velocity.xyz + vec3(0.0, gravity * delta * 0.5, 0.0);
+        outPosition = vec4(position.xyz + v * delta, position.w);
+        outVelocity = vec4(v, life);
+    }
+    outColor = color;
+}
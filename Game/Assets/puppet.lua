@@ -12,13 +12,14 @@ white = gr.material({1.0, 1.0, 1.0}, {0.1, 0.1, 0.1}, 10)
 yellow = gr.material({1.0, 1.0, 0.0}, {0.1, 0.1, 0.1}, 10)
 purple = gr.material({1.0, 0.0, 1.0}, {0.1, 0.1, 0.1}, 10)
 
-function makeLimb(isUpper)
+-- side prefixes the joint names so animation clips can tell the limbs apart
+function makeLimb(isUpper, side)
     limbLen = 0.3
     if isUpper then
-        shoulderJoint = gr.joint('shoulderJoint', {180, 360, 360}, {0, 0, 0})
+        shoulderJoint = gr.joint(side .. 'ShoulderJoint', {180, 360, 360}, {0, 0, 0})
     else
         limbLen = 0.5
-        shoulderJoint = gr.joint('thighJoint', {-90, 0, 60}, {0, 0, 0})
+        shoulderJoint = gr.joint(side .. 'ThighJoint', {-90, 0, 60}, {0, 0, 0})
     end
 
     shoulder = gr.mesh('sphere', 'shoulder')
@@ -33,9 +34,9 @@ function makeLimb(isUpper)
     shoulderJoint:add_child(upper)
 
     if isUpper then
-        elbowJoint = gr.joint('elbowJoint', {-160, -80, 0}, {0, 0, 0})
+        elbowJoint = gr.joint(side .. 'ElbowJoint', {-160, -80, 0}, {0, 0, 0})
     else
-        elbowJoint = gr.joint('kneeJoint', {0, 0, 120}, {0, 0, 0})
+        elbowJoint = gr.joint(side .. 'KneeJoint', {0, 0, 120}, {0, 0, 0})
     end
 
     elbowJoint:translate(0, -limbLen, 0);
@@ -63,14 +64,15 @@ function makeShoulder(isUpper)
     shoulder:set_material(yellow);
     centreJoint:add_child(shoulder)
 
-    leftArm = makeLimb(isUpper)
-    leftArm:translate(-0.3, 0.0, 0.0)
-    centreJoint:add_child(leftArm)
-
-    rightArm = makeLimb(isUpper)
-    rightArm:translate(0.3, 0.0, 0.0)
+    -- The puppet faces +z, so its right side is at -x
+    rightArm = makeLimb(isUpper, 'right')
+    rightArm:translate(-0.3, 0.0, 0.0)
     centreJoint:add_child(rightArm)
 
+    leftArm = makeLimb(isUpper, 'left')
+    leftArm:translate(0.3, 0.0, 0.0)
+    centreJoint:add_child(leftArm)
+
     return centreJoint
 end
 
@@ -0,0 +1,19 @@
+-- puppet_anim.lua
+-- Keyframed clips for puppet.lua, loaded with import_lua_clips.
+--
+-- gr.clip(name, duration, loop) makes a clip, clip:channel(joint, axis,
+-- times, angles) adds a curve of joint angles in degrees, interpolated
+-- linearly between keys. Times are in animation steps: characters advance
+-- 0.2 per simulation tick while walking or attacking.
+
+walk = gr.clip('walk', 2, true)
+walk:channel('leftThighJoint', 'x', {0, 1, 2}, {-25, 30, -25})
+walk:channel('rightThighJoint', 'x', {0, 1, 2}, {30, -25, 30})
+walk:channel('leftShoulderJoint', 'x', {0, 1, 2}, {360, 330, 360})
+walk:channel('rightShoulderJoint', 'x', {0, 1, 2}, {330, 360, 330})
+
+-- Played over walk, only swings the right arm
+smash = gr.clip('smash', 2, false)
+smash:channel('rightShoulderJoint', 'x', {0, 1, 2}, {360, 300, 360})
+
+return {walk, smash}
@@ -1,8 +1,11 @@
 #version 330
 
 uniform mat4 MVP;
-in vec3 position;
+// Locations shared with VertexShader.vs
+layout(location = 0) in vec3 position;
+// Per instance for models, a one instance identity for chunks
+layout(location = 2) in mat4 model;
 
 void main() {
-    gl_Position = MVP * vec4(position, 1.0);
+    gl_Position = MVP * model * vec4(position, 1.0);
 }
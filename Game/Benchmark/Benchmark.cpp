@@ -0,0 +1,464 @@
+/*
+ * Microbenchmarks for the game's hot paths. No window or GL context needed.
+ * Run from the Game directory:
+ *
+ *     $ ./BenchmarkRunner [--warmup N] [--iterations N] [--filter name] [--json file|-]
+ *
+ * Every benchmark runs its warmup iterations untimed, then times each
+ * iteration separately and reports min/median/mean/max. With --json the
+ * results are also written as JSON so runs can be compared across commits.
+ */
+
+#include "Animation.hpp"
+#include "AssetPack.hpp"
+#include "Chunk.hpp"
+#include "ChunkManager.hpp"
+#include "GLUtils.hpp"
+#include "ParticlePool.hpp"
+#include "Perlin.hpp"
+#include "SceneCache.hpp"
+#include "SceneNode.hpp"
+#include "SimulationClock.hpp"
+#include "Utils.hpp"
+#include "scene_lua.hpp"
+
+#include "cs488-framework/ObjFileDecoder.hpp"
+
+#include <lodepng/lodepng.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct BenchmarkResult {
+    string name;
+    int iterations;
+    unsigned long itemsPerIteration;
+    unsigned long bytesPerIteration; // 0 if the benchmark does not read input
+    double minNs, medianNs, meanNs, maxNs, stddevNs;
+};
+
+struct BenchmarkOptions {
+    int warmup;
+    int iterations;
+    const char* filter;
+    const char* jsonPath;
+};
+
+// Keeps the optimizer from throwing away benchmarked work
+static volatile double benchmarkSink;
+
+typedef chrono::steady_clock Clock;
+
+static BenchmarkResult runBenchmark(const BenchmarkOptions& options, const string& name,
+        unsigned long itemsPerIteration, unsigned long bytesPerIteration, function<void()> fn) {
+    for (int i = 0; i < options.warmup; i++) {
+        fn();
+    }
+
+    vector<double> samples(options.iterations);
+    for (int i = 0; i < options.iterations; i++) {
+        Clock::time_point start = Clock::now();
+        fn();
+        samples[i] = chrono::duration<double, nano>(Clock::now() - start).count();
+    }
+
+    BenchmarkResult result;
+    result.name = name;
+    result.iterations = options.iterations;
+    result.itemsPerIteration = itemsPerIteration;
+    result.bytesPerIteration = bytesPerIteration;
+
+    double sum = 0;
+    for (double s : samples) {
+        sum += s;
+    }
+    result.meanNs = sum / samples.size();
+
+    double variance = 0;
+    for (double s : samples) {
+        variance += (s - result.meanNs) * (s - result.meanNs);
+    }
+    result.stddevNs = sqrt(variance / samples.size());
+
+    sort(samples.begin(), samples.end());
+    result.minNs = samples.front();
+    result.maxNs = samples.back();
+    result.medianNs = samples[samples.size() / 2];
+    return result;
+}
+
+static void printResult(const BenchmarkResult& r) {
+    double itemsPerSecond = r.itemsPerIteration / (r.medianNs * 1e-9);
+    printf("%-28s %12.0f %12.0f %12.0f %12.0f ns %14.0f items/s",
+        r.name.c_str(), r.minNs, r.medianNs, r.meanNs, r.maxNs, itemsPerSecond);
+    if (r.bytesPerIteration > 0) {
+        printf(" %10.1f MB/s", r.bytesPerIteration / (r.medianNs * 1e-9) / (1024 * 1024));
+    }
+    printf("\n");
+}
+
+static bool writeJson(const char* path, const BenchmarkOptions& options, const vector<BenchmarkResult>& results) {
+    FILE* out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return false;
+    }
+
+    fprintf(out, "{\n  \"warmup\": %d,\n  \"iterations\": %d,\n  \"benchmarks\": [\n",
+        options.warmup, options.iterations);
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult& r = results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"iterations\": %d, \"items_per_iteration\": %lu, \"bytes_per_iteration\": %lu, "
+            "\"min_ns\": %.1f, \"median_ns\": %.1f, \"mean_ns\": %.1f, \"max_ns\": %.1f, \"stddev_ns\": %.1f}%s\n",
+            r.name.c_str(), r.iterations, r.itemsPerIteration, r.bytesPerIteration,
+            r.minNs, r.medianNs, r.meanNs, r.maxNs, r.stddevNs,
+            i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    BenchmarkOptions options;
+    options.warmup = 3;
+    options.iterations = 20;
+    options.filter = NULL;
+    options.jsonPath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            options.warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            options.iterations = max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            options.jsonPath = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--warmup N] [--iterations N] [--filter name] [--json file|-]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    vector<BenchmarkResult> results;
+    // bytes is the input read per iteration, reported as MB/s
+    auto benchBytes = [&](const string& name, unsigned long items, unsigned long bytes, function<void()> fn) {
+        if (options.filter != NULL && name.find(options.filter) == string::npos) {
+            return;
+        }
+        results.push_back(runBenchmark(options, name, items, bytes, fn));
+        // Keep stdout clean when the JSON goes there
+        if (options.jsonPath == NULL || strcmp(options.jsonPath, "-") != 0) {
+            printResult(results.back());
+        }
+    };
+    auto bench = [&](const string& name, unsigned long items, function<void()> fn) {
+        benchBytes(name, items, 0, fn);
+    };
+
+    if (options.jsonPath == NULL || strcmp(options.jsonPath, "-") != 0) {
+        printf("%-28s %12s %12s %12s %12s\n", "benchmark", "min", "median", "mean", "max");
+    }
+
+    // Fixed inputs so every run measures the same work
+    srand(0);
+    Perlin* perlin = Perlin::instance();
+
+    const int perlinSamples = 4096;
+    bench("perlin_octave", perlinSamples, [&]() {
+        double total = 0;
+        for (int i = 0; i < perlinSamples; i++) {
+            glm::vec2 pos = glm::vec2((i % 64) / (float)CHUNK_SIZE, (i / 64) / (float)CHUNK_SIZE);
+            total += perlin->OctavePerlin(pos, 4, 2);
+        }
+        benchmarkSink = total;
+    });
+
+    const int terrainChunks = 16;
+    bench("chunk_create_terrain", terrainChunks, [&]() {
+        for (int i = 0; i < terrainChunks; i++) {
+            Chunk chunk(glm::vec3((i % 4) * CHUNK_SIZE, 0, (i / 4) * CHUNK_SIZE));
+            chunk.createTerrain(perlin);
+            benchmarkSink = chunk.getBlock(0, 0, 0);
+        }
+    });
+
+    vector<Chunk*> meshChunks;
+    for (int i = 0; i < terrainChunks; i++) {
+        Chunk* chunk = new Chunk(glm::vec3((i % 4) * CHUNK_SIZE, 0, (i / 4) * CHUNK_SIZE));
+        chunk->createTerrain(perlin);
+        meshChunks.push_back(chunk);
+    }
+    bench("chunk_mesh", terrainChunks, [&]() {
+        for (Chunk* chunk : meshChunks) {
+            chunk->updateBlock();
+            benchmarkSink = chunk->getNumVertices();
+        }
+    });
+    for (Chunk* chunk : meshChunks) {
+        delete chunk;
+    }
+
+    ChunkManager* world = new ChunkManager();
+    glm::vec3 origin = glm::vec3(8, 8, 8);
+    world->update(origin);
+
+    const int queries = 100000;
+    vector<glm::vec3> queryPoints(queries);
+    for (glm::vec3& p : queryPoints) {
+        p = origin + glm::vec3(
+            ((float)rand() / RAND_MAX) * 64 - 32,
+            ((float)rand() / RAND_MAX) * 16,
+            ((float)rand() / RAND_MAX) * 64 - 32);
+    }
+    bench("chunk_manager_solid_block", queries, [&]() {
+        int solid = 0;
+        for (glm::vec3& p : queryPoints) {
+            solid += world->solidBlock(p);
+        }
+        benchmarkSink = solid;
+    });
+
+    const int sweeps = 10000;
+    bench("chunk_manager_sweep_aabb", sweeps, [&]() {
+        float total = 0;
+        for (int i = 0; i < sweeps; i++) {
+            glm::vec3 p = queryPoints[i];
+            glm::vec3 delta = queryPoints[i + sweeps] - origin;
+            SweepResult sweep = world->sweepAABB(p, p + glm::vec3(1, 1.8, 1), glm::normalize(delta) * 0.5f);
+            total += sweep.time;
+        }
+        benchmarkSink = total;
+    });
+
+    // Particles scattered over the terrain above, a tiny time step keeps
+    // them all alive so only the collision pass differs from particles_update
+    ParticlePool* scattered = new ParticlePool();
+    for (int i = 0; i < MAX_PARTICLES; i++) {
+        scattered->addParticle(queryPoints[i % queries], glm::vec3(0, -4, 0), glm::vec4(1), 0.25f);
+    }
+    scattered->setCollision(world, ParticleCollision::BOUNCE);
+    bench("particles_update_collide", MAX_PARTICLES, [&]() {
+        scattered->update(origin, 1e-6f);
+    });
+
+    vector<float> packedPositions(4 * MAX_PARTICLES);
+    vector<float> packedColors(4 * MAX_PARTICLES);
+    bench("particles_pack", MAX_PARTICLES, [&]() {
+        benchmarkSink = scattered->pack(&packedPositions[0], &packedColors[0]);
+    });
+    scattered->setSorting(true);
+    bench("particles_pack_sorted", MAX_PARTICLES, [&]() {
+        benchmarkSink = scattered->pack(&packedPositions[0], &packedColors[0]);
+    });
+    delete scattered;
+    delete world;
+
+    ParticlePool* pool = new ParticlePool();
+    bench("particles_spawn", MAX_PARTICLES, [&]() {
+        pool->clear();
+        for (int i = 0; i < MAX_PARTICLES; i++) {
+            pool->addParticle(glm::vec3(0), glm::vec3(0, 4, 0), glm::vec4(1), 0.25f);
+        }
+    });
+
+    // A tiny time step keeps the pool full for every iteration
+    bench("particles_update", MAX_PARTICLES, [&]() {
+        pool->update(glm::vec3(0), 1e-6f);
+    });
+    delete pool;
+
+    bench("lua_scene_load", 1, [&]() {
+        SceneNode* root = import_lua(getAssetFilePath("puppet.lua"));
+        benchmarkSink = root != NULL;
+        delete root;
+    });
+
+    SceneNode* puppetRoot = import_lua(getAssetFilePath("puppet.lua"));
+    SceneTemplate* puppetTemplate = SceneTemplate::fromTree(puppetRoot);
+    delete puppetRoot;
+    bench("scene_instantiate", 1, [&]() {
+        SceneNode* root = puppetTemplate->instantiate();
+        benchmarkSink = root != NULL;
+        delete root;
+    });
+
+    const string snapshotPath = "benchmark_scene.scene";
+    if (puppetTemplate->save(snapshotPath)) {
+        bench("scene_snapshot_load", 1, [&]() {
+            SceneTemplate* scene = SceneTemplate::load(snapshotPath);
+            benchmarkSink = scene != NULL;
+            delete scene;
+        });
+        remove(snapshotPath.c_str());
+    }
+
+    // Items are output triangles
+    const char* objFiles[] = {"cube", "sphere", "suzanne"};
+    for (const char* objFile : objFiles) {
+        string path = getAssetFilePath((string(objFile) + ".obj").c_str());
+        FILE* in = fopen(path.c_str(), "rb");
+        if (in == NULL) {
+            continue;
+        }
+        fseek(in, 0, SEEK_END);
+        unsigned long bytes = ftell(in);
+        fclose(in);
+
+        string objectName;
+        vector<glm::vec3> positions, normals;
+        vector<glm::vec2> uvCoords;
+        vector<unsigned int> indices;
+        ObjFileDecoder::decode(path.c_str(), objectName, positions, normals);
+        unsigned long triangles = positions.size() / 3;
+
+        benchBytes(string("obj_decode_") + objFile, triangles, bytes, [&]() {
+            ObjFileDecoder::decode(path.c_str(), objectName, positions, normals);
+            benchmarkSink = positions.size();
+        });
+        benchBytes(string("obj_decode_indexed_") + objFile, triangles, bytes, [&]() {
+            ObjFileDecoder::decodeIndexed(path.c_str(), objectName, positions, normals, uvCoords, indices);
+            benchmarkSink = indices.size();
+        });
+    }
+
+    bench("animation_clip_load_lua", 1, [&]() {
+        vector<AnimationClip*> clips = import_lua_clips(getAssetFilePath("puppet_anim.lua"));
+        benchmarkSink = clips.size();
+        for (AnimationClip* clip : clips) {
+            delete clip;
+        }
+    });
+
+    vector<AnimationClip*> clips = import_lua_clips(getAssetFilePath("puppet_anim.lua"));
+    const string clipPath = "benchmark_clip.anim";
+    if (!clips.empty() && clips[0]->save(clipPath)) {
+        bench("animation_clip_load_binary", 1, [&]() {
+            AnimationClip* clip = AnimationClip::load(clipPath);
+            benchmarkSink = clip != NULL;
+            delete clip;
+        });
+        remove(clipPath.c_str());
+    }
+
+    // Startup loads from the sources against the cooked pack. The pack side
+    // copies the data out where the game hands it to GL.
+    const string texturePath = getAssetFilePath("tileSet.png");
+    FILE* png = fopen(texturePath.c_str(), "rb");
+    if (png != NULL) {
+        fseek(png, 0, SEEK_END);
+        unsigned long pngBytes = ftell(png);
+        fclose(png);
+        benchBytes("asset_texture_png", 1, pngBytes, [&]() {
+            vector<unsigned char> image;
+            unsigned width, height;
+            lodepng::decode(image, width, height, texturePath);
+            benchmarkSink = image.size();
+        });
+    }
+    // From the PNG, a game pack would already hold the cut tiles
+    TextureImage atlas;
+    atlas.layers = atlas.levels = 1;
+    if (lodepng::decode(atlas.decoded, atlas.width, atlas.height, texturePath) == 0) {
+        atlas.pixels = &atlas.decoded[0];
+        TextureImage tiles;
+        Texture::splitTiles(atlas, TILESET_COLUMNS, tiles);
+        bench("tileset_layers", tiles.layers, [&]() {
+            Texture::splitTiles(atlas, TILESET_COLUMNS, tiles);
+            benchmarkSink = tiles.decoded.size();
+        });
+    }
+    bench("asset_meshes_obj", 1, [&]() {
+        MeshConsolidator* meshes = Mesh::consolidate();
+        benchmarkSink = meshes->getNumDataBytes();
+        delete meshes;
+    });
+
+    const string packPath = "benchmark_assets.pack";
+    AssetPackWriter writer;
+    bool cooked = Mesh::cook(writer) && Texture::cookTiles(writer, texturePath, TILESET_COLUMNS)
+        && writer.save(packPath);
+    AssetPack* pack = cooked ? AssetPack::open(packPath) : NULL;
+    const AssetPack::Entry* texture = pack != NULL ? pack->find(texturePath, AssetType::Texture, 0) : NULL;
+    const AssetPack::Entry* meshes = pack != NULL ? pack->find(MESH_PACK_ENTRY, AssetType::Meshes, 0) : NULL;
+    if (texture != NULL && meshes != NULL) {
+        unsigned long tileBytes = texture->size;
+        unsigned long meshBytes = meshes->size;
+        delete pack;
+
+        vector<char> upload;
+        auto loadCooked = [&](const string& name, AssetType type, size_t bytes) {
+            AssetPack* pack = AssetPack::open(packPath);
+            const AssetPack::Entry* entry = pack != NULL ? pack->find(name, type, 0) : NULL;
+            if (entry != NULL) {
+                upload.assign((const char*)pack->getData(entry), (const char*)pack->getData(entry) + bytes);
+            }
+            benchmarkSink = upload.size();
+            delete pack;
+        };
+        benchBytes("asset_texture_pack", 1, tileBytes, [&]() {
+            loadCooked(texturePath, AssetType::Texture, tileBytes);
+        });
+        benchBytes("asset_meshes_pack", 1, meshBytes, [&]() {
+            loadCooked(MESH_PACK_ENTRY, AssetType::Meshes, meshBytes);
+        });
+    } else {
+        fprintf(stderr, "Cannot cook %s, asset pack benchmarks skipped\n", packPath.c_str());
+        delete pack;
+    }
+    remove(packPath.c_str());
+
+    // Every skeleton walks at its own phase, a tenth also smash
+    const int skeletons = 500;
+    vector<SceneNode*> puppets;
+    AnimationBatch animations;
+    for (int i = 0; i < skeletons; i++) {
+        puppets.push_back(puppetTemplate->instantiate());
+        animations.add(puppets.back());
+    }
+    vector<int> clipHandles;
+    for (AnimationClip* clip : clips) {
+        clipHandles.push_back(animations.bindClip(clip));
+    }
+    if (clipHandles.size() >= 2) {
+        float time = 0;
+        bench("animation_evaluate", skeletons, [&]() {
+            time += 0.2f;
+            for (int i = 0; i < skeletons; i++) {
+                animations.play(i, 0, clipHandles[0], time + i * 0.01f, 1);
+                animations.play(i, 1, clipHandles[1], fmod(time, 2), i % 10 == 0 ? 1 : 0);
+            }
+            animations.evaluate();
+            benchmarkSink = animations.getAngle(skeletons - 1, 0, JointAxis::X);
+        });
+        bench("animation_apply", skeletons, [&]() {
+            animations.apply();
+            benchmarkSink = puppets.back()->dirty;
+        });
+    }
+    for (SceneNode* puppet : puppets) {
+        delete puppet;
+    }
+    delete puppetTemplate;
+    for (AnimationClip* clip : clips) {
+        delete clip;
+    }
+
+    if (options.jsonPath != NULL && !writeJson(options.jsonPath, options, results)) {
+        return 1;
+    }
+    return 0;
+}
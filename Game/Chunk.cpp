@@ -1,4 +1,6 @@
 #include "Chunk.hpp"
+#include "GLState.hpp"
+#include "Profiler.hpp"
 #include "cs488-framework/GlErrorCheck.hpp"
 
 #include <iostream>
@@ -14,6 +16,10 @@ Chunk::Chunk(glm::vec3 position) :
 
     numVertices = 0;
     requireUpdate = true;
+    requireUpload = false;
+    hasGraphicsMemory = false;
+    topHeight = position.y;
+    water = false;
 
     for (int i = 0; i < CHUNK_SIZE; i++) {
         for (int j = 0; j < CHUNK_SIZE; j++) {
@@ -25,8 +31,9 @@ Chunk::Chunk(glm::vec3 position) :
 
     m_model = glm::translate(glm::mat4(), m_position);
 
-    cube_shader = CubeShader::getShader();
-    shadow_shader = ShadowShader::getShader();
+    // Shaders are looked up on upload so chunks can live without a GL context
+    cube_shader = NULL;
+    shadow_shader = NULL;
 }
 
 Chunk::~Chunk() {
@@ -34,10 +41,11 @@ Chunk::~Chunk() {
 }
 
 void Chunk::deleteGraphicsMemory() {
-    if (numVertices > 0) {
+    if (hasGraphicsMemory) {
         glDeleteBuffers(1, &m_vbo);
-        glDeleteVertexArrays(1, &m_vao_cube);
-        glDeleteVertexArrays(1, &m_vao_shadow);
+        GLState::deleteVertexArrays(1, &m_vao_cube);
+        GLState::deleteVertexArrays(1, &m_vao_shadow);
+        hasGraphicsMemory = false;
     }
 }
 
@@ -48,12 +56,41 @@ BlockType Chunk::getBlock(int x, int y, int z) {
 void Chunk::setBlock(int x, int y, int z, BlockType type) {
     blocks[x][y][z] = type;
     requireUpdate = true;
+    updateBounds();
+}
+
+float Chunk::getTopHeight() {
+    return topHeight;
+}
+
+bool Chunk::hasWater() {
+    return water;
+}
+
+void Chunk::updateBounds() {
+    int top = 0;
+    water = false;
+    for (int i = 0; i < CHUNK_SIZE; i++) {
+        for (int j = 0; j < CHUNK_SIZE; j++) {
+            for (int k = 0; k < CHUNK_SIZE; k++) {
+                if (blocks[i][j][k] == BlockType::EMPTY) {
+                    continue;
+                }
+                top = glm::max(top, j + 1);
+                water = water || blocks[i][j][k] == BlockType::WATER;
+            }
+        }
+    }
+    topHeight = m_position.y + top;
 }
 
 void Chunk::renderShadow(glm::mat4& VP) {
     if (requireUpdate) {
         updateBlock();
     }
+    if (requireUpload) {
+        uploadMesh();
+    }
 
     if (numVertices == 0) {
         return;
@@ -62,16 +99,19 @@ void Chunk::renderShadow(glm::mat4& VP) {
     glUniformMatrix4fv( shadow_shader->MVP_uni, 1, GL_FALSE, value_ptr( MVP ) );
 
     glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-    glBindVertexArray(m_vao_shadow);
+    GLState::bindVertexArray(m_vao_shadow);
     glDrawArrays(GL_TRIANGLES, 0, numCubeVertices);
 
     CHECK_GL_ERRORS;
 }
 
-void Chunk::render(glm::mat4& view, glm::mat4& depth) {
+void Chunk::render(glm::mat4& view) {
     if (requireUpdate) {
         updateBlock();
     }
+    if (requireUpload) {
+        uploadMesh();
+    }
 
     if (numVertices == 0) {
         return;
@@ -80,18 +120,19 @@ void Chunk::render(glm::mat4& view, glm::mat4& depth) {
 
     glm::mat4 VM = view * m_model;
     glm::mat3 N = glm::mat3(transpose(inverse(VM)));
-    glm::mat4 depthMVP = depth * m_model;
 
     glUniformMatrix4fv( cube_shader->VM_uni, 1, GL_FALSE, value_ptr( VM ) );
     glUniformMatrix3fv( cube_shader->Normal_Matrix_uni, 1, GL_FALSE, value_ptr( N ) );
-    glUniformMatrix4fv( cube_shader->depthBiasMVP_uni, 1, GL_FALSE, value_ptr( depthMVP ) );
 
-    glBindVertexArray(m_vao_cube);
+    GLState::bindVertexArray(m_vao_cube);
     glDrawArrays(GL_TRIANGLES, 0, numCubeVertices);
 
-    glDisable(GL_CULL_FACE);
-    glDrawArrays(GL_TRIANGLES, numCubeVertices, numVertices);
-    glEnable(GL_CULL_FACE);
+    // Grass blades are seen from both sides
+    if (numVertices > numCubeVertices) {
+        GLState::disable(GL_CULL_FACE);
+        glDrawArrays(GL_TRIANGLES, numCubeVertices, numVertices - numCubeVertices);
+        GLState::enable(GL_CULL_FACE);
+    }
 
     CHECK_GL_ERRORS;
 }
@@ -110,9 +151,8 @@ void Chunk::setCubeVertex(float* verts ,int& i, float x, float y, float z, int t
 }
 
 void Chunk::updateBlock() {
+    PROFILE_ZONE("Chunk::updateBlock");
     requireUpdate = false;
-    // remove previous allocated memory if there is any
-    deleteGraphicsMemory();
 
     size_t vertex_size = 7; // each vertex takes 5 floats
     size_t vertex_per_cube = 6 * 6;
@@ -392,33 +432,62 @@ void Chunk::updateBlock() {
 
     numVertices = x / vertex_size;
 
+    vertexData.assign(verts, verts + x);
+    requireUpload = true;
+    delete [] verts;
+}
+
+void Chunk::uploadMesh() {
+    PROFILE_ZONE("Chunk::uploadMesh");
+    requireUpload = false;
+    // remove previous allocated memory if there is any
+    deleteGraphicsMemory();
+
     if (numVertices == 0) {
-        delete [] verts;
         return;
-    } else {
-        // Create the cube vertex buffer
-        glGenBuffers( 1, &m_vbo );
-        glBindBuffer( GL_ARRAY_BUFFER, m_vbo );
-        glBufferData( GL_ARRAY_BUFFER, x * sizeof(float), verts, GL_STATIC_DRAW );
+    }
 
-        glGenVertexArrays( 1, &m_vao_cube );
-        glBindVertexArray( m_vao_cube );
+    cube_shader = CubeShader::getShader();
+    shadow_shader = ShadowShader::getShader();
 
-        glEnableVertexAttribArray( cube_shader->positionAttrib );
-        glVertexAttribPointer( cube_shader->positionAttrib, 4, GL_FLOAT, GL_FALSE, vertex_size * sizeof(float), nullptr );
+    size_t vertex_size = 7;
 
-        glEnableVertexAttribArray( cube_shader->normalAttrib );
-        glVertexAttribPointer( cube_shader->normalAttrib, 3, GL_FLOAT, GL_FALSE, vertex_size * sizeof(float), (void*)(4 * sizeof(float)));
+    // Create the cube vertex buffer
+    glGenBuffers( 1, &m_vbo );
+    glBindBuffer( GL_ARRAY_BUFFER, m_vbo );
+    glBufferData( GL_ARRAY_BUFFER, vertexData.size() * sizeof(float), &vertexData[0], GL_STATIC_DRAW );
 
-        glGenVertexArrays( 1, &m_vao_shadow );
-        glBindVertexArray( m_vao_shadow );
+    glGenVertexArrays( 1, &m_vao_cube );
+    GLState::bindVertexArray( m_vao_cube );
 
-        glEnableVertexAttribArray( shadow_shader->positionAttrib );
-        glVertexAttribPointer( shadow_shader->positionAttrib, 4, GL_FLOAT, GL_FALSE, vertex_size * sizeof(float), nullptr );
+    glEnableVertexAttribArray( cube_shader->positionAttrib );
+    glVertexAttribPointer( cube_shader->positionAttrib, 4, GL_FLOAT, GL_FALSE, vertex_size * sizeof(float), nullptr );
 
-        delete [] verts;
-        CHECK_GL_ERRORS;
-    }
+    glEnableVertexAttribArray( cube_shader->normalAttrib );
+    glVertexAttribPointer( cube_shader->normalAttrib, 3, GL_FLOAT, GL_FALSE, vertex_size * sizeof(float), (void*)(4 * sizeof(float)));
+    bindIdentityModel( cube_shader->modelAttrib, cube_shader->modelNormalAttrib );
+
+    glGenVertexArrays( 1, &m_vao_shadow );
+    GLState::bindVertexArray( m_vao_shadow );
+    glBindBuffer( GL_ARRAY_BUFFER, m_vbo );
+
+    glEnableVertexAttribArray( shadow_shader->positionAttrib );
+    glVertexAttribPointer( shadow_shader->positionAttrib, 4, GL_FLOAT, GL_FALSE, vertex_size * sizeof(float), nullptr );
+    bindIdentityModel( shadow_shader->modelAttrib );
+
+    hasGraphicsMemory = true;
+
+    // The GPU owns the vertices now
+    std::vector<float>().swap(vertexData);
+    CHECK_GL_ERRORS;
+}
+
+bool Chunk::needsUpdate() {
+    return requireUpdate;
+}
+
+unsigned int Chunk::getNumVertices() {
+    return numVertices;
 }
 
 glm::vec3 Chunk::getPosition() {
@@ -478,6 +547,7 @@ void Chunk::createTerrain(Perlin* perlin) {
             }
         }
     }
+    updateBounds();
 }
 
 bool passableBlock(BlockType block) {
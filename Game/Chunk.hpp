@@ -4,6 +4,8 @@
 #include "cs488-framework/OpenGLImport.hpp"
 #include <glm/glm.hpp>
 
+#include <vector>
+
 #include "Perlin.hpp"
 #include "GLUtils.hpp"
 
@@ -26,6 +28,8 @@ enum BlockType {
 
 bool transparentBlock(BlockType block);
 bool passableBlock(BlockType block);
+// Layer of the block texture array a face samples, the mesher writes it into
+// each vertex's w. The top of water (255) samples the reflection instead.
 unsigned int getBlockFace(BlockType type, unsigned face);
 
 class Chunk {
@@ -34,29 +38,43 @@ public:
     ~Chunk();
     BlockType getBlock(int x, int y, int z);
     void setBlock(int x, int y, int z, BlockType type);
-    void render(glm::mat4& view, glm::mat4& depth);
+    void render(glm::mat4& view);
     void renderShadow(glm::mat4& VP);
     glm::vec3 getPosition();
+    // World height of the top of the highest block, the bottom when empty
+    float getTopHeight();
+    bool hasWater();
 
     void createTerrain(Perlin* perlin);
 
+    // Rebuilds the vertex data on the CPU, uploaded on the next render
+    void updateBlock();
+    bool needsUpdate();
+    unsigned int getNumVertices();
+
 private:
+    void updateBounds();
     void deleteGraphicsMemory();
-    void updateBlock();
+    void uploadMesh();
     void setCubeVertex(float* verts ,int& i, float x, float y, float z, int type, int face);
     bool requireUpdate;
+    bool requireUpload;
+    bool hasGraphicsMemory;
     bool surrounded(int x, int y, int z);
     glm::vec3 getFaceNormal(int face);
 
     // Open Gl Variables
     unsigned int numVertices;
     unsigned int numCubeVertices;
+    std::vector<float> vertexData;
     GLuint m_vbo;
     GLuint m_vao_cube;
     GLuint m_vao_shadow;
 
     glm::vec3 m_position;
     glm::mat4 m_model;
+    float topHeight;
+    bool water;
 
     BlockType blocks[CHUNK_SIZE][CHUNK_SIZE][CHUNK_SIZE];
 
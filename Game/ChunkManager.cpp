@@ -1,11 +1,14 @@
 #include "ChunkManager.hpp"
+#include "Profiler.hpp"
+#include "Utils.hpp"
+#include <climits>
 #include <cstdlib>
 #include <iostream>
 #include <cmath>
 
 #include <glm/gtc/noise.hpp>
 
-ChunkManager::ChunkManager() {
+ChunkManager::ChunkManager() : allChanged(false) {
     m_player_position = glm::vec3(999, 999, 999);
     perlin = Perlin::instance();
 
@@ -33,28 +36,124 @@ ChunkManager::~ChunkManager() {
     }
 }
 
-void ChunkManager::render(glm::mat4& view, glm::mat4& depth) {
+void ChunkManager::render(glm::mat4& view) {
+    PROFILE_ZONE("ChunkManager::render");
     for (int x = 0; x < CHUNK_LIST_X; x++) {
         for (int y = 0; y < CHUNK_LIST_Y; y++) {
             for (int z = 0; z < CHUNK_LIST_Z; z++) {
                 if (chunks[x][y][z] != NULL) {
-                    chunks[x][y][z]->render(view, depth);
+                    chunks[x][y][z]->render(view);
                 }
             }
         }
     }
 }
 
+// Only chunks inside the light's box are drawn, each cascade covers a small
+// part of the world
 void ChunkManager::renderShadow(glm::mat4& VP) {
+    PROFILE_ZONE("ChunkManager::renderShadow");
+    Frustum frustum(VP);
+    for (int x = 0; x < CHUNK_LIST_X; x++) {
+        for (int y = 0; y < CHUNK_LIST_Y; y++) {
+            for (int z = 0; z < CHUNK_LIST_Z; z++) {
+                Chunk* chunk = chunks[x][y][z];
+                if (chunk == NULL) {
+                    continue;
+                }
+                glm::vec3 min = chunk->getPosition();
+                if (frustum.intersects(min, min + glm::vec3(CHUNK_SIZE))) {
+                    chunk->renderShadow(VP);
+                }
+            }
+        }
+    }
+}
+
+// Everything below the water plane is clipped in the reflection, so chunks
+// that do not reach above it are skipped before any vertex work
+void ChunkManager::renderReflection(glm::mat4& view, glm::mat4& VP) {
+    PROFILE_ZONE("ChunkManager::renderReflection");
+    Frustum frustum(VP);
+    for (int x = 0; x < CHUNK_LIST_X; x++) {
+        for (int y = 0; y < CHUNK_LIST_Y; y++) {
+            for (int z = 0; z < CHUNK_LIST_Z; z++) {
+                Chunk* chunk = chunks[x][y][z];
+                if (chunk == NULL || chunk->getTopHeight() <= WATER_LEVEL) {
+                    continue;
+                }
+                glm::vec3 min = chunk->getPosition();
+                glm::vec3 max = glm::vec3(min.x + CHUNK_SIZE, chunk->getTopHeight(), min.z + CHUNK_SIZE);
+                if (frustum.intersects(glm::vec3(min.x, glm::max(min.y, (float)WATER_LEVEL), min.z), max)) {
+                    chunk->render(view);
+                }
+            }
+        }
+    }
+}
+
+bool ChunkManager::waterVisible(glm::mat4& VP) {
+    Frustum frustum(VP);
+    for (int x = 0; x < CHUNK_LIST_X; x++) {
+        for (int y = 0; y < CHUNK_LIST_Y; y++) {
+            for (int z = 0; z < CHUNK_LIST_Z; z++) {
+                Chunk* chunk = chunks[x][y][z];
+                if (chunk == NULL || !chunk->hasWater()) {
+                    continue;
+                }
+                glm::vec3 min = chunk->getPosition();
+                if (frustum.intersects(glm::vec3(min.x, WATER_LEVEL - 1, min.z),
+                                       glm::vec3(min.x + CHUNK_SIZE, WATER_LEVEL, min.z + CHUNK_SIZE))) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+int ChunkManager::updateMeshes() {
+    PROFILE_ZONE("ChunkManager::updateMeshes");
+    int rebuilt = 0;
+    for (int x = 0; x < CHUNK_LIST_X; x++) {
+        for (int y = 0; y < CHUNK_LIST_Y; y++) {
+            for (int z = 0; z < CHUNK_LIST_Z; z++) {
+                if (chunks[x][y][z] != NULL && chunks[x][y][z]->needsUpdate()) {
+                    chunks[x][y][z]->updateBlock();
+                    rebuilt++;
+                }
+            }
+        }
+    }
+    return rebuilt;
+}
+
+int ChunkManager::getNumChunks() {
+    int count = 0;
     for (int x = 0; x < CHUNK_LIST_X; x++) {
         for (int y = 0; y < CHUNK_LIST_Y; y++) {
             for (int z = 0; z < CHUNK_LIST_Z; z++) {
                 if (chunks[x][y][z] != NULL) {
-                    chunks[x][y][z]->renderShadow(VP);
+                    count++;
                 }
             }
         }
     }
+    return count;
+}
+
+unsigned long ChunkManager::getNumVertices() {
+    unsigned long count = 0;
+    for (int x = 0; x < CHUNK_LIST_X; x++) {
+        for (int y = 0; y < CHUNK_LIST_Y; y++) {
+            for (int z = 0; z < CHUNK_LIST_Z; z++) {
+                if (chunks[x][y][z] != NULL) {
+                    count += chunks[x][y][z]->getNumVertices();
+                }
+            }
+        }
+    }
+    return count;
 }
 
 inline glm::vec3 toChunkCoord(glm::vec3 v) {
@@ -74,6 +173,7 @@ inline glm::vec3 toNormalCoord(glm::vec3 v) {
 }
 
 void ChunkManager::update(glm::vec3& player_position) {
+    PROFILE_ZONE("ChunkManager::update");
     glm::vec3 chunk_player_position = toChunkCoord(player_position);
 
     if (chunk_player_position != m_player_position) {
@@ -133,6 +233,7 @@ void ChunkManager::updatePlayerPosition() {
 }
 
 void ChunkManager::updateLoadList() {
+    PROFILE_ZONE("ChunkManager::updateLoadList");
     /*
     if (loadList.empty()) {
         return;
@@ -146,11 +247,13 @@ void ChunkManager::updateLoadList() {
         Chunk* chunk = new Chunk(normalCoord);
         chunk->createTerrain(perlin);
         chunks[(int)coord.x][(int)coord.y][(int)coord.z] = chunk;
+        markChanged(normalCoord);
     }
     loadList.clear();
 }
 
 void ChunkManager::updateUnloadList() {
+    PROFILE_ZONE("ChunkManager::updateUnloadList");
     /*
     if (unloadList.empty()) {
         return;
@@ -160,11 +263,37 @@ void ChunkManager::updateUnloadList() {
     unloadList.erase(unloadList.begin());
     */
     for (Chunk* chunk : unloadList) {
+        markChanged(chunk->getPosition());
         delete chunk;
     }
     unloadList.clear();
 }
 
+void ChunkManager::markChanged(const glm::vec3& chunkPosition) {
+    if (changedChunks.size() < MAX_CHANGED_CHUNKS) {
+        changedChunks.push_back(chunkPosition);
+    } else {
+        allChanged = true;
+    }
+}
+
+bool ChunkManager::chunksChanged(const Frustum& frustum) {
+    if (allChanged) {
+        return true;
+    }
+    for (glm::vec3& min : changedChunks) {
+        if (frustum.intersects(min, min + glm::vec3(CHUNK_SIZE))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ChunkManager::clearChangedChunks() {
+    changedChunks.clear();
+    allChanged = false;
+}
+
 bool ChunkManager::solidBlock(glm::vec3& position) {
     // Find which chunk this belongs to
     glm::vec3 playerChunkPos = toChunkCoord(position);
@@ -221,7 +350,187 @@ bool ChunkManager::destroyBlock(glm::vec3& position) {
     }
 
     chunk->setBlock((int)localCoord.x, (int)localCoord.y, (int)localCoord.z, BlockType::EMPTY);
+    markChanged(chunk->getPosition());
     return true;
 }
 
 
+
+inline int floorDiv(int a, int b) {
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+BlockType ChunkManager::getBlock(int x, int y, int z) {
+    int cx = floorDiv(x, CHUNK_SIZE) - (int)origin.x;
+    int cy = floorDiv(y, CHUNK_SIZE) - (int)origin.y;
+    int cz = floorDiv(z, CHUNK_SIZE) - (int)origin.z;
+    if (cx < 0 || cy < 0 || cz < 0 ||
+        cx >= CHUNK_LIST_X || cy >= CHUNK_LIST_Y || cz >= CHUNK_LIST_Z) {
+        return BlockType::EMPTY;
+    }
+
+    Chunk* chunk = chunks[cx][cy][cz];
+    if (chunk == NULL) {
+        return BlockType::EMPTY;
+    }
+
+    return chunk->getBlock(x - floorDiv(x, CHUNK_SIZE) * CHUNK_SIZE,
+                           y - floorDiv(y, CHUNK_SIZE) * CHUNK_SIZE,
+                           z - floorDiv(z, CHUNK_SIZE) * CHUNK_SIZE);
+}
+
+bool ChunkManager::solidBlock(int x, int y, int z) {
+    int cx = floorDiv(x, CHUNK_SIZE) - (int)origin.x;
+    int cy = floorDiv(y, CHUNK_SIZE) - (int)origin.y;
+    int cz = floorDiv(z, CHUNK_SIZE) - (int)origin.z;
+    // Same rules as solidBlock(glm::vec3&): outside the loaded area is a wall,
+    // chunks that are not generated yet are empty
+    if (cx < 0 || cy < 0 || cz < 0 ||
+        cx >= CHUNK_LIST_X || cy >= CHUNK_LIST_Y || cz >= CHUNK_LIST_Z) {
+        return true;
+    }
+
+    Chunk* chunk = chunks[cx][cy][cz];
+    if (chunk == NULL) {
+        return false;
+    }
+
+    BlockType type = chunk->getBlock(x - floorDiv(x, CHUNK_SIZE) * CHUNK_SIZE,
+                                     y - floorDiv(y, CHUNK_SIZE) * CHUNK_SIZE,
+                                     z - floorDiv(z, CHUNK_SIZE) * CHUNK_SIZE);
+    return !passableBlock(type);
+}
+
+// Neighbouring queries usually fall in the same chunk, so the chunk lookup
+// is only redone when the chunk coordinate changes
+void ChunkManager::solidBlocks(const int* x, const int* y, const int* z, int count, unsigned char* out) {
+    int lastX = INT_MIN, lastY = INT_MIN, lastZ = INT_MIN;
+    bool outside = true;
+    Chunk* chunk = NULL;
+
+    for (int i = 0; i < count; i++) {
+        int cx = floorDiv(x[i], CHUNK_SIZE);
+        int cy = floorDiv(y[i], CHUNK_SIZE);
+        int cz = floorDiv(z[i], CHUNK_SIZE);
+        if (cx != lastX || cy != lastY || cz != lastZ) {
+            lastX = cx;
+            lastY = cy;
+            lastZ = cz;
+            int lx = cx - (int)origin.x;
+            int ly = cy - (int)origin.y;
+            int lz = cz - (int)origin.z;
+            outside = lx < 0 || ly < 0 || lz < 0 ||
+                lx >= CHUNK_LIST_X || ly >= CHUNK_LIST_Y || lz >= CHUNK_LIST_Z;
+            chunk = outside ? NULL : chunks[lx][ly][lz];
+        }
+
+        if (outside) {
+            out[i] = 1;
+        } else if (chunk == NULL) {
+            out[i] = 0;
+        } else {
+            BlockType type = chunk->getBlock(x[i] - cx * CHUNK_SIZE, y[i] - cy * CHUNK_SIZE, z[i] - cz * CHUNK_SIZE);
+            out[i] = !passableBlock(type);
+        }
+    }
+}
+
+// Tolerance used so boxes resting flush against a block face do not count as
+// overlapping it
+#define COLLISION_EPSILON 1e-4f
+
+bool ChunkManager::overlapAABB(const glm::vec3& boxMin, const glm::vec3& boxMax) {
+    glm::ivec3 lo = glm::ivec3(glm::floor(boxMin + COLLISION_EPSILON));
+    glm::ivec3 hi = glm::ivec3(glm::floor(boxMax - COLLISION_EPSILON));
+
+    for (int x = lo.x; x <= hi.x; x++) {
+        for (int y = lo.y; y <= hi.y; y++) {
+            for (int z = lo.z; z <= hi.z; z++) {
+                if (solidBlock(x, y, z)) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+/*
+ * Sweeps the box [boxMin, boxMax] along delta and returns the earliest contact
+ * with a solid block. Only the cells covered by the swept volume are visited, so
+ * a fast moving box cannot skip over a block between two ticks.
+ */
+SweepResult ChunkManager::sweepAABB(const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::vec3& delta) {
+    SweepResult result;
+    result.hit = false;
+    result.time = 1.0f;
+    result.normal = glm::vec3(0);
+
+    if (delta == glm::vec3(0)) {
+        return result;
+    }
+
+    glm::ivec3 lo = glm::ivec3(glm::floor(glm::min(boxMin, boxMin + delta)));
+    glm::ivec3 hi = glm::ivec3(glm::floor(glm::max(boxMax, boxMax + delta)));
+
+    for (int x = lo.x; x <= hi.x; x++) {
+        for (int y = lo.y; y <= hi.y; y++) {
+            for (int z = lo.z; z <= hi.z; z++) {
+                if (!solidBlock(x, y, z)) {
+                    continue;
+                }
+
+                // Slab test of the moving box against the unit cell at (x, y, z)
+                glm::vec3 cell = glm::vec3(x, y, z);
+                float entry = -INFINITY;
+                float exit = INFINITY;
+                int axis = -1;
+                bool separated = false;
+
+                for (int a = 0; a < 3; a++) {
+                    float axisEntry, axisExit;
+                    if (delta[a] > 0) {
+                        axisEntry = (cell[a] - boxMax[a]) / delta[a];
+                        axisExit = (cell[a] + 1 - boxMin[a]) / delta[a];
+                    } else if (delta[a] < 0) {
+                        axisEntry = (cell[a] + 1 - boxMin[a]) / delta[a];
+                        axisExit = (cell[a] - boxMax[a]) / delta[a];
+                    } else {
+                        if (boxMax[a] <= cell[a] + COLLISION_EPSILON ||
+                            boxMin[a] >= cell[a] + 1 - COLLISION_EPSILON) {
+                            separated = true;
+                            break;
+                        }
+                        continue;
+                    }
+
+                    if (axisEntry > entry) {
+                        entry = axisEntry;
+                        axis = a;
+                    }
+                    exit = glm::min(exit, axisExit);
+                }
+
+                if (separated || axis < 0 || entry >= exit || entry > result.time) {
+                    continue;
+                }
+
+                // Allow a tiny penetration from float error, but ignore blocks the
+                // box already started inside of so it can move out of them
+                if (entry * glm::abs(delta[axis]) < -COLLISION_EPSILON) {
+                    continue;
+                }
+
+                entry = glm::max(entry, 0.0f);
+                if (!result.hit || entry < result.time) {
+                    result.hit = true;
+                    result.time = entry;
+                    result.normal = glm::vec3(0);
+                    result.normal[axis] = delta[axis] > 0 ? -1.0f : 1.0f;
+                }
+            }
+        }
+    }
+
+    return result;
+}
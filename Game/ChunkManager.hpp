@@ -11,19 +11,57 @@
 #define CHUNK_LIST_Y 3
 #define CHUNK_LIST_Z 17
 
+// Past this many changes since the last clear, every chunk counts as changed
+#define MAX_CHANGED_CHUNKS 256
+
+class Frustum;
+
+// Result of sweeping an axis aligned box through the block grid
+struct SweepResult {
+    bool hit;
+    float time;       // Fraction of the move completed before contact, [0, 1]
+    glm::vec3 normal; // Face normal of the block that was hit
+};
+
 class ChunkManager {
 public:
     ChunkManager();
     ~ChunkManager();
 
     void update(glm::vec3& player_position);
-    void render(glm::mat4& view, glm::mat4& depth);
+    void render(glm::mat4& view);
     void renderShadow(glm::mat4& VP);
+    // Draws only chunks reaching above the water inside the mirrored camera's
+    // frustum, VP is the mirrored camera's
+    void renderReflection(glm::mat4& view, glm::mat4& VP);
+    // Whether any water surface lies inside the camera's frustum
+    bool waterVisible(glm::mat4& VP);
+
+    // Rebuilds the mesh of every changed chunk without touching GL, returns
+    // the number of chunks rebuilt
+    int updateMeshes();
+    int getNumChunks();
+    unsigned long getNumVertices();
 
     bool solidBlock(glm::vec3& position);
+    bool solidBlock(int x, int y, int z);
+    BlockType getBlock(int x, int y, int z);
+    // Batched solidBlock(x, y, z), out[i] is 1 where the cell is solid
+    void solidBlocks(const int* x, const int* y, const int* z, int count, unsigned char* out);
+
+    // Collision queries against the block grid, boxes are in world space
+    bool overlapAABB(const glm::vec3& boxMin, const glm::vec3& boxMax);
+    SweepResult sweepAABB(const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::vec3& delta);
     bool destroyBlock(glm::vec3& position);
 
+    // Whether a chunk inside the frustum was loaded, unloaded or edited since
+    // the last clearChangedChunks(), used to keep cached shadow maps valid
+    bool chunksChanged(const Frustum& frustum);
+    void clearChangedChunks();
+
 private:
+    void markChanged(const glm::vec3& chunkPosition);
+
     void updatePlayerPosition();
     void updateLoadList();
     void updateUnloadList();
@@ -32,6 +70,10 @@ private:
     std::vector<glm::vec3> loadList;
     std::vector<Chunk*> unloadList;
 
+    // Minimum corners of the changed chunks
+    std::vector<glm::vec3> changedChunks;
+    bool allChanged;
+
     glm::vec3 m_player_position;
     glm::vec3 origin;
 
@@ -0,0 +1,114 @@
+/*
+ * Asset cooker.
+ *
+ * Decodes the game's textures, meshes, scenes and animation clips once and
+ * writes them into an asset pack the game memory maps at startup instead of
+ * running lodepng, the .obj parser and Lua. Run from the Game directory:
+ *
+ *     $ ./AssetCooker [pack]
+ *
+ * The pack defaults to Assets/assets.pack. Cooked entries remember their
+ * sources' modification times, the game falls back to a source that was
+ * edited after cooking, so rerun the cooker before shipping a build.
+ *
+ * Shaders stay GLSL text: program binaries are specific to the driver that
+ * produced them.
+ */
+
+#include "Animation.hpp"
+#include "AssetPack.hpp"
+#include "GLUtils.hpp"
+#include "SceneCache.hpp"
+#include "Utils.hpp"
+#include "scene_lua.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static const char* textureFiles[] = {"dudv.png"};
+static const char* sceneFiles[] = {"puppet.lua"};
+static const char* clipFiles[] = {"puppet_anim.lua"};
+
+static bool cookScene(AssetPackWriter& writer, const string& file) {
+    // From the source, a stale pack or snapshot must not be cooked again
+    SceneNode* root = import_lua(file);
+    if (root == NULL) {
+        return false;
+    }
+    SceneTemplate* scene = SceneTemplate::fromTree(root);
+    delete root;
+
+    vector<char> bytes;
+    scene->toBytes(bytes);
+    delete scene;
+    writer.add(file, AssetType::Scene, NULL, getFileModifiedTime(file), bytes.data(), bytes.size());
+    return true;
+}
+
+static bool cookClips(AssetPackWriter& writer, const string& file) {
+    vector<AnimationClip*> clips = import_lua_clips(file);
+    if (clips.empty()) {
+        return false;
+    }
+    vector<char> bytes;
+    for (AnimationClip* clip : clips) {
+        clip->toBytes(bytes);
+        delete clip;
+    }
+    uint32_t info[4] = {(uint32_t)clips.size(), 0, 0, 0};
+    writer.add(file, AssetType::Clips, info, getFileModifiedTime(file), bytes.data(), bytes.size());
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [pack]\n", argv[0]);
+        return 1;
+    }
+    string packPath = argc > 1 ? argv[1] : getAssetFilePath(GAME_ASSET_PACK);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    AssetPackWriter writer;
+    int failed = 0;
+
+    for (const char* file : textureFiles) {
+        failed += !Texture::cook(writer, getAssetFilePath(file));
+    }
+    failed += !Texture::cookTiles(writer, getAssetFilePath("tileSet.png"), TILESET_COLUMNS);
+    failed += !Mesh::cook(writer);
+    for (const char* file : sceneFiles) {
+        failed += !cookScene(writer, getAssetFilePath(file));
+    }
+    for (const char* file : clipFiles) {
+        failed += !cookClips(writer, getAssetFilePath(file));
+    }
+
+    if (failed > 0) {
+        fprintf(stderr, "%d assets failed to cook, %s not written\n", failed, packPath.c_str());
+        return 1;
+    }
+    if (!writer.save(packPath)) {
+        fprintf(stderr, "Cannot write %s\n", packPath.c_str());
+        return 1;
+    }
+
+    AssetPack* pack = AssetPack::open(packPath);
+    if (pack == NULL) {
+        return 1;
+    }
+    const char* typeNames[] = {"texture", "meshes", "scene", "clips"};
+    for (int i = 0; i < pack->getNumEntries(); i++) {
+        const AssetPack::Entry* entry = pack->getEntry(i);
+        printf("%-24s %-8s %10llu bytes\n", entry->name, typeNames[entry->type],
+            (unsigned long long)entry->size);
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    printf("Wrote %s: %d entries, %zu payload bytes in %.1f ms\n", packPath.c_str(),
+        writer.getNumEntries(), writer.getPayloadBytes(), ms);
+    delete pack;
+    return 0;
+}
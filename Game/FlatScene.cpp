@@ -0,0 +1,84 @@
+#include "FlatScene.hpp"
+#include "GeometryNode.hpp"
+#include "JointNode.hpp"
+
+FlatScene::FlatScene() {
+}
+
+void FlatScene::build(SceneNode* root) {
+    nodes.clear();
+    parents.clear();
+    geometry.clear();
+    meshIds.clear();
+    if (root == NULL) {
+        return;
+    }
+
+    // Depth first with an explicit stack, children keep their list order
+    std::vector<std::pair<SceneNode*, int>> stack;
+    stack.push_back(std::make_pair(root, -1));
+    while (!stack.empty()) {
+        SceneNode* node = stack.back().first;
+        int parent = stack.back().second;
+        stack.pop_back();
+
+        int index = nodes.size();
+        nodes.push_back(node);
+        parents.push_back(parent);
+        node->dirty = true;
+
+        if (node->m_nodeType == NodeType::GeometryNode) {
+            geometry.push_back(index);
+            meshIds.push_back(static_cast<GeometryNode*>(node)->meshId);
+        } else {
+            meshIds.push_back(std::string());
+        }
+
+        for (auto it = node->children.rbegin(); it != node->children.rend(); ++it) {
+            stack.push_back(std::make_pair(*it, index));
+        }
+    }
+
+    locals.resize(nodes.size());
+    transforms.resize(nodes.size());
+    changed.resize(nodes.size());
+    update();
+}
+
+void FlatScene::update() {
+    for (size_t i = 0; i < nodes.size(); i++) {
+        SceneNode* node = nodes[i];
+        int parent = parents[i];
+
+        if (node->dirty) {
+            locals[i] = node->trans;
+            if (node->m_nodeType == NodeType::JointNode) {
+                const JointNode* joint = static_cast<const JointNode*>(node);
+                locals[i] = locals[i] * joint->get_x_rotate() * joint->get_y_rotate();
+            }
+        }
+
+        // Parents come first, so their flag is already final
+        changed[i] = node->dirty || (parent >= 0 && changed[parent]);
+        node->dirty = false;
+        if (changed[i]) {
+            transforms[i] = parent >= 0 ? transforms[parent] * locals[i] : locals[i];
+        }
+    }
+}
+
+int FlatScene::getNumNodes() const {
+    return nodes.size();
+}
+
+const std::vector<int>& FlatScene::getGeometry() const {
+    return geometry;
+}
+
+const std::string& FlatScene::getMeshId(int node) const {
+    return meshIds[node];
+}
+
+const glm::mat4& FlatScene::getTransform(int node) const {
+    return transforms[node];
+}
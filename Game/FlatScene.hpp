@@ -0,0 +1,41 @@
+#pragma once
+
+#include "SceneNode.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+/*
+ * A scene graph compiled into arrays in parent before child order, so world
+ * transforms come from one linear sweep instead of a recursive walk per
+ * pass. Only nodes whose local transform changed since the last update (see
+ * SceneNode::dirty) and their descendants are recomputed.
+ *
+ * Transforms are relative to the root, the caller applies the model view.
+ * The graph's shape is fixed once compiled, only transforms may change.
+ */
+class FlatScene {
+public:
+    FlatScene();
+
+    void build(SceneNode* root);
+    // Picks up changed transforms, call once per frame before drawing
+    void update();
+
+    int getNumNodes() const;
+    // Node indices of the geometry nodes, in draw order
+    const std::vector<int>& getGeometry() const;
+    const std::string& getMeshId(int node) const;
+    const glm::mat4& getTransform(int node) const;
+
+private:
+    std::vector<SceneNode*> nodes;
+    std::vector<int> parents;          // -1 for the root
+    std::vector<glm::mat4> locals;     // Joint rotations included
+    std::vector<glm::mat4> transforms; // Relative to the root
+    std::vector<unsigned char> changed;
+    std::vector<int> geometry;
+    std::vector<std::string> meshIds;
+};
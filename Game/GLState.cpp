@@ -0,0 +1,238 @@
+#include "GLState.hpp"
+
+#include <imgui/imgui.h>
+
+#include <iostream>
+
+// Zero is a valid binding, so unknown state needs its own value
+#define UNKNOWN ((GLuint)-1)
+
+static const GLenum trackedCapabilities[] = {
+    GL_BLEND,
+    GL_CLIP_DISTANCE0,
+    GL_CULL_FACE,
+    GL_DEPTH_TEST,
+    GL_MULTISAMPLE,
+    GL_RASTERIZER_DISCARD,
+    GL_SCISSOR_TEST
+};
+static const int NUM_CAPABILITIES = sizeof(trackedCapabilities) / sizeof(trackedCapabilities[0]);
+
+static GLuint program = UNKNOWN;
+static GLuint vertexArray = UNKNOWN;
+static GLuint activeUnit = UNKNOWN;
+static GLuint textures[GL_STATE_TEXTURE_UNITS];
+static GLuint readFramebuffer = UNKNOWN;
+static GLuint drawFramebuffer = UNKNOWN;
+// 0 disabled, 1 enabled, -1 unknown
+static int capabilities[NUM_CAPABILITIES];
+static bool initialized = false;
+
+static bool unitsUsed[GL_STATE_TEXTURE_UNITS];
+
+static unsigned issued[GLState::NUM_CALL_TYPES];
+static unsigned skipped[GLState::NUM_CALL_TYPES];
+static unsigned lastIssued[GLState::NUM_CALL_TYPES];
+static unsigned lastSkipped[GLState::NUM_CALL_TYPES];
+
+static void ensureInitialized() {
+    if (!initialized) {
+        GLState::invalidate();
+    }
+}
+
+// Returns true if the call has to be issued
+static bool change(GLuint& cached, GLuint value, GLState::CallType type) {
+    if (cached == value) {
+        skipped[type]++;
+        return false;
+    }
+    cached = value;
+    issued[type]++;
+    return true;
+}
+
+void GLState::invalidate() {
+    program = UNKNOWN;
+    vertexArray = UNKNOWN;
+    activeUnit = UNKNOWN;
+    for (int i = 0; i < GL_STATE_TEXTURE_UNITS; i++) {
+        textures[i] = UNKNOWN;
+    }
+    readFramebuffer = UNKNOWN;
+    drawFramebuffer = UNKNOWN;
+    for (int i = 0; i < NUM_CAPABILITIES; i++) {
+        capabilities[i] = -1;
+    }
+    initialized = true;
+}
+
+void GLState::beginFrame() {
+    for (int i = 0; i < NUM_CALL_TYPES; i++) {
+        lastIssued[i] = issued[i];
+        lastSkipped[i] = skipped[i];
+        issued[i] = 0;
+        skipped[i] = 0;
+    }
+}
+
+void GLState::useProgram(GLuint value) {
+    ensureInitialized();
+    if (change(program, value, PROGRAM)) {
+        glUseProgram(value);
+    }
+}
+
+void GLState::bindVertexArray(GLuint value) {
+    ensureInitialized();
+    if (change(vertexArray, value, VERTEX_ARRAY)) {
+        glBindVertexArray(value);
+    }
+}
+
+// Every texture has a unit of its own, so one texture per unit is enough
+// whatever its target
+void GLState::bindTexture(int unit, GLuint texture, GLenum target) {
+    ensureInitialized();
+    if (textures[unit] == texture) {
+        skipped[TEXTURE]++;
+        return;
+    }
+    if (activeUnit != (GLuint)unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+    }
+    glBindTexture(target, texture);
+    textures[unit] = texture;
+    issued[TEXTURE]++;
+}
+
+void GLState::editTexture(int unit, GLuint texture, GLenum target) {
+    bindTexture(unit, texture, target);
+    if (activeUnit != (GLuint)unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+    }
+}
+
+void GLState::bindFramebuffer(GLenum target, GLuint framebuffer) {
+    ensureInitialized();
+    if (target == GL_FRAMEBUFFER) {
+        if (readFramebuffer == framebuffer && drawFramebuffer == framebuffer) {
+            skipped[FRAMEBUFFER]++;
+            return;
+        }
+        readFramebuffer = framebuffer;
+        drawFramebuffer = framebuffer;
+        issued[FRAMEBUFFER]++;
+        glBindFramebuffer(target, framebuffer);
+    } else if (change(target == GL_READ_FRAMEBUFFER ? readFramebuffer : drawFramebuffer, framebuffer, FRAMEBUFFER)) {
+        glBindFramebuffer(target, framebuffer);
+    }
+}
+
+static void setCapability(GLenum capability, bool on) {
+    ensureInitialized();
+    for (int i = 0; i < NUM_CAPABILITIES; i++) {
+        if (trackedCapabilities[i] != capability) {
+            continue;
+        }
+        if (capabilities[i] == (on ? 1 : 0)) {
+            skipped[GLState::CAPABILITY]++;
+            return;
+        }
+        capabilities[i] = on ? 1 : 0;
+        break;
+    }
+    issued[GLState::CAPABILITY]++;
+    if (on) {
+        glEnable(capability);
+    } else {
+        glDisable(capability);
+    }
+}
+
+void GLState::enable(GLenum capability) {
+    setCapability(capability, true);
+}
+
+void GLState::disable(GLenum capability) {
+    setCapability(capability, false);
+}
+
+void GLState::deleteVertexArrays(GLsizei count, const GLuint* vertexArrays) {
+    for (GLsizei i = 0; i < count; i++) {
+        if (vertexArray == vertexArrays[i]) {
+            vertexArray = UNKNOWN;
+        }
+    }
+    glDeleteVertexArrays(count, vertexArrays);
+}
+
+void GLState::deleteTextures(GLsizei count, const GLuint* names) {
+    for (GLsizei i = 0; i < count; i++) {
+        for (int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++) {
+            if (textures[unit] == names[i]) {
+                textures[unit] = UNKNOWN;
+            }
+        }
+    }
+    glDeleteTextures(count, names);
+}
+
+void GLState::deleteFramebuffers(GLsizei count, const GLuint* framebuffers) {
+    for (GLsizei i = 0; i < count; i++) {
+        if (readFramebuffer == framebuffers[i]) {
+            readFramebuffer = UNKNOWN;
+        }
+        if (drawFramebuffer == framebuffers[i]) {
+            drawFramebuffer = UNKNOWN;
+        }
+    }
+    glDeleteFramebuffers(count, framebuffers);
+}
+
+int GLState::allocateTextureUnit() {
+    for (int i = 0; i < GL_STATE_TEXTURE_UNITS; i++) {
+        if (!unitsUsed[i]) {
+            unitsUsed[i] = true;
+            return i;
+        }
+    }
+    std::cout << "Out of texture units" << std::endl;
+    return GL_STATE_TEXTURE_UNITS - 1;
+}
+
+void GLState::freeTextureUnit(int unit) {
+    unitsUsed[unit] = false;
+}
+
+unsigned GLState::getIssued(CallType type) {
+    return lastIssued[type];
+}
+
+unsigned GLState::getSkipped(CallType type) {
+    return lastSkipped[type];
+}
+
+void GLState::drawWindow(bool* open) {
+    static const char* names[NUM_CALL_TYPES] = {
+        "program", "vertex array", "texture", "framebuffer", "capability"
+    };
+
+    // Same title as the CPU profiler so both end up in one window
+    ImGui::Begin("Profiler", open, ImVec2(600, 400));
+
+    if (ImGui::CollapsingHeader("GL state", NULL, true, true)) {
+        unsigned totalIssued = 0;
+        unsigned totalSkipped = 0;
+        for (int i = 0; i < NUM_CALL_TYPES; i++) {
+            ImGui::Text("%6u issued  %6u skipped  %s", lastIssued[i], lastSkipped[i], names[i]);
+            totalIssued += lastIssued[i];
+            totalSkipped += lastSkipped[i];
+        }
+        ImGui::Text("%6u issued  %6u skipped  total per frame", totalIssued, totalSkipped);
+    }
+
+    ImGui::End();
+}
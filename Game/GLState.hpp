@@ -0,0 +1,57 @@
+#pragma once
+
+#include "cs488-framework/OpenGLImport.hpp"
+
+#define GL_STATE_TEXTURE_UNITS 32
+
+/*
+ * Shadow copy of the GL bindings the renderer changes most, so binding what
+ * is already bound costs no driver call. Every bind of a program, vertex
+ * array, texture, frame buffer or one of the tracked caps has to go through
+ * here, a raw GL call would leave the copy stale. Code that changes them
+ * behind our back (ImGui) is followed by invalidate().
+ *
+ * Texture units are handed out per texture, lowest free first, and returned
+ * when the texture is deleted.
+ */
+class GLState {
+public:
+    enum CallType {
+        PROGRAM,
+        VERTEX_ARRAY,
+        TEXTURE,
+        FRAMEBUFFER,
+        CAPABILITY,
+        NUM_CALL_TYPES
+    };
+
+    // Forgets every cached binding, the next bind of each is always issued
+    static void invalidate();
+    // Keeps the counters of the frame that ended and starts new ones
+    static void beginFrame();
+
+    static void useProgram(GLuint program);
+    static void bindVertexArray(GLuint vertexArray);
+    static void bindTexture(int unit, GLuint texture, GLenum target = GL_TEXTURE_2D);
+    // Also makes the unit active, for glTexImage2D and friends
+    static void editTexture(int unit, GLuint texture, GLenum target = GL_TEXTURE_2D);
+    // GL_FRAMEBUFFER binds both the read and the draw target
+    static void bindFramebuffer(GLenum target, GLuint framebuffer);
+    static void enable(GLenum capability);
+    static void disable(GLenum capability);
+
+    // Deleted names may be handed out again, so they must leave the cache
+    static void deleteVertexArrays(GLsizei count, const GLuint* vertexArrays);
+    static void deleteTextures(GLsizei count, const GLuint* textures);
+    static void deleteFramebuffers(GLsizei count, const GLuint* framebuffers);
+
+    static int allocateTextureUnit();
+    static void freeTextureUnit(int unit);
+
+    // Calls of the last finished frame
+    static unsigned getIssued(CallType type);
+    static unsigned getSkipped(CallType type);
+
+    // Adds a GL state section to the profiler window
+    static void drawWindow(bool* open);
+};
@@ -1,16 +1,19 @@
 #include "GLUtils.hpp"
+#include "AssetPack.hpp"
+#include "GLState.hpp"
 
 #include <lodepng/lodepng.h>
 #include "cs488-framework/GlErrorCheck.hpp"
 #include "cs488-framework/OpenGLImport.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "Utils.hpp"
 
-#include "scene_lua.hpp"
-#include "GeometryNode.hpp"
-#include "JointNode.hpp"
+#include "SceneCache.hpp"
 
 CubeShader* CubeShader::getShader() {
     static CubeShader cube_shader;
@@ -27,6 +30,11 @@ ParticleShader* ParticleShader::getShader() {
     return &particle_shader;
 }
 
+ParticleUpdateShader* ParticleUpdateShader::getShader() {
+    static ParticleUpdateShader particle_update_shader;
+    return &particle_update_shader;
+}
+
 Shader::Shader(std::string vertex_shader, std::string frag_shader) {
 	// Build the shader
 	m_shader.generateProgramObject();
@@ -38,35 +46,40 @@ Shader::Shader(std::string vertex_shader, std::string frag_shader) {
 }
 
 void Shader::enable() const {
-    m_shader.enable();
+    GLState::useProgram(m_shader.getProgramObject());
 }
 
+// The next enable() switches programs, unbinding in between only adds a call
 void Shader::disable() const {
-    m_shader.disable();
 }
 
 CubeShader::CubeShader() : Shader("VertexShader.vs", "FragmentShader.fs") {
     P_uni = m_shader.getUniformLocation("P");
     VM_uni = m_shader.getUniformLocation("VM");
     Normal_Matrix_uni = m_shader.getUniformLocation("NormalMatrix");
-    depthBiasMVP_uni = m_shader.getUniformLocation("depthBiasMVP");
+    cascadeFromView_uni = m_shader.getUniformLocation("cascadeFromView");
+    cascadeEnds_uni = m_shader.getUniformLocation("cascadeEnds");
     tex_uni = m_shader.getUniformLocation("tex");
     texShadow_uni = m_shader.getUniformLocation("texShadow");
     texWater_uni = m_shader.getUniformLocation("texWater");
     texDUDV_uni = m_shader.getUniformLocation("texDUDV");
     ambientIntensity_uni = m_shader.getUniformLocation("ambientIntensity");
     moveFactor_uni = m_shader.getUniformLocation("moveFactor");
+    meshTile_uni = m_shader.getUniformLocation("meshTile");
     light_position_uni = m_shader.getUniformLocation("light.position");
     light_rgbIntensity_uni = m_shader.getUniformLocation("light.rgbIntensity");
 
     positionAttrib = m_shader.getAttribLocation("position");
     normalAttrib = m_shader.getAttribLocation("normal");
+    modelAttrib = m_shader.getAttribLocation("model");
+    modelNormalAttrib = m_shader.getAttribLocation("modelNormal");
 }
 
 ShadowShader::ShadowShader() : Shader("shadow_VertexShader.vs", "shadow_FragmentShader.fs") {
     MVP_uni = m_shader.getUniformLocation("MVP");
 
     positionAttrib = m_shader.getAttribLocation("position");
+    modelAttrib = m_shader.getAttribLocation("model");
 }
 
 ParticleShader::ParticleShader() : Shader("particle_VertexShader.vs", "particle_FragmentShader.fs") {
@@ -77,36 +90,97 @@ ParticleShader::ParticleShader() : Shader("particle_VertexShader.vs", "particle_
     colorAttrib = m_shader.getAttribLocation("color");
 }
 
-int Texture::textureCounter = 0;
+ParticleUpdateShader::ParticleUpdateShader() {
+    static const char* varyings[] = { "outPosition", "outVelocity", "outColor" };
+
+    m_shader.generateProgramObject();
+    m_shader.attachVertexShader(
+        getAssetFilePath( "particle_update_VertexShader.vs" ).c_str() );
+    // Has to be set before linking
+    glTransformFeedbackVaryings(m_shader.getProgramObject(), 3, varyings, GL_INTERLEAVED_ATTRIBS);
+    m_shader.link();
+
+    delta_uni = m_shader.getUniformLocation("delta");
+    gravity_uni = m_shader.getUniformLocation("gravity");
+}
 
 Texture::Texture(std::string imageUrl) {
-    loaded = false;
+    TextureImage image;
+    decode(imageUrl, image);
+    upload(image);
+}
+
+Texture::Texture(const TextureImage& image) {
+    upload(image);
+}
+
+bool Texture::decode(const std::string& imageUrl, TextureImage& image) {
+    image.pixels = NULL;
+    image.layers = 1;
+    image.levels = 1;
+    const AssetPack* pack = AssetPack::getGamePack();
+    const AssetPack::Entry* cooked = pack != NULL
+        ? pack->find(imageUrl, AssetType::Texture, getFileModifiedTime(imageUrl)) : NULL;
+    if (cooked != NULL) {
+        image.width = cooked->info[0];
+        image.height = cooked->info[1];
+        image.layers = cooked->info[2];
+        image.levels = cooked->info[3];
+        image.pixels = (const unsigned char*)pack->getData(cooked);
+        return true;
+    }
 
-    std::vector<unsigned char> image;
-    unsigned error = lodepng::decode(image, width, height, imageUrl);
+    unsigned error = lodepng::decode(image.decoded, image.width, image.height, imageUrl);
 
     if(error != 0) {
         std::cout << "error " << error << ": " << lodepng_error_text(error) << std::endl;
+        return false;
+    }
+    image.pixels = &image.decoded[0];
+    return true;
+}
+
+void Texture::upload(const TextureImage& image) {
+    loaded = false;
+    if (image.pixels == NULL) {
         return;
     }
+    width = image.width;
+    height = image.height;
+    target = image.layers > 1 || image.levels > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
 
     glGenTextures(1, &tex);
-    textureId = Texture::textureCounter;
-
-    glActiveTexture(GL_TEXTURE0 + textureId);
-    glBindTexture(GL_TEXTURE_2D, tex);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    textureId = GLState::allocateTextureUnit();
+    GLState::editTexture(textureId, tex, target);
+
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    if (target == GL_TEXTURE_2D_ARRAY) {
+        // Texels stay sharp up close, the mips take over in the distance
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, image.levels - 1);
+
+        const unsigned char* level = image.pixels;
+        unsigned levelWidth = width;
+        unsigned levelHeight = height;
+        for (unsigned i = 0; i < image.levels; i++) {
+            glTexImage3D(target, i, GL_RGBA, levelWidth, levelHeight, image.layers, 0, GL_RGBA,
+                GL_UNSIGNED_BYTE, level);
+            level += levelWidth * levelHeight * image.layers * 4;
+            levelWidth = std::max(levelWidth / 2, 1u);
+            levelHeight = std::max(levelHeight / 2, 1u);
+        }
+    } else {
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-    size_t u = 1; while(u < width) u *= 2;
-    size_t v = 1; while(v < height) v *= 2;
+        size_t u = 1; while(u < width) u *= 2;
+        size_t v = 1; while(v < height) v *= 2;
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, u, v, 0, GL_RGBA, GL_UNSIGNED_BYTE, &image[0]);
-    Texture::textureCounter += 1;
+        glTexImage2D(target, 0, GL_RGBA, u, v, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels);
+    }
     loaded = true;
 
     this->type = "color";
@@ -114,21 +188,183 @@ Texture::Texture(std::string imageUrl) {
 	CHECK_GL_ERRORS;
 }
 
+// Halves an RGBA8 image with a box filter, an odd last row or column is
+// averaged with itself. Colours are weighted by alpha so the invisible texels
+// of leaves and grass blades do not darken their edges.
+static void downsample(const unsigned char* src, unsigned width, unsigned height,
+        std::vector<unsigned char>& dst, unsigned& dstWidth, unsigned& dstHeight) {
+    dstWidth = std::max(width / 2, 1u);
+    dstHeight = std::max(height / 2, 1u);
+    dst.resize(dstWidth * dstHeight * 4);
+    for (unsigned y = 0; y < dstHeight; y++) {
+        unsigned y0 = std::min(2 * y, height - 1);
+        unsigned y1 = std::min(2 * y + 1, height - 1);
+        for (unsigned x = 0; x < dstWidth; x++) {
+            unsigned x0 = std::min(2 * x, width - 1);
+            unsigned x1 = std::min(2 * x + 1, width - 1);
+            const unsigned char* texels[4] = {
+                &src[(y0 * width + x0) * 4], &src[(y0 * width + x1) * 4],
+                &src[(y1 * width + x0) * 4], &src[(y1 * width + x1) * 4]
+            };
+            unsigned alpha = texels[0][3] + texels[1][3] + texels[2][3] + texels[3][3];
+            unsigned char* out = &dst[(y * dstWidth + x) * 4];
+            for (int c = 0; c < 3; c++) {
+                unsigned sum = 0;
+                for (int i = 0; i < 4; i++) {
+                    sum += alpha > 0 ? texels[i][c] * texels[i][3] : texels[i][c];
+                }
+                unsigned weight = alpha > 0 ? alpha : 4;
+                out[c] = (sum + weight / 2) / weight;
+            }
+            out[3] = (alpha + 2) / 4;
+        }
+    }
+}
+
+// Share of the texels that pass the fragment shader's alpha test once their
+// alpha is scaled
+static float alphaCoverage(const unsigned char* pixels, size_t count, float scale) {
+    size_t covered = 0;
+    for (size_t i = 0; i < count; i++) {
+        covered += pixels[i * 4 + 3] * scale >= 127.5f;
+    }
+    return covered / (float)count;
+}
+
+// Averaged alpha drops below the test threshold, so minified leaves would
+// thin out and vanish. Scales a level's alpha until it covers as much as
+// the full size tile did.
+static void keepAlphaCoverage(unsigned char* pixels, size_t count, float coverage) {
+    float low = 0.0f;
+    float high = 4.0f;
+    for (int i = 0; i < 10; i++) {
+        float scale = (low + high) / 2;
+        if (alphaCoverage(pixels, count, scale) < coverage) {
+            low = scale;
+        } else {
+            high = scale;
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        pixels[i * 4 + 3] = std::min(pixels[i * 4 + 3] * high, 255.0f);
+    }
+}
+
+bool Texture::splitTiles(const TextureImage& atlas, unsigned columns, TextureImage& tiles) {
+    tiles.pixels = NULL;
+    unsigned tileSize = atlas.width / columns;
+    if (atlas.pixels == NULL || tileSize == 0 || atlas.width % columns != 0 || atlas.height % tileSize != 0) {
+        std::cout << "error: cannot cut a " << atlas.width << "x" << atlas.height << " image into "
+            << columns << " columns of square tiles" << std::endl;
+        return false;
+    }
+    unsigned rows = atlas.height / tileSize;
+    tiles.width = tiles.height = tileSize;
+    tiles.layers = columns * rows;
+    tiles.levels = 1;
+    while ((tileSize >> tiles.levels) > 0) {
+        tiles.levels++;
+    }
+
+    size_t tileBytes = tileSize * tileSize * 4;
+    tiles.decoded.resize(tileBytes * tiles.layers);
+    for (unsigned layer = 0; layer < tiles.layers; layer++) {
+        unsigned x = layer % columns * tileSize;
+        unsigned y = layer / columns * tileSize;
+        for (unsigned row = 0; row < tileSize; row++) {
+            memcpy(&tiles.decoded[layer * tileBytes + row * tileSize * 4],
+                atlas.pixels + ((y + row) * atlas.width + x) * 4, tileSize * 4);
+        }
+    }
+
+    std::vector<float> coverage(tiles.layers);
+    for (unsigned layer = 0; layer < tiles.layers; layer++) {
+        coverage[layer] = alphaCoverage(&tiles.decoded[layer * tileBytes], tileSize * tileSize, 1.0f);
+    }
+
+    // Each level is appended behind the one it is filtered from
+    std::vector<unsigned char> level;
+    size_t source = 0;
+    unsigned levelSize = tileSize;
+    for (unsigned i = 1; i < tiles.levels; i++) {
+        size_t sourceBytes = levelSize * levelSize * 4;
+        unsigned nextSize = 0;
+        for (unsigned layer = 0; layer < tiles.layers; layer++) {
+            downsample(&tiles.decoded[source + layer * sourceBytes], levelSize, levelSize, level, nextSize, nextSize);
+            if (coverage[layer] < 1.0f) {
+                keepAlphaCoverage(&level[0], nextSize * nextSize, coverage[layer]);
+            }
+            tiles.decoded.insert(tiles.decoded.end(), level.begin(), level.end());
+        }
+        source += sourceBytes * tiles.layers;
+        levelSize = nextSize;
+    }
+    tiles.pixels = &tiles.decoded[0];
+    return true;
+}
+
+bool Texture::decodeTiles(const std::string& imageUrl, unsigned columns, TextureImage& tiles) {
+    TextureImage atlas;
+    if (!decode(imageUrl, atlas)) {
+        return false;
+    }
+    if (atlas.layers > 1) {
+        // Cooked by cookTiles, pixels point into the pack
+        tiles = atlas;
+        return true;
+    }
+    return splitTiles(atlas, columns, tiles);
+}
+
+// The pack's sources are the PNG files, never an older pack
+static bool decodeSource(const std::string& imageUrl, TextureImage& image) {
+    image.layers = 1;
+    image.levels = 1;
+    image.pixels = NULL;
+    unsigned error = lodepng::decode(image.decoded, image.width, image.height, imageUrl);
+    if (error != 0) {
+        std::cout << "error " << error << ": " << lodepng_error_text(error) << std::endl;
+        return false;
+    }
+    image.pixels = &image.decoded[0];
+    return true;
+}
+
+static void addToPack(AssetPackWriter& writer, const std::string& imageUrl, const TextureImage& image) {
+    uint32_t info[4] = {image.width, image.height, image.layers, image.levels};
+    writer.add(imageUrl, AssetType::Texture, info, getFileModifiedTime(imageUrl),
+        image.decoded.data(), image.decoded.size());
+}
+
+bool Texture::cook(AssetPackWriter& writer, const std::string& imageUrl) {
+    // Sampled GL_NEAREST without mips, only the image itself is needed
+    TextureImage image;
+    if (!decodeSource(imageUrl, image)) {
+        return false;
+    }
+    addToPack(writer, imageUrl, image);
+    return true;
+}
+
+bool Texture::cookTiles(AssetPackWriter& writer, const std::string& imageUrl, unsigned columns) {
+    TextureImage atlas;
+    TextureImage tiles;
+    if (!decodeSource(imageUrl, atlas) || !splitTiles(atlas, columns, tiles)) {
+        return false;
+    }
+    addToPack(writer, imageUrl, tiles);
+    return true;
+}
+
 Texture::Texture(int width, int height, std::string type) {
     loaded = false;
+    target = GL_TEXTURE_2D;
 
     glGenTextures(1, &tex);
-    textureId = Texture::textureCounter;
-
-    glActiveTexture(GL_TEXTURE0 + textureId);
-    glBindTexture(GL_TEXTURE_2D, tex);
+    textureId = GLState::allocateTextureUnit();
 
     this->type = type;
-    if (type == "depth") {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
-    } else { // color
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_FLOAT, 0);
-    }
+    resize(width, height);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -136,14 +372,24 @@ Texture::Texture(int width, int height, std::string type) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
-    Texture::textureCounter += 1;
     loaded = true;
 }
 
+void Texture::resize(int width, int height) {
+    this->width = width;
+    this->height = height;
+
+    GLState::editTexture(textureId, tex);
+    if (type == "depth") {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+    } else { // color
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_FLOAT, 0);
+    }
+}
+
 bool Texture::bind(GLint uniform) {
     if (loaded) {
-        glActiveTexture(GL_TEXTURE0 + textureId);
-        glBindTexture(GL_TEXTURE_2D, tex);
+        GLState::bindTexture(textureId, tex, target);
         glUniform1i(uniform, textureId);
 	    CHECK_GL_ERRORS;
     }
@@ -152,7 +398,8 @@ bool Texture::bind(GLint uniform) {
 
 Texture::~Texture() {
     if (loaded) {
-        glDeleteTextures(1, &tex);
+        GLState::deleteTextures(1, &tex);
+        GLState::freeTextureUnit(textureId);
     }
 }
 
@@ -170,7 +417,7 @@ GLuint Texture::getTex() {
 
 FrameBuffer::FrameBuffer(Texture* texture): texture(texture) {
     glGenFramebuffers(1, &frameBufferName);
-    glBindFramebuffer(GL_FRAMEBUFFER, frameBufferName);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, frameBufferName);
     if (texture->type == "depth") {
         glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture->getTex(), 0);
         glDrawBuffer(GL_NONE);
@@ -185,284 +432,564 @@ FrameBuffer::FrameBuffer(Texture* texture): texture(texture) {
     } else {
         loaded = true;
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 FrameBuffer::~FrameBuffer() {
     if (loaded) {
-        glDeleteFramebuffers(1, &frameBufferName);
+        GLState::deleteFramebuffers(1, &frameBufferName);
         delete texture;
     }
 }
 
 void FrameBuffer::bind() {
-    glBindFramebuffer(GL_FRAMEBUFFER, frameBufferName);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, frameBufferName);
 }
 
 void FrameBuffer::unbind() {
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-Mesh* Mesh::getMeshRender() {
-    static Mesh mesh;
-    return &mesh;
+void FrameBuffer::copyDepthTo(FrameBuffer* target) {
+    int width = texture->getWidth();
+    int height = texture->getHeight();
+    GLState::bindFramebuffer(GL_READ_FRAMEBUFFER, frameBufferName);
+    GLState::bindFramebuffer(GL_DRAW_FRAMEBUFFER, target->frameBufferName);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-Mesh::Mesh() {
-    CubeShader* cube_shader = CubeShader::getShader();
-    ShadowShader* shadow_shader = ShadowShader::getShader();
+Mesh* Mesh::instance = NULL;
+
+Mesh* Mesh::getMeshRender() {
+    if (instance == NULL) {
+        MeshData meshData;
+        load(meshData);
+        create(meshData);
+    }
+    return instance;
+}
 
-    std::unique_ptr<MeshConsolidator> meshConsolidator (new MeshConsolidator{
+// Small enough for 16 bit indices, which MeshConsolidator checks
+std::vector<std::string> Mesh::getObjFiles() {
+    return {
         getAssetFilePath("cube.obj"),
         getAssetFilePath("sphere.obj"),
         getAssetFilePath("suzanne.obj")
-    });
+    };
+}
 
-    // Acquire the BatchInfoMap from the MeshConsolidator.
-    meshConsolidator->getBatchInfoMap(m_batchInfoMap);
-
-    const int numVertex = meshConsolidator->getNumVertexPositionBytes() / sizeof(float);
-    const float* vertexPositions = meshConsolidator->getVertexPositionDataPtr();
-    float* vertexPositionsVec4 = new float[(numVertex/3) * 4];
-    int x = 0;
-    for (int i = 0; i < numVertex/3; i++) {
-        for (int j = 0; j < 3; j++) {
-            vertexPositionsVec4[x++] = vertexPositions[i * 3 + j];
+MeshConsolidator* Mesh::consolidate() {
+    return new MeshConsolidator(getObjFiles(), MESH_SHORT_INDICES | MESH_QUANTIZED_NORMALS);
+}
+
+time_t Mesh::getSourceTime() {
+    time_t newest = 0;
+    for (const std::string& file : getObjFiles()) {
+        newest = std::max(newest, getFileModifiedTime(file));
+    }
+    return newest;
+}
+
+// The batch table followed by the consolidator's block
+bool Mesh::cook(AssetPackWriter& writer) {
+    std::unique_ptr<MeshConsolidator> meshConsolidator;
+    try {
+        meshConsolidator.reset(consolidate());
+    } catch (const std::exception& e) {
+        std::cout << e.what() << std::endl;
+        return false;
+    }
+    BatchInfoMap batchInfoMap;
+    meshConsolidator->getBatchInfoMap(batchInfoMap);
+
+    std::vector<char> payload(batchInfoMap.size() * sizeof(CookedBatch), 0);
+    CookedBatch* table = (CookedBatch*)payload.data();
+    for (auto& batch : batchInfoMap) {
+        strncpy(table->meshId, batch.first.c_str(), sizeof(table->meshId) - 1);
+        table->startIndex = batch.second.startIndex;
+        table->numIndices = batch.second.numIndices;
+        table->baseVertex = batch.second.baseVertex;
+        table++;
+    }
+    const char* data = (const char*)meshConsolidator->getDataPtr();
+    payload.insert(payload.end(), data, data + meshConsolidator->getNumDataBytes());
+
+    uint32_t flags = (meshConsolidator->hasShortIndices() ? MESH_SHORT_INDICES : 0)
+        | (meshConsolidator->hasQuantizedNormals() ? MESH_QUANTIZED_NORMALS : 0);
+    uint32_t info[4] = {
+        (uint32_t)batchInfoMap.size(),
+        (uint32_t)meshConsolidator->getVertexStride(),
+        flags,
+        (uint32_t)meshConsolidator->getIndexOffset()
+    };
+    writer.add(MESH_PACK_ENTRY, AssetType::Meshes, info, getSourceTime(), payload.data(), payload.size());
+    return true;
+}
+
+void Mesh::load(MeshData& meshData) {
+    const AssetPack* pack = AssetPack::getGamePack();
+    const AssetPack::Entry* cooked = pack != NULL
+        ? pack->find(MESH_PACK_ENTRY, AssetType::Meshes, getSourceTime()) : NULL;
+
+    if (cooked != NULL) {
+        const CookedBatch* table = (const CookedBatch*)pack->getData(cooked);
+        uint32_t numBatches = cooked->info[0];
+        for (uint32_t i = 0; i < numBatches; i++) {
+            BatchInfo batchInfo;
+            batchInfo.startIndex = table[i].startIndex;
+            batchInfo.numIndices = table[i].numIndices;
+            batchInfo.baseVertex = table[i].baseVertex;
+            meshData.handleIds.push_back(table[i].meshId);
+            meshData.batches.push_back(batchInfo);
         }
-        vertexPositionsVec4[x++] = 120;
+        meshData.data = table + numBatches;
+        meshData.size = cooked->size - numBatches * sizeof(CookedBatch);
+        meshData.indexOffset = cooked->info[3];
+        meshData.stride = cooked->info[1];
+        meshData.flags = cooked->info[2];
+        return;
     }
 
-    // Generate VBO
-    glGenBuffers(1, &m_vbo_position);
-    glBindBuffer(GL_ARRAY_BUFFER, m_vbo_position);
+    meshData.consolidator.reset(consolidate());
+    MeshConsolidator* meshConsolidator = meshData.consolidator.get();
 
-    glBufferData(GL_ARRAY_BUFFER, x * sizeof(float), vertexPositionsVec4, GL_STATIC_DRAW);
+    // Acquire the BatchInfoMap from the MeshConsolidator.
+    BatchInfoMap batchInfoMap;
+    meshConsolidator->getBatchInfoMap(batchInfoMap);
+    for (auto& batch : batchInfoMap) {
+        meshData.handleIds.push_back(batch.first);
+        meshData.batches.push_back(batch.second);
+    }
 
-    glGenBuffers(1, &m_vbo_normal);
-    glBindBuffer(GL_ARRAY_BUFFER, m_vbo_normal);
+    meshData.data = meshConsolidator->getDataPtr();
+    meshData.size = meshConsolidator->getNumDataBytes();
+    meshData.indexOffset = meshConsolidator->getIndexOffset();
+    meshData.stride = meshConsolidator->getVertexStride();
+    meshData.flags = (meshConsolidator->hasShortIndices() ? MESH_SHORT_INDICES : 0)
+        | (meshConsolidator->hasQuantizedNormals() ? MESH_QUANTIZED_NORMALS : 0);
+}
 
-    glBufferData(GL_ARRAY_BUFFER, meshConsolidator->getNumVertexNormalBytes(),
-        meshConsolidator->getVertexNormalDataPtr(), GL_STATIC_DRAW);
+// Models keep pointers to the instance, so it is only ever created once
+void Mesh::create(const MeshData& meshData) {
+    if (instance == NULL) {
+        instance = new Mesh(meshData);
+    }
+}
 
-    delete [] vertexPositionsVec4;
+Mesh::Mesh(const MeshData& meshData) : handleIds(meshData.handleIds), batches(meshData.batches) {
+    CubeShader* cube_shader = CubeShader::getShader();
+    ShadowShader* shadow_shader = ShadowShader::getShader();
+
+    unsigned int flags = meshData.flags;
+    GLsizei stride = meshData.stride;
+    m_indexType = (flags & MESH_SHORT_INDICES) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    m_indexSize = (flags & MESH_SHORT_INDICES) ? sizeof(GLushort) : sizeof(GLuint);
+    m_indexOffset = meshData.indexOffset;
+    // Every vertex starts with its position, see MeshConsolidator
+    const void* normalOffset = (const void*)(3 * sizeof(float));
+
+    // Vertices and indices share one buffer, uploaded as is
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    glBufferData(GL_ARRAY_BUFFER, meshData.size, meshData.data, GL_STATIC_DRAW);
 
 	glGenVertexArrays(1, &m_vao);
-    glBindVertexArray(m_vao);
+    GLState::bindVertexArray(m_vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_buffer);
 
     glEnableVertexAttribArray(cube_shader->positionAttrib);
     glEnableVertexAttribArray(cube_shader->normalAttrib);
 
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_position);
-	glVertexAttribPointer(cube_shader->positionAttrib, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_normal);
-	glVertexAttribPointer(cube_shader->normalAttrib, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+	glVertexAttribPointer(cube_shader->positionAttrib, 3, GL_FLOAT, GL_FALSE, stride, nullptr);
+    if (flags & MESH_QUANTIZED_NORMALS) {
+        glVertexAttribPointer(cube_shader->normalAttrib, 3, GL_SHORT, GL_TRUE, stride, normalOffset);
+    } else {
+        glVertexAttribPointer(cube_shader->normalAttrib, 3, GL_FLOAT, GL_FALSE, stride, normalOffset);
+    }
+
+    // Pointers into the instance buffer are set per draw, the offset moves every frame
+    for (int i = 0; i < 4; i++) {
+        glEnableVertexAttribArray(cube_shader->modelAttrib + i);
+        glVertexAttribDivisor(cube_shader->modelAttrib + i, 1);
+    }
+    for (int i = 0; i < 3; i++) {
+        glEnableVertexAttribArray(cube_shader->modelNormalAttrib + i);
+        glVertexAttribDivisor(cube_shader->modelNormalAttrib + i, 1);
+    }
 
     glGenVertexArrays( 1, &m_vao_shadow );
-    glBindVertexArray( m_vao_shadow );
+    GLState::bindVertexArray( m_vao_shadow );
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_buffer);
     glEnableVertexAttribArray( shadow_shader->positionAttrib );
 
-    glBindBuffer(GL_ARRAY_BUFFER, m_vbo_position);
-    glVertexAttribPointer( shadow_shader->positionAttrib, 4, GL_FLOAT, GL_FALSE, 0, nullptr );
+    glVertexAttribPointer( shadow_shader->positionAttrib, 3, GL_FLOAT, GL_FALSE, stride, nullptr );
+
+    for (int i = 0; i < 4; i++) {
+        glEnableVertexAttribArray(shadow_shader->modelAttrib + i);
+        glVertexAttribDivisor(shadow_shader->modelAttrib + i, 1);
+    }
 
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
 
 	CHECK_GL_ERRORS;
 }
 
 Mesh::~Mesh() {
-    glDeleteBuffers(1, &m_vbo_position);
-    glDeleteBuffers(1, &m_vbo_position);
-    glDeleteVertexArrays(1, &m_vao);
+    glDeleteBuffers(1, &m_buffer);
+    GLState::deleteVertexArrays(1, &m_vao);
+    GLState::deleteVertexArrays(1, &m_vao_shadow);
+}
+
+void bindIdentityModel(GLint modelAttrib, GLint modelNormalAttrib) {
+    // Shared by every chunk, lives as long as the context
+    static GLuint identityBuffer = 0;
+    if (identityBuffer == 0) {
+        ModelInstance identity = {glm::mat4(1.0f), glm::mat3(1.0f)};
+        glGenBuffers(1, &identityBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, identityBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(identity), &identity, GL_STATIC_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, identityBuffer);
+    for (int i = 0; i < 4; i++) {
+        glEnableVertexAttribArray(modelAttrib + i);
+        glVertexAttribDivisor(modelAttrib + i, 1);
+        glVertexAttribPointer(modelAttrib + i, 4, GL_FLOAT, GL_FALSE, sizeof(ModelInstance),
+            (void *)(i * sizeof(glm::vec4)));
+    }
+    for (int i = 0; modelNormalAttrib >= 0 && i < 3; i++) {
+        glEnableVertexAttribArray(modelNormalAttrib + i);
+        glVertexAttribDivisor(modelNormalAttrib + i, 1);
+        glVertexAttribPointer(modelNormalAttrib + i, 3, GL_FLOAT, GL_FALSE, sizeof(ModelInstance),
+            (void *)(offsetof(ModelInstance, normalMatrix) + i * sizeof(glm::vec3)));
+    }
+}
 
+int Mesh::getHandle(const std::string& meshId) {
+    for (size_t i = 0; i < handleIds.size(); i++) {
+        if (handleIds[i] == meshId) {
+            return i;
+        }
+    }
+    return -1;
 }
 
 void Mesh::bindVAO(bool on, bool shadow) {
     if (on) {
         if (shadow) {
-            glBindVertexArray(m_vao_shadow);
+            GLState::bindVertexArray(m_vao_shadow);
         } else {
-            glBindVertexArray(m_vao);
+            GLState::bindVertexArray(m_vao);
         }
     } else {
-	    glBindVertexArray(0);
+	    GLState::bindVertexArray(0);
     }
 }
 
-void Mesh::render(std::string meshId) {
-    BatchInfo batchInfo = m_batchInfoMap[meshId];
-    glDrawArrays(GL_TRIANGLES, batchInfo.startIndex, batchInfo.numIndices);
+void Mesh::setInstanceBuffer(GLuint buffer, GLintptr offset, bool shadow) {
+    GLint modelAttrib = shadow ? ShadowShader::getShader()->modelAttrib : CubeShader::getShader()->modelAttrib;
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (int i = 0; i < 4; i++) {
+        glVertexAttribPointer(modelAttrib + i, 4, GL_FLOAT, GL_FALSE, sizeof(ModelInstance),
+            (void *)(offset + i * sizeof(glm::vec4)));
+    }
+    if (shadow) {
+        return;
+    }
+    GLint modelNormalAttrib = CubeShader::getShader()->modelNormalAttrib;
+    for (int i = 0; i < 3; i++) {
+        glVertexAttribPointer(modelNormalAttrib + i, 3, GL_FLOAT, GL_FALSE, sizeof(ModelInstance),
+            (void *)(offset + offsetof(ModelInstance, normalMatrix) + i * sizeof(glm::vec3)));
+    }
+}
+
+void Mesh::renderInstanced(int handle, int count) {
+    const BatchInfo& batchInfo = batches[handle];
+    const void* indices = (const void*)(m_indexOffset + batchInfo.startIndex * m_indexSize);
+    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, batchInfo.numIndices, m_indexType, indices,
+        count, batchInfo.baseVertex);
 }
 
 MeshModel::MeshModel (std::string file) : meshRender(Mesh::getMeshRender()) {
-    m_rootNode = std::shared_ptr<SceneNode>(import_lua(file));
+    m_rootNode = std::shared_ptr<SceneNode>(SceneCache::instantiate(file));
 	if (!m_rootNode) {
 		std::cerr << "Could not open " << file << std::endl;
 	}
-}
-
-void MeshModel::renderNode(const SceneNode* node, glm::mat4 trans, const SceneNode* parent, bool shadow) {
-    trans = trans * node->trans;
+    scene.build(m_rootNode.get());
 
-    if (node->m_nodeType == NodeType::SceneNode) {
-    }
-    else if (node->m_nodeType == NodeType::GeometryNode) {
-        const GeometryNode* geometryNode = static_cast<const GeometryNode *>(node);
-        if (shadow) {
-            glUniformMatrix4fv(ShadowShader::getShader()->MVP_uni, 1, GL_FALSE, value_ptr(trans));
-        } else {
-            glUniformMatrix4fv(CubeShader::getShader()->VM_uni, 1, GL_FALSE, value_ptr(trans));
+    for (int node : scene.getGeometry()) {
+        int handle = meshRender->getHandle(scene.getMeshId(node));
+        if (handle < 0) {
+            std::cerr << "Unknown mesh " << scene.getMeshId(node) << " in " << file << std::endl;
         }
-		//-- Now render the mesh:
-        meshRender->render(geometryNode->meshId);
-    } else { // JointNode
-        const JointNode* jointNode = static_cast<const JointNode *>(node);
-        trans = trans * jointNode->get_x_rotate() * jointNode->get_y_rotate();
+        meshHandles.push_back(handle);
     }
+}
 
-    for (const SceneNode* children : node->children) {
-        renderNode(children, trans, node, shadow);
-    }
+void MeshModel::update() {
+    scene.update();
+}
+
+const FlatScene& MeshModel::getScene() const {
+    return scene;
 }
-void MeshModel::render(glm::mat4 view, bool shadow) {
-    meshRender->bindVAO(true, shadow);
-    this->renderNode(&*m_rootNode, view, NULL, shadow);
-    meshRender->bindVAO(false, shadow);
+
+const std::vector<int>& MeshModel::getMeshHandles() const {
+    return meshHandles;
 }
 
 SceneNode* MeshModel::getRoot() {
     return &*m_rootNode;
 }
 
-Particles::Particles() {
-    static const float vertex_buffer_data[] = {
-        -0.5f, -0.5f, 0.0f,
-        0.5f, -0.5f, 0.0f,
-        -0.5f, 0.5f, 0.0f,
-        0.5f, 0.5f, 0.0f
-    };
+// Billboard quad drawn once per particle instance
+static const float particle_quad_data[] = {
+    -0.5f, -0.5f, 0.0f,
+    0.5f, -0.5f, 0.0f,
+    -0.5f, 0.5f, 0.0f,
+    0.5f, 0.5f, 0.0f
+};
 
+Particles::Particles() {
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_buffer_data), vertex_buffer_data, GL_STATIC_DRAW);
-
-    glGenBuffers(1, &pbo);
-    glBindBuffer(GL_ARRAY_BUFFER, pbo);
-    glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * 4 * sizeof(float), NULL, GL_STREAM_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(particle_quad_data), particle_quad_data, GL_STATIC_DRAW);
 
-    glGenBuffers(1, &cbo);
-    glBindBuffer(GL_ARRAY_BUFFER, cbo);
-    glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * 4 * sizeof(float), NULL, GL_STREAM_DRAW);
+    instanceBuffer = new StreamBuffer(GL_ARRAY_BUFFER, 2 * MAX_PARTICLES * 4 * sizeof(float));
+    instanceOffset = 0;
 
     ParticleShader* particle_shader = ParticleShader::getShader();
 
     glGenVertexArrays( 1, &m_vao );
-    glBindVertexArray( m_vao );
+    GLState::bindVertexArray( m_vao );
 
     glEnableVertexAttribArray( particle_shader->vertex_positionAttrib);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glVertexAttribPointer(particle_shader->vertex_positionAttrib, 3, GL_FLOAT, GL_FALSE, 0, (void *)0);
 
+    // Pointers into the stream buffer are set in render(), the offset moves every frame
     glEnableVertexAttribArray( particle_shader->particle_positionAttrib);
-    glBindBuffer(GL_ARRAY_BUFFER, pbo);
-    glVertexAttribPointer(particle_shader->particle_positionAttrib, 4, GL_FLOAT, GL_FALSE, 0, (void *)0);
-
     glEnableVertexAttribArray( particle_shader->colorAttrib);
-    glBindBuffer(GL_ARRAY_BUFFER, cbo);
-    glVertexAttribPointer(particle_shader->colorAttrib, 4, GL_FLOAT, GL_FALSE, 0, (void *)0);
 
     CHECK_GL_ERRORS;
     //
     num_particles = 0;
-    last_particle = 0;
+}
 
-    for (int i = 0; i < MAX_PARTICLES; i++) {
-        particleArr[i].life = -1;
-    }
+Particles::~Particles() {
+    delete instanceBuffer;
+    glDeleteBuffers(1, &vbo);
+    GLState::deleteVertexArrays(1, &m_vao);
 }
 
 void Particles::updateBuffer() {
-    glBindBuffer(GL_ARRAY_BUFFER, pbo);
-    glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * 4 * sizeof(float), NULL, GL_STREAM_DRAW);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, num_particles * 4 * sizeof(float), position_data);
-
-    glBindBuffer(GL_ARRAY_BUFFER, cbo);
-    glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * 4 * sizeof(float), NULL, GL_STREAM_DRAW);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, num_particles * 4 * sizeof(float), color_data);
+    float* data = (float*)instanceBuffer->map();
+    if (data == NULL) {
+        num_particles = 0;
+        return;
+    }
+    num_particles = pool.getCount();
+    pool.pack(data, data + 4 * num_particles);
+    instanceOffset = instanceBuffer->unmap(2 * num_particles * 4 * sizeof(float));
     CHECK_GL_ERRORS;
 }
 
 void Particles::render(glm::mat4 view) {
     ParticleShader* particle_shader = ParticleShader::getShader();
 
-    glBindVertexArray( m_vao );
+    GLState::bindVertexArray( m_vao );
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer->getBuffer());
+    glVertexAttribPointer(particle_shader->particle_positionAttrib, 4, GL_FLOAT, GL_FALSE, 0,
+        (void *)instanceOffset);
+    glVertexAttribPointer(particle_shader->colorAttrib, 4, GL_FLOAT, GL_FALSE, 0,
+        (void *)(instanceOffset + num_particles * 4 * sizeof(float)));
     glVertexAttribDivisor(particle_shader->vertex_positionAttrib, 0);
     glVertexAttribDivisor(particle_shader->particle_positionAttrib, 1);
     glVertexAttribDivisor(particle_shader->colorAttrib, 1);
 
     glUniformMatrix4fv( particle_shader->MVP_uni, 1, GL_FALSE, value_ptr( view ) );
     glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, num_particles);
+    instanceBuffer->fence();
 
     CHECK_GL_ERRORS;
 }
 
-int Particles::findFreeParticle(){
-    for(int i = last_particle; i< MAX_PARTICLES; i++){
-        if (particleArr[i].life < 0){
-            last_particle = i;
-            return i;
-        }
+// Advances the simulation by one tick, the GPU buffers are refreshed
+// separately by updateBuffer() once per rendered frame
+void Particles::updateParticles(glm::vec3 cameraPos, float delta) {
+    pool.update(cameraPos, delta);
+}
+
+void Particles::addParticle(glm::vec3 loc, glm::vec3 v, glm::vec4 c, float size) {
+    pool.addParticle(loc, v, c, size);
+}
+
+void Particles::setCollision(ChunkManager* world, ParticleCollision mode) {
+    pool.setCollision(world, mode);
+}
+
+void Particles::setSorting(bool on) {
+    pool.setSorting(on);
+}
+
+ParticlePool* Particles::getPool() {
+    return &pool;
+}
+
+GpuParticles::GpuParticles(int capacity)
+    : capacity(capacity), used(0), cursor(0), source(0)
+{
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(particle_quad_data), particle_quad_data, GL_STATIC_DRAW);
+
+    // Slots past used are never read, so the buffers need no initial data
+    glGenBuffers(2, stateBuffers);
+    for (int i = 0; i < 2; i++) {
+        glBindBuffer(GL_ARRAY_BUFFER, stateBuffers[i]);
+        glBufferData(GL_ARRAY_BUFFER, capacity * GPU_PARTICLE_STRIDE, NULL, GL_DYNAMIC_COPY);
     }
 
-    for(int i = 0; i< last_particle; i++){
-        if (particleArr[i].life < 0){
-            last_particle = i;
-            return i;
+    spawnBuffer = new StreamBuffer(GL_COPY_READ_BUFFER, GPU_PARTICLE_SPAWN_BATCH * GPU_PARTICLE_STRIDE);
+    spawns.reserve(GPU_PARTICLE_SPAWN_BATCH * GPU_PARTICLE_FLOATS);
+
+    ParticleShader* particle_shader = ParticleShader::getShader();
+    ParticleUpdateShader::getShader();
+
+    glGenVertexArrays(2, updateVaos);
+    glGenVertexArrays(2, renderVaos);
+    for (int i = 0; i < 2; i++) {
+        // Locations are fixed in particle_update_VertexShader.vs
+        GLState::bindVertexArray(updateVaos[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, stateBuffers[i]);
+        for (GLuint attrib = 0; attrib < 3; attrib++) {
+            glEnableVertexAttribArray(attrib);
+            glVertexAttribPointer(attrib, 4, GL_FLOAT, GL_FALSE, GPU_PARTICLE_STRIDE,
+                (void *)(attrib * 4 * sizeof(float)));
         }
+
+        GLState::bindVertexArray(renderVaos[i]);
+        glEnableVertexAttribArray(particle_shader->vertex_positionAttrib);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glVertexAttribPointer(particle_shader->vertex_positionAttrib, 3, GL_FLOAT, GL_FALSE, 0, (void *)0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, stateBuffers[i]);
+        glEnableVertexAttribArray(particle_shader->particle_positionAttrib);
+        glVertexAttribPointer(particle_shader->particle_positionAttrib, 4, GL_FLOAT, GL_FALSE,
+            GPU_PARTICLE_STRIDE, (void *)0);
+        glVertexAttribDivisor(particle_shader->particle_positionAttrib, 1);
+        glEnableVertexAttribArray(particle_shader->colorAttrib);
+        glVertexAttribPointer(particle_shader->colorAttrib, 4, GL_FLOAT, GL_FALSE,
+            GPU_PARTICLE_STRIDE, (void *)(8 * sizeof(float)));
+        glVertexAttribDivisor(particle_shader->colorAttrib, 1);
     }
-    return 0;
+    GLState::bindVertexArray(0);
+
+    CHECK_GL_ERRORS;
 }
 
-void Particles::updateParticles(glm::vec3 cameraPos) {
-    static const float delta = 1.0/60.0; // Represent delta time, TODO:use actual time
-    num_particles = 0;
-    for (int i = 0; i < MAX_PARTICLES; i++) {
-        Particle& p = particleArr[i];
-        if (p.life > 0.0f) {
-            p.life -= delta;
-            if (p.life > 0) {
-                // simulate falling
-                p.velocity += glm::vec3(0.0f,-9.81f, 0.0f) * (float)delta * 0.5f;
-                p.position += p.velocity * (float)delta;
-
-                p.cameraDist = glm::length(p.position - cameraPos);
-
-                position_data[4 * num_particles + 0] = p.position.x;
-                position_data[4 * num_particles + 1] = p.position.y;
-                position_data[4 * num_particles + 2] = p.position.z;
-                position_data[4 * num_particles + 3] = p.size;
-
-                color_data[4 * num_particles + 0] = p.color.r;
-                color_data[4 * num_particles + 1] = p.color.g;
-                color_data[4 * num_particles + 2] = p.color.b;
-                color_data[4 * num_particles + 3] = p.color.a;
-
-                num_particles++;
-            } else {
-                p.cameraDist = -1;
-            }
+GpuParticles::~GpuParticles() {
+    delete spawnBuffer;
+    GLState::deleteVertexArrays(2, renderVaos);
+    GLState::deleteVertexArrays(2, updateVaos);
+    glDeleteBuffers(2, stateBuffers);
+    glDeleteBuffers(1, &vbo);
+}
+
+void GpuParticles::addParticle(glm::vec3 loc, glm::vec3 v, glm::vec4 c, float size) {
+    float particle[GPU_PARTICLE_FLOATS] = {
+        loc.x, loc.y, loc.z, size,
+        v.x, v.y, v.z, PARTICLE_LIFE,
+        c.r, c.g, c.b, c.a
+    };
+    spawns.insert(spawns.end(), particle, particle + GPU_PARTICLE_FLOATS);
+}
+
+// Copies the queued spawns into the ring, one upload per batch. If more
+// were queued than the ring holds only the newest ones are kept.
+void GpuParticles::flushSpawns() {
+    int queued = spawns.size() / GPU_PARTICLE_FLOATS;
+    int count = std::min(queued, capacity);
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, stateBuffers[source]);
+    for (int done = 0; done < count; ) {
+        int batch = std::min(count - done, GPU_PARTICLE_SPAWN_BATCH);
+        const float* first = &spawns[(queued - count + done) * GPU_PARTICLE_FLOATS];
+
+        void* data = spawnBuffer->map();
+        if (data == NULL) {
+            break;
+        }
+        memcpy(data, first, batch * GPU_PARTICLE_STRIDE);
+        GLintptr offset = spawnBuffer->unmap(batch * GPU_PARTICLE_STRIDE);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, spawnBuffer->getBuffer());
+        int tail = std::min(batch, capacity - cursor);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+            offset, cursor * GPU_PARTICLE_STRIDE, tail * GPU_PARTICLE_STRIDE);
+        if (tail < batch) {
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                offset + tail * GPU_PARTICLE_STRIDE, 0, (batch - tail) * GPU_PARTICLE_STRIDE);
         }
+        spawnBuffer->fence();
+
+        cursor = (cursor + batch) % capacity;
+        used = std::min(capacity, used + batch);
+        done += batch;
     }
-    updateBuffer();
+    spawns.clear();
 }
 
-void Particles::addParticle(glm::vec3 loc, glm::vec3 v, glm::vec4 c, float size) {
-    int slot = findFreeParticle();
+void GpuParticles::updateParticles(glm::vec3, float delta) {
+    flushSpawns();
+    if (used == 0) {
+        return;
+    }
+
+    ParticleUpdateShader* update_shader = ParticleUpdateShader::getShader();
+    update_shader->enable();
+    glUniform1f(update_shader->delta_uni, delta);
+    glUniform1f(update_shader->gravity_uni, PARTICLE_GRAVITY);
+
+    GLState::enable(GL_RASTERIZER_DISCARD);
+    GLState::bindVertexArray(updateVaos[source]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, stateBuffers[1 - source]);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, used);
+    glEndTransformFeedback();
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    GLState::bindVertexArray(0);
+    GLState::disable(GL_RASTERIZER_DISCARD);
+    update_shader->disable();
+
+    source = 1 - source;
+    CHECK_GL_ERRORS;
+}
 
-    particleArr[slot].life = 2.0;
-    particleArr[slot].position = loc;
-    particleArr[slot].velocity = v;
-    particleArr[slot].color = c;
-    particleArr[slot].size = size;
+// The state is already on the GPU
+void GpuParticles::updateBuffer() {
 }
 
+void GpuParticles::render(glm::mat4 view) {
+    ParticleShader* particle_shader = ParticleShader::getShader();
+
+    GLState::bindVertexArray(renderVaos[source]);
+    glUniformMatrix4fv( particle_shader->MVP_uni, 1, GL_FALSE, value_ptr( view ) );
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, used);
+
+    CHECK_GL_ERRORS;
+}
+
+int GpuParticles::getUsed() const {
+    return used;
+}
+
+void GpuParticles::readState(std::vector<float>& state) {
+    state.resize(used * GPU_PARTICLE_FLOATS);
+    if (used > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, stateBuffers[source]);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, used * GPU_PARTICLE_STRIDE, state.data());
+    }
+    CHECK_GL_ERRORS;
+}
@@ -3,12 +3,18 @@
 #include "cs488-framework/ShaderProgram.hpp"
 #include "cs488-framework/MeshConsolidator.hpp"
 
+#include "FlatScene.hpp"
 #include "SceneNode.hpp"
+#include "ParticlePool.hpp"
+#include "StreamBuffer.hpp"
 
 
+#include <cstdint>
+#include <ctime>
 #include <string>
 #include <glm/glm.hpp>
 #include <memory>
+#include <vector>
 
 class Shader {
 public:
@@ -16,6 +22,7 @@ public:
     void enable() const;
     void disable() const;
 protected:
+    Shader() {}
     ShaderProgram m_shader;
 };
 
@@ -27,7 +34,8 @@ public:
     GLint P_uni;
     GLint VM_uni;
     GLint Normal_Matrix_uni;
-    GLint depthBiasMVP_uni;
+    GLint cascadeFromView_uni;
+    GLint cascadeEnds_uni;
     GLint tex_uni;
     GLint texShadow_uni;
     GLint texWater_uni;
@@ -36,10 +44,13 @@ public:
     GLint light_position_uni;
     GLint light_rgbIntensity_uni;
     GLint moveFactor_uni;
+    GLint meshTile_uni;
 
     // Attributes
     GLint positionAttrib;
     GLint normalAttrib;
+    GLint modelAttrib;
+    GLint modelNormalAttrib;
 private:
     CubeShader();
 };
@@ -53,6 +64,7 @@ public:
 
     // Attributes
     GLint positionAttrib;
+    GLint modelAttrib;
 private:
     ShadowShader();
 };
@@ -72,27 +84,76 @@ private:
     ParticleShader();
 };
 
+// Vertex only program whose outputs are captured with transform feedback
+class ParticleUpdateShader : public Shader {
+public:
+    static ParticleUpdateShader* getShader();
+
+    // Uniforms
+    GLint delta_uni;
+    GLint gravity_uni;
+private:
+    ParticleUpdateShader();
+};
+
+
+class AssetPackWriter;
+
+// Tiles per row of tileSet.png, tile row * TILESET_COLUMNS + column is the
+// layer of the block texture array
+#define TILESET_COLUMNS 16
+
+// An RGBA8 image decoded for Texture, pixels point into the asset pack or
+// into decoded. NULL pixels if decoding failed. An image with more than one
+// layer or level becomes an array texture, pixels then hold every layer of
+// the first level, then every layer of the next.
+struct TextureImage {
+    unsigned width;
+    unsigned height;
+    unsigned layers;
+    unsigned levels;
+    const unsigned char* pixels;
+    std::vector<unsigned char> decoded;
+};
 
 class Texture {
 public:
+    // Uploads the cooked image from the game's asset pack if there is one
     Texture(std::string imageUrl);
+    Texture(const TextureImage& image);
     Texture(int width, int height, std::string type);
     bool bind(GLint uniform);
+    // Reallocates the storage of a render target, contents are lost
+    void resize(int width, int height);
     ~Texture();
     int getWidth();
     int getHeight();
     GLuint getTex();
 
+    // No GL calls, safe on any thread
+    static bool decode(const std::string& imageUrl, TextureImage& image);
+    // Cuts an atlas of square tiles into layers with full mip chains, so
+    // tiles never bleed into each other when minified
+    static bool splitTiles(const TextureImage& atlas, unsigned columns, TextureImage& tiles);
+    // Skips the split when the pack holds the tiles from cookTiles
+    static bool decodeTiles(const std::string& imageUrl, unsigned columns, TextureImage& tiles);
+    // Decodes the image and adds it to a pack
+    static bool cook(AssetPackWriter& writer, const std::string& imageUrl);
+    // Adds the image's tiles and their mips as splitTiles cuts them to a pack
+    static bool cookTiles(AssetPackWriter& writer, const std::string& imageUrl, unsigned columns);
+
     std::string type;
 private:
+    void upload(const TextureImage& image);
+
     GLuint tex;
+    GLenum target;
     unsigned width;
     unsigned height;
     bool loaded;
 
+    // Texture unit, held for the texture's lifetime
     int textureId;
-
-    static int textureCounter;
 };
 
 class FrameBuffer {
@@ -102,6 +163,8 @@ public:
 
     void bind();
     void unbind();
+    // Both buffers need depth textures of the same size
+    void copyDepthTo(FrameBuffer* target);
 
     Texture* texture;
 private:
@@ -110,18 +173,85 @@ private:
     GLuint frameBufferName;
 };
 
+// Per instance attributes of the instanced mesh draws. The normal matrix is
+// transpose(inverse(mat3(model))), worked out once per instance on the CPU
+struct ModelInstance {
+    glm::mat4 model;
+    glm::mat3 normalMatrix;
+};
+
+// Points the model attributes of the bound VAO at one identity ModelInstance,
+// for geometry drawn without instances. The shadow shader has no normal
+// matrix, -1 skips it
+void bindIdentityModel(GLint modelAttrib, GLint modelNormalAttrib = -1);
+
+// Tileset tile the mesh models are textured with, see meshTile in VertexShader.vs
+#define MESH_TILE 120
+
+// Asset pack entry holding all of Mesh's buffer
+#define MESH_PACK_ENTRY "meshes"
+
+// Mesh's buffer and batches before upload, data points into the asset pack
+// or into consolidator
+struct MeshData {
+    std::vector<std::string> handleIds;
+    std::vector<BatchInfo> batches;
+    const void* data;
+    size_t size;
+    size_t indexOffset;
+    size_t stride;
+    unsigned int flags;
+    std::unique_ptr<MeshConsolidator> consolidator;
+};
+
+// All meshes in one buffer, drawn instanced with a model matrix per instance
 class Mesh {
 public:
+    // Loads and uploads the meshes on first use unless create() was called
     static Mesh* getMeshRender();
-    void render(std::string meshId);
+    // Reads the cooked meshes or decodes the .obj files, no GL calls
+    static void load(MeshData& meshData);
+    // Uploads the data as the instance getMeshRender() returns, unless there
+    // already is one
+    static void create(const MeshData& meshData);
+
+    static std::vector<std::string> getObjFiles();
+    // The .obj files decoded into Mesh's layout, owned by the caller
+    static MeshConsolidator* consolidate();
+    // Newest modification time of the .obj files
+    static time_t getSourceTime();
+    // Adds the consolidated meshes to a pack, Mesh uploads them from there
+    // until the .obj files change. False if an .obj file cannot be decoded
+    static bool cook(AssetPackWriter& writer);
+
+    // Resolved once at load so draws need no string lookup, -1 if unknown
+    int getHandle(const std::string& meshId);
     void bindVAO(bool on, bool shadow);
+    // Points the model attributes of the bound VAO at tightly packed ModelInstances
+    void setInstanceBuffer(GLuint buffer, GLintptr offset, bool shadow);
+    void renderInstanced(int handle, int count);
 private:
-    Mesh();
+    // One per mesh ahead of the data in a cooked pack, 64 bytes so the data
+    // stays aligned
+    struct CookedBatch {
+        char meshId[48];
+        uint32_t startIndex;
+        uint32_t numIndices;
+        int32_t baseVertex;
+        uint32_t pad;
+    };
+
+    Mesh(const MeshData& meshData);
     ~Mesh();
-    unsigned int numVertices;
-    GLuint m_vbo_position;
-    GLuint m_vbo_normal;
-    BatchInfoMap m_batchInfoMap;
+    static Mesh* instance;
+
+    // Interleaved vertices followed by the indices
+    GLuint m_buffer;
+    GLenum m_indexType;
+    size_t m_indexOffset;
+    size_t m_indexSize;
+    std::vector<std::string> handleIds;
+    std::vector<BatchInfo> batches;
     GLuint m_vao;
     GLuint m_vao_shadow;
 };
@@ -129,47 +259,102 @@ private:
 class MeshModel {
 public:
     MeshModel(std::string file);
-    void render(glm::mat4 view, bool shadow);
+    // Picks up joint changes, once per frame before the passes
+    void update();
     SceneNode* getRoot();
+    const FlatScene& getScene() const;
+    // Mesh handle of each geometry node, in FlatScene::getGeometry() order
+    const std::vector<int>& getMeshHandles() const;
 private:
-    void renderNode(const SceneNode* node, glm::mat4 trans, const SceneNode* parent, bool shadow);
     Mesh* meshRender;
     std::shared_ptr<SceneNode> m_rootNode;
+    FlatScene scene;
+    std::vector<int> meshHandles;
 };
 
-struct Particle {
-    glm::vec3 position, velocity;
-    glm::vec4 color;
-    float size;
-    float cameraDist;
-    float life; // Remaining life of the particle. if < 0 : dead and unused.
+// Interface shared by the CPU and GPU particle backends
+class ParticleSystem {
+public:
+    virtual ~ParticleSystem() {}
+
+    // Advances the simulation by one tick
+    virtual void updateParticles(glm::vec3 cameraPos, float delta) = 0;
+    // Refreshes what render() draws, once per rendered frame
+    virtual void updateBuffer() = 0;
+    virtual void render(glm::mat4 view) = 0;
+    virtual void addParticle(glm::vec3 loc, glm::vec3 v, glm::vec4 c, float size) = 0;
+
+    // Only the CPU backend has the block data to collide with and sorts
+    virtual void setCollision(ChunkManager*, ParticleCollision) {}
+    virtual void setSorting(bool) {}
 };
 
 // Code From: http://www.opengl-tutorial.org/intermediate-tutorials/billboards-particles/particles-instancing/
-#define MAX_PARTICLES 1000
-class Particles {
+class Particles : public ParticleSystem {
 public:
     Particles();
+    ~Particles();
 
-    void updateParticles(glm::vec3 cameraPos);
+    void updateParticles(glm::vec3 cameraPos, float delta);
     void updateBuffer();
     void render(glm::mat4 view);
     void addParticle(glm::vec3 loc, glm::vec3 v, glm::vec4 c, float size);
+    void setCollision(ChunkManager* world, ParticleCollision mode);
+    void setSorting(bool on);
 
-
-    int findFreeParticle();
+    ParticlePool* getPool();
 private:
 
-    Particle particleArr[MAX_PARTICLES];
+    ParticlePool pool;
     int num_particles;
-    int last_particle;
-
-    float position_data[4 * MAX_PARTICLES];
-    float color_data[4 * MAX_PARTICLES];
 
     GLuint vbo; // vertex buffer
-    GLuint pbo; // position buffer
-    GLuint cbo; // color buffer
+    // Per frame positions followed by colors, num_particles of each
+    StreamBuffer* instanceBuffer;
+    GLintptr instanceOffset;
 
     GLuint m_vao;
 };
+
+#define GPU_MAX_PARTICLES 1000000
+#define GPU_PARTICLE_SPAWN_BATCH 16384
+// Layout of one particle in the GPU state buffers
+#define GPU_PARTICLE_FLOATS 12
+#define GPU_PARTICLE_STRIDE (GPU_PARTICLE_FLOATS * sizeof(float))
+
+// Particles simulated on the GPU. State lives in two buffers, each tick a
+// transform feedback pass reads one and writes the other. Slots are handed
+// out as a ring, so once full the oldest particles are overwritten. Spawns
+// are queued and uploaded in batches at the start of the next tick.
+class GpuParticles : public ParticleSystem {
+public:
+    GpuParticles(int capacity = GPU_MAX_PARTICLES);
+    ~GpuParticles();
+
+    void updateParticles(glm::vec3 cameraPos, float delta);
+    void updateBuffer();
+    void render(glm::mat4 view);
+    void addParticle(glm::vec3 loc, glm::vec3 v, glm::vec4 c, float size);
+
+    // Slots that have held a particle, live or dead
+    int getUsed() const;
+    // Copies the used slots back as (position, size), (velocity, life),
+    // color, dead ones have size 0. Waits for the GPU, for tests only
+    void readState(std::vector<float>& state);
+private:
+    void flushSpawns();
+
+    int capacity;
+    int used;
+    int cursor;
+    int source; // Index of the buffer holding the current state
+
+    // Queued (position, size), (velocity, life), color per spawn
+    std::vector<float> spawns;
+    StreamBuffer* spawnBuffer;
+
+    GLuint vbo; // quad vertices
+    GLuint stateBuffers[2];
+    GLuint updateVaos[2];
+    GLuint renderVaos[2];
+};
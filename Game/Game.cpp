@@ -3,8 +3,13 @@
 
 #include "cs488-framework/GlErrorCheck.hpp"
 #include "cs488-framework/MathUtils.hpp"
+#include "AssetLoader.hpp"
 #include "GeometryNode.hpp"
 #include "JointNode.hpp"
+#include "GLState.hpp"
+#include "GpuProfiler.hpp"
+#include "Profiler.hpp"
+#include "SceneCache.hpp"
 
 #include <imgui/imgui.h>
 
@@ -21,6 +26,7 @@ using namespace glm;
 using namespace std;
 
 static bool show_gui = true;
+static bool show_profiler = false;
 
 const size_t CIRCLE_PTS = 48;
 
@@ -28,9 +34,12 @@ const int button_types[] = {GLFW_MOUSE_BUTTON_LEFT, GLFW_MOUSE_BUTTON_MIDDLE, GL
 
 //----------------------------------------------------------------------------------------
 // Constructor
-Game::Game() : msaa(false), enablePlayerParticle(false)
+Game::Game() : shadowCaching(true), reflectionScale(REFLECTION_SCALE), enablePlayerParticle(false), gpuParticles(false),
+    particleCollision((int)ParticleCollision::BOUNCE), sortParticles(true), renderEnabled(true), vsync(true),
+    numEnemies(0), msaa(false)
 {
     moveFactor = glm::vec2(0,0);
+    shadowLightDirection = glm::vec3(0);
 }
 
 //----------------------------------------------------------------------------------------
@@ -40,8 +49,13 @@ Game::~Game()
     delete cubeTexture;
     delete worldManager;
 
-    delete shadowFrameBuffer;
     delete particle_system;
+    for (Enemy* enemy : enemies) {
+        delete enemy;
+    }
+    for (AnimationClip* clip : animationClips) {
+        delete clip;
+    }
 }
 
 //----------------------------------------------------------------------------------------
@@ -53,19 +67,64 @@ void Game::init()
 	// Set the background colour.
 	glClearColor(0.35, 0.35, 0.35, 1.0);
 
-    initShader();
+    Profiler::setThreadName("main");
+    GpuProfiler::init();
+
 	initCamera();
-    initGameWorld();
+    loadAssets();
     initTexture();
 	initLightSources();
 
     audio.playBackground();
     particle_system = new Particles();
+    particle_system->setCollision(worldManager, (ParticleCollision)particleCollision);
+    particle_system->setSorting(sortParticles);
+
+    lastFrameTime = glfwGetTime();
 }
 
+// The loader's threads decode the files while the main thread compiles the
+// shaders and uploads whatever has been decoded
+void Game::loadAssets() {
+    AssetLoader loader;
+    TextureImage tileSetImage;
+    TextureImage dudvImage;
+    MeshData meshData;
+
+    int shaders = loader.add("shaders", NULL, [&]() { initShader(); });
+    loader.add("tileSet.png",
+        [&]() { Texture::decodeTiles(getAssetFilePath("tileSet.png"), TILESET_COLUMNS, tileSetImage); },
+        [&]() { cubeTexture = new Texture(tileSetImage); });
+    loader.add("dudv.png",
+        [&]() { Texture::decode(getAssetFilePath("dudv.png"), dudvImage); },
+        [&]() { dudvTexture = new Texture(dudvImage); });
+    // The vertex arrays are set up with the shaders' attribute locations
+    int meshes = loader.add("meshes", [&]() { Mesh::load(meshData); }, [&]() { Mesh::create(meshData); },
+        {shaders});
+    int puppet = loader.add("puppet.lua", [&]() { SceneCache::get(getAssetFilePath("puppet.lua")); }, NULL);
+    int clips = loader.add("puppet_anim.lua",
+        [&]() { animationClips = AnimationClip::loadAll(getAssetFilePath("puppet_anim.lua")); }, NULL);
+    loader.add("sounds", [&]() { audio.load(); }, NULL);
+    loader.add("game world", NULL, [&]() { initGameWorld(); }, {meshes, puppet, clips});
+
+    loader.run();
+}
+
+// Needs the meshes, the puppet scene and the animation clips
 void Game::initGameWorld() {
     this->worldManager = new ChunkManager();
     this->player.loadModel();
+    player.animation = animations.add(player.playerModel->getRoot());
+
+    walkClip = smashClip = -1;
+    for (AnimationClip* clip : animationClips) {
+        int handle = animations.bindClip(clip);
+        if (clip->name == "walk") {
+            walkClip = handle;
+        } else if (clip->name == "smash") {
+            smashClip = handle;
+        }
+    }
     timeOfDay = 0;
 }
 
@@ -82,28 +141,26 @@ void Game::initCamera()
 	float aspect = ((float)m_windowWidth) / m_windowHeight;
     camera.aspect = aspect;
     camera.generateProjectionMatrix();
-
-    m_shadow_perspective = glm::ortho<float>(-30,30,-30,30,-10,200);
-    //m_perspective = m_shadow_perspective;
-    //m_shadow_perspective = m_perspective;
 }
 
 //----------------------------------------------------------------------------------------
 
+// The tileset and dudv textures come from loadAssets()
 void Game::initTexture() {
-    shadowTexture = new Texture(1024, 768, "depth");
-    waterTexture = new Texture(1024, 768, "color");
-
-    cubeTexture = new Texture(getAssetFilePath("tileSet.png"));
-    dudvTexture = new Texture(getAssetFilePath("dudv.png"));
-    shadowFrameBuffer = new FrameBuffer(shadowTexture);
-    waterFrameBuffer = new FrameBuffer(waterTexture);
+    shadowFrameBuffer = renderTargets.acquire(SHADOW_CASCADES * SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, "depth");
+    staticShadowFrameBuffer = renderTargets.acquire(SHADOW_CASCADES * SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, "depth");
+    for (int i = 0; i < SHADOW_CASCADES; i++) {
+        staticShadowDirty[i] = true;
+    }
+    waterFrameBuffer = NULL;
 
     cube_shader->enable();
     cubeTexture->bind(cube_shader->tex_uni);
-    waterTexture->bind(cube_shader->texWater_uni);
     dudvTexture->bind(cube_shader->texDUDV_uni);
-    shadowTexture->bind(cube_shader->texShadow_uni);
+    shadowFrameBuffer->texture->bind(cube_shader->texShadow_uni);
+    // Until the first reflection. Left at unit 0 it could share a unit with
+    // the tileset's array texture, which fails every draw.
+    dudvTexture->bind(cube_shader->texWater_uni);
     cube_shader->disable();
 }
 
@@ -116,8 +173,37 @@ void Game::initLightSources() {
 //----------------------------------------------------------------------------------------
 void Game::updateViewMatrix() {
     camera.update(player);
-    m_shadow_view = glm::lookAt(m_light.position * 10, m_light.position * 9, vec3(0, 1, 0));
-    // m_shadow_view = m_view;
+    updateShadowCascades();
+}
+
+// Splits the view distance into cascades and fits a shadow box to each slice
+void Game::updateShadowCascades() {
+    // The cached direction only follows the sun in steps, every step redraws
+    // all cached cascades
+    if (!shadowCaching ||
+        glm::dot(shadowLightDirection, m_light.position) < glm::cos(glm::radians(SHADOW_CACHE_ANGLE))) {
+        shadowLightDirection = m_light.position;
+    }
+    float padding = shadowCaching ? SHADOW_CACHE_PADDING : 0.0f;
+
+    float near = camera.near_plane;
+    float far = camera.far_plane;
+    for (int i = 0; i < SHADOW_CASCADES; i++) {
+        float t = (i + 1) / (float)SHADOW_CASCADES;
+        float uniformSplit = near + (far - near) * t;
+        float logSplit = near * glm::pow(far / near, t);
+        float end = glm::mix(uniformSplit, logSplit, SHADOW_SPLIT_LAMBDA);
+
+        if (shadowCascades[i].update(camera.m_view, camera.fov, camera.aspect, near, end,
+                                     shadowLightDirection, SHADOW_MAP_SIZE, padding)) {
+            staticShadowDirty[i] = true;
+        }
+        if (worldManager->chunksChanged(Frustum(shadowCascades[i].getViewProjection()))) {
+            staticShadowDirty[i] = true;
+        }
+        near = end;
+    }
+    worldManager->clearChangedChunks();
 }
 
 LightSource Game::getSunLight() {
@@ -158,12 +244,27 @@ void Game::uploadCommonSceneUniforms() {
 
 }
 
+// Shadow lookups start from eye space, so they depend on the view of the pass
+void Game::uploadShadowUniforms(glm::mat4& view) {
+    glm::mat4 inverseView = glm::inverse(view);
+    glm::mat4 cascadeFromView[SHADOW_CASCADES];
+    float cascadeEnds[SHADOW_CASCADES];
+    for (int i = 0; i < SHADOW_CASCADES; i++) {
+        glm::mat4 VP = shadowCascades[i].getViewProjection();
+        cascadeFromView[i] = getBiasMatrix(VP) * inverseView;
+        cascadeEnds[i] = shadowCascades[i].getFar();
+    }
+    glUniformMatrix4fv(cube_shader->cascadeFromView_uni, SHADOW_CASCADES, GL_FALSE, value_ptr(cascadeFromView[0]));
+    glUniform1fv(cube_shader->cascadeEnds_uni, SHADOW_CASCADES, cascadeEnds);
+}
+
 //----------------------------------------------------------------------------------------
 /*
- * Called once per frame, before guiLogic().
+ * Advances the game world by one fixed simulation step.
  */
-void Game::appLogic()
+void Game::tick()
 {
+    PROFILE_ZONE("tick");
     if (enablePlayerParticle) {
         for (int i = 0; i < 5; i++) {
             float randx = ((float)rand() / RAND_MAX) * 2 - 1;
@@ -181,18 +282,93 @@ void Game::appLogic()
     moveFactor.x = fmod(moveFactor.x, 1.0);
     moveFactor.y = fmod(moveFactor.y, 1.0);
 
-
-    player.updatePosition(worldManager, &audio);
-	// Place per frame, application logic here ...
-    timeOfDay = wrap(timeOfDay + 1.0/60, 0, 1440);
+    {
+        PROFILE_ZONE("player");
+        player.updatePosition(worldManager, &audio);
+    }
+    {
+        PROFILE_ZONE("enemies");
+        for (Enemy* enemy : enemies) {
+            enemy->updatePosition(worldManager);
+        }
+    }
+    timeOfDay = wrap(timeOfDay + simulationClock.getTickSeconds(), 0, 1440);
 
     worldManager->update(player.position);
 
+    {
+        PROFILE_ZONE("particles");
+        particle_system->updateParticles(camera.position, simulationClock.getTickSeconds());
+    }
+}
+
+// Spawns or removes enemies until there are numEnemies of them
+void Game::updateEnemies() {
+    while ((int)enemies.size() > numEnemies) {
+        delete enemies.back();
+        enemies.pop_back();
+    }
+    while ((int)enemies.size() < numEnemies) {
+        float angle = ((float)rand() / RAND_MAX) * 2 * PI;
+        float distance = ((float)rand() / RAND_MAX) * ENEMY_SPAWN_RADIUS;
+        float turnRate = ((float)rand() / RAND_MAX) * 2 - 1;
+        vec3 home = vec3(player.position.x + cos(angle) * distance, 20, player.position.z + sin(angle) * distance);
+
+        Enemy* enemy = new Enemy(home, angle, turnRate);
+        enemy->loadModel();
+        enemies.push_back(enemy);
+    }
+
+    // Removed enemies leave holes, so the instances are added again
+    animations.clear();
+    player.animation = animations.add(player.playerModel->getRoot());
+    for (Enemy* enemy : enemies) {
+        enemy->animation = animations.add(enemy->model->getRoot());
+    }
+}
+
+// Every character walks, the player's smash plays over its walk
+void Game::animateCharacters() {
+    PROFILE_ZONE("animation");
+    if (walkClip < 0 || smashClip < 0) {
+        return;
+    }
+
+    animations.play(player.animation, 0, walkClip, player.walkingTime, 1);
+    animations.play(player.animation, 1, smashClip, player.smashTime, player.smashTime > 0 ? 1 : 0);
+    for (Enemy* enemy : enemies) {
+        animations.play(enemy->animation, 0, walkClip, enemy->walkingTime, 1);
+    }
+    animations.evaluate();
+    animations.apply();
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Called once per frame, before guiLogic().
+ */
+void Game::appLogic()
+{
+    Profiler::beginFrame();
+    PROFILE_ZONE("appLogic");
+
+    double now = glfwGetTime();
+    int ticks = simulationClock.advance(now - lastFrameTime);
+    lastFrameTime = now;
+
+    for (int i = 0; i < ticks; i++) {
+        tick();
+    }
+
+    // Render state sits between the last two ticks
+    animateCharacters();
+    player.interpolate(simulationClock.getAlpha());
+    for (Enemy* enemy : enemies) {
+        enemy->interpolate(simulationClock.getAlpha());
+    }
     m_light = getSunLight();
 
     updateViewMatrix();
-
-    particle_system->updateParticles(camera.position);
 }
 
 //----------------------------------------------------------------------------------------
@@ -227,17 +403,53 @@ void Game::guiLogic()
         }
 
         ImGui::Checkbox("First Person", &camera.first_person);
+        ImGui::Checkbox("Render", &renderEnabled);
+        ImGui::Checkbox("Profiler", &show_profiler);
+        if (ImGui::Checkbox("VSync", &vsync)) {
+            glfwSwapInterval(vsync ? 1 : 0);
+        }
+        ImGui::SliderFloat("Reflection Scale", &reflectionScale, 0.25f, 1.0f, "%.2f");
+        if (ImGui::SliderInt("Enemies", &numEnemies, 0, MAX_ENEMIES)) {
+            updateEnemies();
+        }
+        // The cache is stale after running without it
+        if (ImGui::Checkbox("Cache Shadows", &shadowCaching)) {
+            for (int i = 0; i < SHADOW_CASCADES; i++) {
+                staticShadowDirty[i] = true;
+            }
+        }
         ImGui::Checkbox("Enable Particles", &enablePlayerParticle);
+        // Live particles are not carried over when switching
+        if (ImGui::Checkbox("GPU Particles", &gpuParticles)) {
+            delete particle_system;
+            if (gpuParticles) {
+                particle_system = new GpuParticles();
+            } else {
+                particle_system = new Particles();
+            }
+            particle_system->setCollision(worldManager, (ParticleCollision)particleCollision);
+            particle_system->setSorting(sortParticles);
+        }
+        if (ImGui::Combo("Particle Collision", &particleCollision, "None\0Bounce\0Stop\0Kill\0\0")) {
+            particle_system->setCollision(worldManager, (ParticleCollision)particleCollision);
+        }
+        if (ImGui::Checkbox("Sort Particles", &sortParticles)) {
+            particle_system->setSorting(sortParticles);
+        }
 
         if (ImGui::Checkbox("msaa", &msaa)) {
             if (msaa) {
-                glEnable(GL_MULTISAMPLE);
+                GLState::enable(GL_MULTISAMPLE);
             } else {
-                glDisable(GL_MULTISAMPLE);
+                GLState::disable(GL_MULTISAMPLE);
             }
         }
 
 		ImGui::Text( "Framerate: %.1f FPS", ImGui::GetIO().Framerate );
+		ImGui::Text( "Simulation ticks: %lu", simulationClock.getTickCount() );
+		ImGui::Text( "Render targets: %d, %.1f MB", renderTargets.getCount(),
+		             renderTargets.getMemoryUsage() / (1024.0f * 1024.0f) );
+		ImGui::Text( "Models: %d instances, %d draws", models.getNumInstances(), models.getNumDraws() );
 
 
 		ImGui::Text( "Position %f %f %f", player.position.x, player.position.y, player.position.z);
@@ -245,6 +457,13 @@ void Game::guiLogic()
 		ImGui::Text( "Solid Block 2 %d", worldManager->solidBlock(player.position));
 
 	ImGui::End();
+
+    if (show_profiler) {
+        Profiler::drawWindow(&show_profiler);
+        GpuProfiler::drawWindow(&show_profiler);
+        AssetLoader::drawTimeline(&show_profiler);
+        GLState::drawWindow(&show_profiler);
+    }
 }
 
 //----------------------------------------------------------------------------------------
@@ -252,60 +471,165 @@ void Game::guiLogic()
  * Called once per frame, after guiLogic().
  */
 void Game::draw() {
-    glm::mat4 VP = m_shadow_perspective * m_shadow_view;
-
-    shadowFrameBuffer->bind();
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    PROFILE_ZONE("draw");
+    GpuProfiler::beginFrame();
+    // ImGui changes bindings after every frame
+    GLState::invalidate();
+    GLState::beginFrame();
+    if (!renderEnabled) {
+        return;
+    }
 
-    shadow_shader->enable();
-        glEnable( GL_DEPTH_TEST );
-        glDisable( GL_CULL_FACE );
-        worldManager->renderShadow(VP);
-        player.renderShadow(VP);
+    {
+        PROFILE_ZONE("particle upload");
+        particle_system->updateBuffer();
+    }
 
-    shadow_shader->disable();
-    shadowFrameBuffer->unbind();
+    {
+        PROFILE_ZONE("model upload");
+        models.begin();
+        if (player.playerModel != NULL) {
+            models.add(player.playerModel, player.getModelMatrix());
+        }
+        for (Enemy* enemy : enemies) {
+            models.add(enemy->model, enemy->getModelMatrix());
+        }
+        models.upload();
+    }
 
-    // Render world
-    glm::mat4 biasDepthVP = getBiasMatrix(VP);
+    {
+        PROFILE_ZONE("shadow pass");
+        GPU_ZONE("shadow pass");
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+
+        shadow_shader->enable();
+            GLState::enable( GL_DEPTH_TEST );
+            GLState::disable( GL_CULL_FACE );
+
+            // Terrain goes into the cache only for cascades that went stale,
+            // then the whole cache is copied under the dynamic casters
+            if (shadowCaching) {
+                staticShadowFrameBuffer->bind();
+                GLState::enable( GL_SCISSOR_TEST );
+                for (int i = 0; i < SHADOW_CASCADES; i++) {
+                    if (!staticShadowDirty[i]) {
+                        continue;
+                    }
+                    PROFILE_ZONE("static shadow cascade");
+                    glViewport(i * SHADOW_MAP_SIZE, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+                    glScissor(i * SHADOW_MAP_SIZE, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+                    glClear(GL_DEPTH_BUFFER_BIT);
+                    glm::mat4 VP = shadowCascades[i].getViewProjection();
+                    worldManager->renderShadow(VP);
+                    staticShadowDirty[i] = false;
+                }
+                GLState::disable( GL_SCISSOR_TEST );
+                staticShadowFrameBuffer->copyDepthTo(shadowFrameBuffer);
+                shadowFrameBuffer->bind();
+            } else {
+                shadowFrameBuffer->bind();
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            }
 
-    Camera waterCamera = camera;
-    float distanceToWater = 2 * (camera.position.y - WATER_LEVEL);
-    waterCamera.position.y -= distanceToWater;
-    waterCamera.facing.y = -waterCamera.facing.y;
-    waterCamera.generateViewMatrix();
+            for (int i = 0; i < SHADOW_CASCADES; i++) {
+                glViewport(i * SHADOW_MAP_SIZE, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+                glm::mat4 VP = shadowCascades[i].getViewProjection();
+                if (!shadowCaching) {
+                    worldManager->renderShadow(VP);
+                }
+                models.render(VP, true);
+            }
 
-    waterFrameBuffer->bind();
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    cube_shader->enable();
-        glEnable( GL_DEPTH_TEST );
-        glEnable( GL_CULL_FACE );
-        glEnable(GL_CLIP_DISTANCE0);
-        uploadCommonSceneUniforms();
-        //glCullFace( GL_FRONT );
-        worldManager->render(waterCamera.m_view, biasDepthVP);
-        player.render(waterCamera.m_view);
-    cube_shader->disable();
-    waterFrameBuffer->unbind();
+        shadow_shader->disable();
+        shadowFrameBuffer->unbind();
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
 
-    // Draw the actual
-    cube_shader->enable();
-        glEnable( GL_DEPTH_TEST );
-        glEnable( GL_CULL_FACE );
-        glDisable(GL_CLIP_DISTANCE0);
-        //glCullFace( GL_FRONT );
-        worldManager->render(camera.m_view, biasDepthVP);
-        player.render(camera.m_view);
-    cube_shader->disable();
- 
+    // Render world
 
+    // The reflection is only sampled by water, without any in view the last
+    // one is left as is
+    glm::mat4 VP = camera.m_perspective * camera.m_view;
+    if (worldManager->waterVisible(VP)) {
+        PROFILE_ZONE("reflection pass");
+        GPU_ZONE("reflection pass");
+        Camera waterCamera = camera;
+        float distanceToWater = 2 * (camera.position.y - WATER_LEVEL);
+        waterCamera.position.y -= distanceToWater;
+        waterCamera.facing.y = -waterCamera.facing.y;
+        waterCamera.generateViewMatrix();
+        glm::mat4 waterVP = waterCamera.m_perspective * waterCamera.m_view;
+
+        // The water shader samples the reflection in screen space, so it
+        // follows the framebuffer at any scale
+        int width = glm::max(1, (int)(m_framebufferWidth * reflectionScale));
+        int height = glm::max(1, (int)(m_framebufferHeight * reflectionScale));
+        waterFrameBuffer = renderTargets.acquire(width, height, "color");
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+
+        waterFrameBuffer->bind();
+        glViewport(0, 0, width, height);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        cube_shader->enable();
+            GLState::enable( GL_DEPTH_TEST );
+            GLState::enable( GL_CULL_FACE );
+            GLState::enable(GL_CLIP_DISTANCE0);
+            uploadCommonSceneUniforms();
+            uploadShadowUniforms(waterCamera.m_view);
+            //glCullFace( GL_FRONT );
+            worldManager->renderReflection(waterCamera.m_view, waterVP);
+            models.render(waterCamera.m_view, false);
+        cube_shader->disable();
+        waterFrameBuffer->unbind();
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    } else {
+        // The main pass still needs the common uniforms
+        cube_shader->enable();
+            uploadCommonSceneUniforms();
+        cube_shader->disable();
+    }
 
+    // Draw the actual
+    {
+        PROFILE_ZONE("main pass");
+        GPU_ZONE("main pass");
+        cube_shader->enable();
+            GLState::enable( GL_DEPTH_TEST );
+            GLState::enable( GL_CULL_FACE );
+            GLState::disable(GL_CLIP_DISTANCE0);
+            uploadShadowUniforms(camera.m_view);
+            if (waterFrameBuffer != NULL) {
+                waterFrameBuffer->texture->bind(cube_shader->texWater_uni);
+            }
+            //glCullFace( GL_FRONT );
+            worldManager->render(camera.m_view);
+            models.render(camera.m_view, false);
+        cube_shader->disable();
+
+        if (waterFrameBuffer != NULL) {
+            renderTargets.release(waterFrameBuffer);
+            waterFrameBuffer = NULL;
+        }
+    }
 
+    {
+        PROFILE_ZONE("particle pass");
+        GPU_ZONE("particle pass");
+        // Sorted back to front by the CPU backend so blending is in order
+        GLState::enable( GL_BLEND );
+        glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+        particle_shader->enable();
+            GLState::enable( GL_DEPTH_TEST );
+            particle_system->render(camera.m_perspective * camera.m_view);
+        particle_shader->disable();
+        GLState::disable( GL_BLEND );
+    }
 
-    particle_shader->enable();
-        glEnable( GL_DEPTH_TEST );
-        particle_system->render(camera.m_perspective * camera.m_view);
-    particle_shader->disable();
+    models.fence();
+    renderTargets.endFrame();
 
 	CHECK_GL_ERRORS;
 }
@@ -317,7 +641,7 @@ void Game::draw() {
  */
 void Game::cleanup()
 {
-
+    GpuProfiler::shutdown();
 }
 
 //----------------------------------------------------------------------------------------
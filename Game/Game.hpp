@@ -5,10 +5,14 @@
 #include "cs488-framework/ShaderProgram.hpp"
 #include "cs488-framework/MeshConsolidator.hpp"
 
+#include "Animation.hpp"
 #include "Chunk.hpp"
 #include "ChunkManager.hpp"
 #include "GLUtils.hpp"
+#include "ModelBatch.hpp"
 #include "Objects.hpp"
+#include "RenderTargetPool.hpp"
+#include "SimulationClock.hpp"
 #include "Utils.hpp"
 
 #include <glm/glm.hpp>
@@ -18,6 +22,21 @@
 
 #define NUM_JOINT 32
 
+// Cascades sit side by side in one depth texture, see FragmentShader.fs
+#define SHADOW_CASCADES 3
+#define SHADOW_MAP_SIZE 1024
+// Blend between uniform and logarithmic cascade splits
+#define SHADOW_SPLIT_LAMBDA 0.5f
+// Cached terrain shadows are redrawn once the sun has moved this many degrees
+#define SHADOW_CACHE_ANGLE 1.0f
+// Cached cascades are grown by this fraction so the camera can move inside them
+#define SHADOW_CACHE_PADDING 0.25f
+// Size of the water reflection relative to the framebuffer
+#define REFLECTION_SCALE 0.5f
+// Upper end of the enemies slider, spawned this far around the player
+#define MAX_ENEMIES 500
+#define ENEMY_SPAWN_RADIUS 20.0f
+
 struct LightSource {
 	glm::vec3 position;
 	glm::vec3 rgbIntensity;
@@ -46,14 +65,20 @@ protected:
 
 	//-- One time initialization methods:
     void initShader();
+    void loadAssets();
     void initGameWorld();
 	void initCamera();
     void initTexture();
     void initLightSources();
 
     // -- Update methods
+    void tick();
+    void updateEnemies();
+    void animateCharacters();
     void updateViewMatrix();
+    void updateShadowCascades();
     void uploadCommonSceneUniforms();
+    void uploadShadowUniforms(glm::mat4& view);
     LightSource getSunLight();
 
     // -- Open GL variables
@@ -61,16 +86,30 @@ protected:
     ShadowShader* shadow_shader;
     ParticleShader* particle_shader;
 
+    // Every offscreen target comes from the pool, the shadow ones are held
+    // for the whole run and the water one only from reflection to main pass
+    RenderTargetPool renderTargets;
     FrameBuffer* shadowFrameBuffer;
+    FrameBuffer* staticShadowFrameBuffer;
     FrameBuffer* waterFrameBuffer;
 
     // -- Render variables
-    glm::mat4 m_shadow_perspective;
-    glm::mat4 m_shadow_view;
+    ShadowBox shadowCascades[SHADOW_CASCADES];
+    // Terrain only shadows live in staticShadowFrameBuffer and are copied
+    // under the dynamic casters every frame
+    bool shadowCaching;
+    bool staticShadowDirty[SHADOW_CASCADES];
+    glm::vec3 shadowLightDirection;
+    float reflectionScale;
+    // Every character of the frame, drawn instanced in each pass
+    ModelBatch models;
 
 	LightSource m_light;
-    Particles* particle_system;
+    ParticleSystem* particle_system;
     bool enablePlayerParticle;
+    bool gpuParticles;
+    int particleCollision; // ParticleCollision
+    bool sortParticles;
 
     glm::vec2 moveFactor;
 
@@ -81,14 +120,22 @@ protected:
     ChunkManager* worldManager;
     Texture* cubeTexture;
     Texture* dudvTexture;
-    Texture* shadowTexture;
-    Texture* waterTexture;
 
     // Game logic variables
     float timeOfDay;
+    SimulationClock simulationClock;
+    double lastFrameTime;
+    bool renderEnabled;
+    bool vsync;
 
     // Control Variables
     Player player;
+    std::vector<Enemy*> enemies;
+    int numEnemies;
+    // Poses the player and every enemy, clips from puppet_anim.lua
+    AnimationBatch animations;
+    std::vector<AnimationClip*> animationClips;
+    int walkClip, smashClip;
     Camera camera;
 
     Audio audio;
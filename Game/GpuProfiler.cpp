@@ -0,0 +1,231 @@
+#include "GpuProfiler.hpp"
+#include "Profiler.hpp"
+
+#include <imgui/imgui.h>
+
+#include <cstdio>
+#include <map>
+
+struct GpuFrame {
+    GLuint queries[GPU_PROFILER_MAX_ZONES];
+    const char* names[GPU_PROFILER_MAX_ZONES];
+    int count;
+    bool pending;
+    bool warmup;
+    uint64_t frame;
+};
+
+struct GpuZoneHistory {
+    float ms[GPU_PROFILER_HISTORY];
+    int count;
+    int head;
+    float last;
+};
+
+static GpuFrame frames[GPU_PROFILER_LATENCY];
+static GpuFrame* current = NULL;
+static bool initialized = false;
+static bool supported = false;
+static bool zoneOpen = false;
+static bool recording = false;
+static uint64_t frameCount = 0;
+static uint64_t droppedFrames = 0;
+
+static std::map<std::string, GpuZoneHistory> history;
+static float frameTotals[GPU_PROFILER_HISTORY];
+static int frameTotalsCount = 0;
+static int frameTotalsHead = 0;
+
+static FILE* logFile = NULL;
+
+void GpuProfiler::init() {
+    if (initialized) {
+        return;
+    }
+
+    // Timer queries are core since 3.3, but a driver may still report no
+    // counter bits for them
+    GLint bits = 0;
+    glGetQueryiv(GL_TIME_ELAPSED, GL_QUERY_COUNTER_BITS, &bits);
+    supported = bits > 0;
+
+    if (supported) {
+        for (int i = 0; i < GPU_PROFILER_LATENCY; i++) {
+            glGenQueries(GPU_PROFILER_MAX_ZONES, frames[i].queries);
+            frames[i].count = 0;
+            frames[i].pending = false;
+        }
+    }
+    recording = false;
+    initialized = true;
+}
+
+void GpuProfiler::shutdown() {
+    if (!initialized) {
+        return;
+    }
+    if (supported) {
+        for (int i = 0; i < GPU_PROFILER_LATENCY; i++) {
+            glDeleteQueries(GPU_PROFILER_MAX_ZONES, frames[i].queries);
+        }
+    }
+    closeLog();
+    current = NULL;
+    initialized = false;
+}
+
+static void pushSample(float* samples, int& count, int& head, float value) {
+    samples[head] = value;
+    head = (head + 1) % GPU_PROFILER_HISTORY;
+    count = count < GPU_PROFILER_HISTORY ? count + 1 : count;
+}
+
+static void resolve(GpuFrame& frame) {
+    frame.pending = false;
+    if (frame.warmup) {
+        return;
+    }
+
+    float total = 0;
+    for (int i = 0; i < frame.count; i++) {
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &ns);
+        float ms = ns / 1e6f;
+        total += ms;
+
+        GpuZoneHistory& zone = history[frame.names[i]];
+        pushSample(zone.ms, zone.count, zone.head, ms);
+        zone.last = ms;
+
+        if (logFile != NULL) {
+            fprintf(logFile, "%llu,%s,%.4f\n", (unsigned long long)frame.frame, frame.names[i], ms);
+        }
+    }
+    pushSample(frameTotals, frameTotalsCount, frameTotalsHead, total);
+}
+
+void GpuProfiler::beginFrame() {
+    if (!supported) {
+        return;
+    }
+    if (zoneOpen) {
+        end();
+    }
+
+    // Frames finish in submission order, so stop at the first one whose last
+    // query is not ready yet
+    for (uint64_t i = 0; i < GPU_PROFILER_LATENCY; i++) {
+        GpuFrame& frame = frames[(frameCount + i) % GPU_PROFILER_LATENCY];
+        if (!frame.pending) {
+            continue;
+        }
+        if (frame.count > 0) {
+            GLuint available = 0;
+            glGetQueryObjectuiv(frame.queries[frame.count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                break;
+            }
+        }
+        resolve(frame);
+    }
+
+    GpuFrame& next = frames[frameCount % GPU_PROFILER_LATENCY];
+    if (next.pending || !Profiler::isEnabled()) {
+        droppedFrames += next.pending ? 1 : 0;
+        current = NULL;
+    } else {
+        // llvmpipe reports a bogus interval of seconds for the first queries
+        // of a context, so the first frame of a recording is not kept
+        next.count = 0;
+        next.frame = frameCount;
+        next.pending = true;
+        next.warmup = !recording;
+        current = &next;
+    }
+    recording = Profiler::isEnabled();
+    frameCount++;
+}
+
+bool GpuProfiler::begin(const char* name) {
+    if (current == NULL || zoneOpen || current->count == GPU_PROFILER_MAX_ZONES) {
+        return false;
+    }
+    current->names[current->count] = name;
+    glBeginQuery(GL_TIME_ELAPSED, current->queries[current->count]);
+    zoneOpen = true;
+    return true;
+}
+
+void GpuProfiler::end() {
+    if (!zoneOpen) {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    current->count++;
+    zoneOpen = false;
+}
+
+bool GpuProfiler::openLog(const std::string& path) {
+    closeLog();
+    logFile = fopen(path.c_str(), "w");
+    if (logFile == NULL) {
+        return false;
+    }
+    fprintf(logFile, "frame,zone,gpu_ms\n");
+    return true;
+}
+
+void GpuProfiler::closeLog() {
+    if (logFile != NULL) {
+        fclose(logFile);
+        logFile = NULL;
+    }
+}
+
+static float average(const float* samples, int count) {
+    float sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += samples[i];
+    }
+    return count > 0 ? sum / count : 0;
+}
+
+void GpuProfiler::drawWindow(bool* open) {
+    static bool logging = false;
+    static float plot[GPU_PROFILER_HISTORY];
+
+    // Same title as the CPU profiler so both end up in one window
+    ImGui::Begin("Profiler", open, ImVec2(600, 400));
+
+    if (ImGui::CollapsingHeader("GPU passes", NULL, true, true)) {
+        if (!supported) {
+            ImGui::Text("Timer queries are not supported by this driver");
+            ImGui::End();
+            return;
+        }
+
+        if (ImGui::Checkbox("Log gpu_profile.csv", &logging)) {
+            if (logging) {
+                logging = openLog("gpu_profile.csv");
+            } else {
+                closeLog();
+            }
+        }
+        ImGui::SameLine();
+        ImGui::Text("%llu frames skipped", (unsigned long long)droppedFrames);
+
+        // Oldest first
+        for (int i = 0; i < frameTotalsCount; i++) {
+            int index = (frameTotalsHead - frameTotalsCount + i + GPU_PROFILER_HISTORY) % GPU_PROFILER_HISTORY;
+            plot[i] = frameTotals[index];
+        }
+        ImGui::PlotHistogram("GPU ms", plot, frameTotalsCount, 0, NULL, 0.0f, 16.6f, ImVec2(0, 60));
+
+        for (const auto& zone : history) {
+            ImGui::Text("%8.3f ms  (avg %8.3f)  %s", zone.second.last,
+                average(zone.second.ms, zone.second.count), zone.first.c_str());
+        }
+    }
+
+    ImGui::End();
+}
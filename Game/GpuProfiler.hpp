@@ -0,0 +1,67 @@
+#pragma once
+
+#include "cs488-framework/OpenGLImport.hpp"
+#include "Profiler.hpp"
+
+#include <string>
+
+/*
+ * GPU pass timing with GL_TIME_ELAPSED queries.
+ *
+ * Each frame's queries go into one slot of a ring that is GPU_PROFILER_LATENCY
+ * frames deep. Results are only read once GL reports them available, so
+ * timing never stalls the pipeline; if the GPU falls further behind than the
+ * ring, that frame is simply not measured, nor is the first frame after the
+ * profiler is enabled. Time elapsed queries cannot nest, a zone opened inside
+ * another is ignored.
+ *
+ *     {
+ *         PROFILE_ZONE("shadow pass");
+ *         GPU_ZONE("shadow pass");
+ *         ...
+ *     }
+ */
+
+#define GPU_PROFILER_LATENCY 4
+#define GPU_PROFILER_MAX_ZONES 16
+#define GPU_PROFILER_HISTORY 120
+
+class GpuProfiler {
+public:
+    // Needs a current GL context
+    static void init();
+    static void shutdown();
+
+    // Collects finished frames and starts a new one, called once per frame
+    static void beginFrame();
+
+    static bool begin(const char* name);
+    static void end();
+
+    // Adds a GPU section to the profiler window
+    static void drawWindow(bool* open);
+
+    // Appends "frame,zone,gpu_ms" rows for every resolved zone
+    static bool openLog(const std::string& path);
+    static void closeLog();
+};
+
+class GpuZone {
+public:
+    GpuZone(const char* name) : started(GpuProfiler::begin(name)) {}
+
+    ~GpuZone() {
+        if (started) {
+            GpuProfiler::end();
+        }
+    }
+
+private:
+    bool started;
+};
+
+#ifdef DISABLE_PROFILER
+#define GPU_ZONE(name)
+#else
+#define GPU_ZONE(name) GpuZone PROFILE_CONCAT(gpuZone, __LINE__)(name)
+#endif
@@ -0,0 +1,172 @@
+/*
+ * Headless simulation runner.
+ *
+ * Drives world generation, chunk streaming, meshing, collision and particles
+ * along a scripted player path without creating a window or GL context, then
+ * reports per subsystem timings and memory use. Run from the Game directory:
+ *
+ *     $ ./HeadlessRunner [ticks] [walk speed] [trace.json]
+ *
+ * When a trace file is given, profiler zones are recorded for every tick and
+ * written out as a Chrome trace (chrome://tracing).
+ */
+
+#include "ChunkManager.hpp"
+#include "Objects.hpp"
+#include "ParticlePool.hpp"
+#include "Profiler.hpp"
+#include "SimulationClock.hpp"
+#include "Utils.hpp"
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+struct SubsystemTimer {
+    const char* name;
+    double total;
+    double worst;
+    unsigned long calls;
+
+    SubsystemTimer(const char* name) : name(name), total(0), worst(0), calls(0) {}
+
+    void add(double ms) {
+        total += ms;
+        worst = ms > worst ? ms : worst;
+        calls++;
+    }
+
+    void print() const {
+        printf("%-12s %10.2f ms total %8.3f ms avg %8.3f ms worst\n",
+            name, total, calls ? total / calls : 0.0, worst);
+    }
+};
+
+typedef chrono::steady_clock Clock;
+
+static double elapsedMs(Clock::time_point start) {
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+static long peakResidentKb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+// Both fail unless the whole argument is a number above 0
+static bool parseTicks(const char* arg, int& ticks) {
+    char* end;
+    long value = strtol(arg, &end, 10);
+    ticks = (int)value;
+    return end != arg && *end == '\0' && value > 0 && value <= INT_MAX;
+}
+
+static bool parseSpeed(const char* arg, float& speed) {
+    char* end;
+    speed = strtof(arg, &end);
+    return end != arg && *end == '\0' && speed > 0;
+}
+
+int main(int argc, char** argv) {
+    int ticks = 3600;
+    float speed = 0.25f;
+    const char* tracePath = argc > 3 ? argv[3] : NULL;
+    if (argc > 4 || (argc > 1 && !parseTicks(argv[1], ticks)) || (argc > 2 && !parseSpeed(argv[2], speed))) {
+        fprintf(stderr, "Usage: %s [ticks] [walk speed] [trace.json]\n", argv[0]);
+        return 1;
+    }
+
+    Profiler::setThreadName("main");
+    Profiler::setEnabled(tracePath != NULL);
+
+    srand(0);
+
+    SubsystemTimer terrain("terrain");
+    SubsystemTimer meshing("meshing");
+    SubsystemTimer collision("collision");
+    SubsystemTimer particles("particles");
+
+    Clock::time_point runStart = Clock::now();
+
+    ChunkManager* world = new ChunkManager();
+    ParticlePool* pool = new ParticlePool();
+    pool->setCollision(world, ParticleCollision::BOUNCE);
+    Audio audio;
+    Player player;
+
+    unsigned long chunksMeshed = 0;
+    bool blocked = false;
+    for (int tick = 0; tick < ticks; tick++) {
+        Profiler::beginFrame();
+        PROFILE_ZONE("tick");
+
+        // Scripted path: walk forward while slowly turning, jump when blocked
+        player.updateRotation(0.001f);
+        player.updateDelta(player.facing * speed);
+        if (blocked && player.fallingTime == 0) {
+            player.updateDelta(glm::vec3(0, 0.3, 0));
+        }
+        glm::vec3 positionBefore = player.position;
+
+        Clock::time_point start = Clock::now();
+        world->update(player.position);
+        terrain.add(elapsedMs(start));
+
+        start = Clock::now();
+        chunksMeshed += world->updateMeshes();
+        meshing.add(elapsedMs(start));
+
+        start = Clock::now();
+        player.updatePosition(world, &audio);
+        collision.add(elapsedMs(start));
+
+        glm::vec2 moved = glm::vec2(player.position.x - positionBefore.x, player.position.z - positionBefore.z);
+        blocked = glm::length(moved) < speed * 0.5f;
+
+        start = Clock::now();
+        for (int i = 0; i < 5; i++) {
+            float randx = ((float)rand() / RAND_MAX) * 2 - 1;
+            float randz = ((float)rand() / RAND_MAX) * 2 - 1;
+            pool->addParticle(player.position, glm::vec3(randx, 4, randz), glm::vec4(1), 0.25f);
+        }
+        pool->update(player.position, SIMULATION_TICK_SECONDS);
+        particles.add(elapsedMs(start));
+    }
+
+    double runMs = elapsedMs(runStart);
+
+    printf("ticks        %d (%.1f s simulated)\n", ticks, ticks * SIMULATION_TICK_SECONDS);
+    printf("wall time    %.2f ms, %.0f ticks/s\n", runMs, ticks / (runMs / 1000.0));
+    printf("player       %.2f %.2f %.2f\n", player.position.x, player.position.y, player.position.z);
+    printf("\n");
+    terrain.print();
+    meshing.print();
+    collision.print();
+    particles.print();
+    printf("\n");
+
+    unsigned long vertices = world->getNumVertices();
+    int chunks = world->getNumChunks();
+    printf("chunks       %d loaded, %lu meshed\n", chunks, chunksMeshed);
+    printf("blocks       %.2f MB\n", chunks * sizeof(BlockType) * CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE / (1024.0 * 1024.0));
+    printf("vertices     %lu (%.2f MB)\n", vertices, vertices * 7 * sizeof(float) / (1024.0 * 1024.0));
+    printf("peak rss     %.2f MB\n", peakResidentKb() / 1024.0);
+
+    if (tracePath != NULL && !Profiler::exportChromeTrace(tracePath)) {
+        fprintf(stderr, "Cannot write %s\n", tracePath);
+    }
+
+    delete pool;
+    delete world;
+    return 0;
+}
@@ -24,6 +24,7 @@ void JointNode::set_joint_x(double min, double init, double max) {
 	m_joint_x.init = init;
 	m_joint_x.max = max;
 	m_joint_x.curr = init;
+	dirty = true;
 
     if (max - min == 0) {
         hasEmptyJoint = true;
@@ -36,6 +37,7 @@ void JointNode::set_joint_y(double min, double init, double max) {
 	m_joint_y.init = init;
 	m_joint_y.max = max;
 	m_joint_y.curr = init;
+	dirty = true;
 
     if (max - min == 0) {
         hasEmptyJoint = true;
@@ -52,17 +54,28 @@ static double clamp(JointNode::JointRange range, double val) {
 }
 
 void JointNode::set_x_rotate(double delta) {
-    m_joint_x.curr = clamp(m_joint_x, delta);
+    double curr = clamp(m_joint_x, delta);
+    dirty = dirty || curr != m_joint_x.curr;
+    m_joint_x.curr = curr;
+}
+
+void JointNode::set_y_rotate(double delta) {
+    double curr = clamp(m_joint_y, delta);
+    dirty = dirty || curr != m_joint_y.curr;
+    m_joint_y.curr = curr;
 }
 
 void JointNode::rotate_joint(JointRange& range, double delta) {
-    range.curr = clamp(range, delta + range.curr);
+    double curr = clamp(range, delta + range.curr);
+    dirty = dirty || curr != range.curr;
+    range.curr = curr;
 }
 
 void JointNode::reset_joint() {
     m_joint_x.curr = m_joint_x.init;
     m_joint_y.curr = m_joint_y.init;
     isSelected = false;
+    dirty = true;
 }
 
 glm::mat4 JointNode::get_x_rotate() const {
@@ -18,6 +18,7 @@ public:
     void reset_joint();
 
     void set_x_rotate(double delta);
+    void set_y_rotate(double delta);
 
     glm::mat4 get_x_rotate() const;
     glm::mat4 get_y_rotate() const;
@@ -0,0 +1,113 @@
+#include "ModelBatch.hpp"
+
+#include "cs488-framework/GlErrorCheck.hpp"
+
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+ModelBatch::ModelBatch() : instanceOffset(0), numInstances(0), numDraws(0) {
+    instanceBuffer = new StreamBuffer(GL_ARRAY_BUFFER, MAX_MODEL_INSTANCES * sizeof(ModelInstance));
+    handles.reserve(MAX_MODEL_INSTANCES);
+    transforms.reserve(MAX_MODEL_INSTANCES);
+}
+
+ModelBatch::~ModelBatch() {
+    delete instanceBuffer;
+}
+
+void ModelBatch::begin() {
+    handles.clear();
+    transforms.clear();
+}
+
+void ModelBatch::add(const MeshModel* model, const glm::mat4& world) {
+    const FlatScene& scene = model->getScene();
+    const std::vector<int>& geometry = scene.getGeometry();
+    const std::vector<int>& meshHandles = model->getMeshHandles();
+
+    for (size_t i = 0; i < geometry.size(); i++) {
+        if (meshHandles[i] < 0 || handles.size() == MAX_MODEL_INSTANCES) {
+            continue;
+        }
+        handles.push_back(meshHandles[i]);
+        transforms.push_back(world * scene.getTransform(geometry[i]));
+    }
+}
+
+// Counting sort by mesh, written straight into the mapped region
+void ModelBatch::upload() {
+    int maxHandle = -1;
+    for (int handle : handles) {
+        maxHandle = glm::max(maxHandle, handle);
+    }
+    counts.assign(maxHandle + 1, 0);
+    starts.assign(maxHandle + 1, 0);
+    for (int handle : handles) {
+        counts[handle]++;
+    }
+    for (int i = 1; i <= maxHandle; i++) {
+        starts[i] = starts[i - 1] + counts[i - 1];
+    }
+
+    ModelInstance* data = (ModelInstance*)instanceBuffer->map();
+    if (data == NULL) {
+        numInstances = 0;
+        return;
+    }
+    numInstances = handles.size();
+    std::vector<int> next = starts;
+    for (int i = 0; i < numInstances; i++) {
+        ModelInstance& instance = data[next[handles[i]]++];
+        instance.model = transforms[i];
+        instance.normalMatrix = glm::inverseTranspose(glm::mat3(transforms[i]));
+    }
+    instanceOffset = instanceBuffer->unmap(numInstances * sizeof(ModelInstance));
+}
+
+void ModelBatch::render(const glm::mat4& view, bool shadow) {
+    numDraws = 0;
+    if (numInstances == 0) {
+        return;
+    }
+
+    Mesh* mesh = Mesh::getMeshRender();
+    if (shadow) {
+        glUniformMatrix4fv(ShadowShader::getShader()->MVP_uni, 1, GL_FALSE, glm::value_ptr(view));
+    } else {
+        CubeShader* cube_shader = CubeShader::getShader();
+        glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(view)));
+        glUniformMatrix4fv(cube_shader->VM_uni, 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix3fv(cube_shader->Normal_Matrix_uni, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+        glUniform1i(cube_shader->meshTile_uni, MESH_TILE);
+    }
+
+    mesh->bindVAO(true, shadow);
+    for (size_t handle = 0; handle < counts.size(); handle++) {
+        if (counts[handle] == 0) {
+            continue;
+        }
+        // No base instance before GL 4.2, so the pointers move instead
+        mesh->setInstanceBuffer(instanceBuffer->getBuffer(),
+            instanceOffset + starts[handle] * sizeof(ModelInstance), shadow);
+        mesh->renderInstanced(handle, counts[handle]);
+        numDraws++;
+    }
+    mesh->bindVAO(false, shadow);
+
+    if (!shadow) {
+        glUniform1i(CubeShader::getShader()->meshTile_uni, 0);
+    }
+    CHECK_GL_ERRORS;
+}
+
+void ModelBatch::fence() {
+    instanceBuffer->fence();
+}
+
+int ModelBatch::getNumInstances() const {
+    return numInstances;
+}
+
+int ModelBatch::getNumDraws() const {
+    return numDraws;
+}
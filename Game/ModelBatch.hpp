@@ -0,0 +1,54 @@
+#pragma once
+
+#include "GLUtils.hpp"
+#include "StreamBuffer.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#define MAX_MODEL_INSTANCES 16384
+
+/*
+ * Collects the geometry of every mesh model drawn in a frame and draws each
+ * mesh once, instanced over all models using it. The model matrices and
+ * their normal matrices are uploaded once and shared by every pass of the
+ * frame.
+ *
+ *     batch.begin();
+ *     batch.add(model, world);    // per character
+ *     batch.upload();
+ *     batch.render(VP, true);     // per pass, with the pass's shader enabled
+ *     batch.render(view, false);
+ *     batch.fence();              // after the last pass
+ */
+class ModelBatch {
+public:
+    ModelBatch();
+    ~ModelBatch();
+
+    void begin();
+    // world places the model's root, instances past MAX_MODEL_INSTANCES are dropped
+    void add(const MeshModel* model, const glm::mat4& world);
+    void upload();
+    // view is the shadow shader's MVP or the cube shader's VM
+    void render(const glm::mat4& view, bool shadow);
+    void fence();
+
+    int getNumInstances() const;
+    int getNumDraws() const;
+
+private:
+    // Filled by add(), grouped by mesh in upload()
+    std::vector<int> handles;
+    std::vector<glm::mat4> transforms;
+
+    // Per mesh handle, into the uploaded region
+    std::vector<int> starts;
+    std::vector<int> counts;
+
+    StreamBuffer* instanceBuffer;
+    GLintptr instanceOffset;
+    int numInstances;
+    int numDraws;
+};
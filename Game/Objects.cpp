@@ -1,10 +1,18 @@
 #include "Objects.hpp"
 #include "SceneNode.hpp"
+#include "SimulationClock.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
 
 #define PI 3.141592653f
 
+// Enemies walk at this speed and turn back once this far from home
+#define ENEMY_SPEED 2.0f
+#define ENEMY_RANGE 24.0f
+// Downward acceleration in units/s². delta.y is the vertical velocity times
+// the tick length, so a tick adds GRAVITY * dt * dt to the fall
+#define GRAVITY 60.0
+
 void Objects::updateRotation(float delta) {
     rotation = wrap(rotation + delta, 0, 2 * PI);
     m_rotate = glm::rotate(glm::mat4(), rotation, glm::vec3(0, 1, 0));
@@ -17,30 +25,48 @@ void Objects::updatePosition(glm::vec3 pos) {
 
 bool SolidObjects::collideEnvironment(glm::vec3& position, ChunkManager* chunkManager) {
     float halfWidth = width / 2;
-    // Check 8 points
-    glm::vec3 points[8];
-
-    // Bottom
-    points[0] = glm::vec3(position.x + halfWidth, position.y, position.z + halfWidth);
-    points[1] = glm::vec3(position.x + halfWidth, position.y, position.z - halfWidth);
-    points[2] = glm::vec3(position.x - halfWidth, position.y, position.z + halfWidth );
-    points[3] = glm::vec3(position.x - halfWidth, position.y, position.z - halfWidth);
-
-    points[4] = glm::vec3(position.x + halfWidth, position.y + height, position.z + halfWidth);
-    points[5] = glm::vec3(position.x + halfWidth, position.y + height, position.z - halfWidth);
-    points[6] = glm::vec3(position.x - halfWidth, position.y + height, position.z + halfWidth );
-    points[7] = glm::vec3(position.x - halfWidth, position.y + height, position.z - halfWidth);
-
-    for (int i = 0; i < 7; i++) {
-        if (chunkManager->solidBlock(points[i])) {
-            return true;
+    glm::vec3 boxMin = glm::vec3(position.x - halfWidth, position.y, position.z - halfWidth);
+    glm::vec3 boxMax = glm::vec3(position.x + halfWidth, position.y + height, position.z + halfWidth);
+
+    return chunkManager->overlapAABB(boxMin, boxMax);
+}
+
+/*
+ * Moves the object by delta, stopping at the first block hit and sliding the rest
+ * of the move along the contact face. Components of delta going into a contact are
+ * zeroed. Returns the contact normals, one signed component per axis that was hit.
+ */
+glm::vec3 SolidObjects::moveAndSlide(glm::vec3& delta, ChunkManager* chunkManager) {
+    float halfWidth = width / 2;
+    glm::vec3 contact = glm::vec3(0);
+    glm::vec3 remaining = delta;
+
+    // Each iteration removes one axis from the move, so 3 is enough
+    for (int i = 0; i < 3; i++) {
+        glm::vec3 boxMin = glm::vec3(position.x - halfWidth, position.y, position.z - halfWidth);
+        glm::vec3 boxMax = glm::vec3(position.x + halfWidth, position.y + height, position.z + halfWidth);
+
+        SweepResult sweep = chunkManager->sweepAABB(boxMin, boxMax, remaining);
+        position += remaining * sweep.time;
+        if (!sweep.hit) {
+            break;
+        }
+
+        remaining *= 1.0f - sweep.time;
+        for (int a = 0; a < 3; a++) {
+            if (sweep.normal[a] != 0) {
+                remaining[a] = 0;
+                delta[a] = 0;
+                contact[a] = sweep.normal[a];
+            }
         }
     }
-    return false;
+    return contact;
 }
 
 Player::Player() {
     position = glm::vec3(0, 12, 0);
+    previousPosition = renderPosition = position;
     rotation = 0;
     facing = glm::vec3(0, 0, 1);
     right = glm::vec3(-1, 0, 0);
@@ -52,35 +78,18 @@ Player::Player() {
     smashTime = 0;
 
     playerModel = NULL;
-    leftThigh = rightThigh = leftArm = rightArm = NULL;
+    animation = -1;
 }
 
 void Player::loadModel() {
     playerModel = new MeshModel(getAssetFilePath("puppet.lua"));
+}
 
-    SceneNode* root = playerModel->getRoot();
-    loadJoints(root);
+glm::mat4 Player::getModelMatrix() {
+    return glm::translate(glm::mat4(), renderPosition) * m_rotate;
 }
 
-void Player::loadJoints(SceneNode* node) {
-    if (node->m_name == "shoulderJoint") {
-        if (rightArm == NULL) {
-            rightArm = static_cast<JointNode *>(node);
-        } else {
-            leftArm = static_cast<JointNode *>(node);
-        }
-    } else if (node->m_name == "thighJoint") {
-        if (rightThigh == NULL) {
-            rightThigh = static_cast<JointNode *>(node);
-        } else {
-            leftThigh = static_cast<JointNode *>(node);
-        }
-    }
 
-    for (SceneNode* child : node->children) {
-        loadJoints(child);
-    }
-}
 
 void Player::updateRotation(float delta) {
     this->Objects::updateRotation(delta);
@@ -97,28 +106,13 @@ void Player::updateDelta(glm::vec3 d) {
 
 void Player::updatePosition(ChunkManager* chunkManager, Audio* audio) {
     glm::vec3 positionBefore = position;
+    previousPosition = position;
 
-    delta.y -= 1.0/60.0;
-    for (int i = 0; i < 3; i++) {
-        glm::vec3 newpos = position;
-        if (i == 0) {
-            newpos.x += delta.x;
-        } else if (i == 1) {
-            newpos.y += delta.y;
-        } else {
-            newpos.z += delta.z;
-        }
-
-        if (collideEnvironment(newpos, chunkManager)) {
-
-        } else {
-            position = newpos;
-        }
-    }
+    delta.y -= GRAVITY * SIMULATION_TICK_SECONDS * SIMULATION_TICK_SECONDS;
+    glm::vec3 contact = moveAndSlide(delta, chunkManager);
 
-    if (positionBefore.y == position.y) {
+    if (contact.y > 0) {
         fallingTime = 0;
-        delta.y = 0;
     } else {
         fallingTime += 1;
     }
@@ -127,7 +121,7 @@ void Player::updatePosition(ChunkManager* chunkManager, Audio* audio) {
         if (walkingTime < 0.2 || (walkingTime >= 1.0 && walkingTime < 1.2)) {
             audio->playWalk();
         }
-        walkingTime += 1.0/5.0;
+        walkingTime = fmod(walkingTime + 1.0/5.0, 2);
     }
 
     if (smashTime > 0) {
@@ -137,45 +131,76 @@ void Player::updatePosition(ChunkManager* chunkManager, Audio* audio) {
         }
     }
 
-    animate();
     delta = glm::vec3(0, delta.y, 0);
 }
 
-void Player::animate() {
-    walkingTime = fmod(walkingTime, 2);
-    float frame = walkingTime > 1 ? 2 - walkingTime : walkingTime;
+void Player::interpolate(float alpha) {
+    renderPosition = lerp(previousPosition, position, alpha);
+    // Shared by every pass of the frame
+    if (playerModel != NULL) {
+        playerModel->update();
+    }
+}
 
+Enemy::Enemy(glm::vec3 home, float rotation, float turnRate) : home(home), turnRate(turnRate) {
+    position = previousPosition = renderPosition = home;
+    delta = glm::vec3(0);
+    this->rotation = 0;
+    updateRotation(rotation);
+    walkingTime = 0;
 
-    float leftLegAngle = lerp(-25, 30, frame);
-    float rightLegAngle = lerp(-25, 30, 1 - frame);
-    float leftArmAngle = lerp(330, 360, 1- frame);
-    float rightArmAngle = lerp(330, 360, frame);
+    width = 1;
+    height = 1.8;
 
-    if (smashTime > 0) {
-        frame = smashTime > 1 ? 2 - smashTime : smashTime;
-        rightArmAngle = lerp(360, 300, frame);
-    }
+    model = NULL;
+    animation = -1;
+}
 
-    leftArm->set_x_rotate(leftArmAngle);
-    rightArm->set_x_rotate(rightArmAngle);
-    leftThigh->set_x_rotate(leftLegAngle);
-    rightThigh->set_x_rotate(rightLegAngle);
+Enemy::~Enemy() {
+    delete model;
 }
 
-void Player::render(glm::mat4 view) {
-    if (playerModel == NULL) {
-        return;
+void Enemy::loadModel() {
+    model = new MeshModel(getAssetFilePath("puppet.lua"));
+}
+
+glm::mat4 Enemy::getModelMatrix() {
+    return glm::translate(glm::mat4(), renderPosition) * m_rotate;
+}
+
+void Enemy::updatePosition(ChunkManager* chunkManager) {
+    previousPosition = position;
+
+    glm::vec3 toHome = home - position;
+    toHome.y = 0;
+    if (glm::length(toHome) > ENEMY_RANGE) {
+        updateRotation(atan2(toHome.x, toHome.z) - rotation);
+    } else {
+        updateRotation(turnRate * SIMULATION_TICK_SECONDS);
+    }
+
+    glm::vec3 walk = facing * (float)(ENEMY_SPEED * SIMULATION_TICK_SECONDS);
+    delta = glm::vec3(walk.x, delta.y - (float)(GRAVITY * SIMULATION_TICK_SECONDS * SIMULATION_TICK_SECONDS), walk.z);
+    glm::vec3 contact = moveAndSlide(delta, chunkManager);
+
+    // Blocked by a wall, walk the other way
+    if (contact.x != 0 || contact.z != 0) {
+        updateRotation(PI);
+    }
+    // Fell out of the loaded world
+    if (position.y < -CHUNK_SIZE) {
+        position = previousPosition = home;
+        delta = glm::vec3(0);
     }
-    glm::mat4 translate = glm::translate(glm::mat4(), position);
-    playerModel->render(view * translate * m_rotate, false);
+
+    walkingTime = fmod(walkingTime + 1.0/5.0, 2);
 }
 
-void Player::renderShadow(glm::mat4 view) {
-    if (playerModel == NULL) {
-        return;
+void Enemy::interpolate(float alpha) {
+    renderPosition = lerp(previousPosition, position, alpha);
+    if (model != NULL) {
+        model->update();
     }
-    glm::mat4 translate = glm::translate(glm::mat4(), position);
-    playerModel->render(view * translate * m_rotate, true);
 }
 
 Camera::Camera() {
@@ -196,7 +221,7 @@ Camera::Camera() {
 
 void Camera::update(Player& player) {
     if (first_person) {
-        this->position = player.position + glm::vec3(0, 1.8f, 0.0f) + 0.1f * player.facing; // player height
+        this->position = player.renderPosition + glm::vec3(0, 1.8f, 0.0f) + 0.1f * player.facing; // player height
     } else {
         float yaw = player.rotation + PI;
         float pitch = camera_rotation.y;
@@ -205,9 +230,9 @@ void Camera::update(Player& player) {
         float width = distanceFromPlayer * glm::cos(pitch);
 
         glm::mat4 rotate = glm::rotate(glm::mat4(), yaw, glm::vec3(0.0f, 1.0f, 0.0f));
-        this->position = player.position + glm::vec3(0, 1.8f, 0.0f) + glm::vec3(rotate * glm::vec4(0, 0, width, 1)) + glm::vec3(0, height, 0);
+        this->position = player.renderPosition + glm::vec3(0, 1.8f, 0.0f) + glm::vec3(rotate * glm::vec4(0, 0, width, 1)) + glm::vec3(0, height, 0);
 
-        this->facing = player.position - this->position;
+        this->facing = player.renderPosition - this->position;
     }
 
     generateViewMatrix();
@@ -21,36 +21,53 @@ struct SolidObjects: public Objects {
     float width;
     float height;
     virtual bool collideEnvironment(glm::vec3& position, ChunkManager* chunkManager);
+    glm::vec3 moveAndSlide(glm::vec3& delta, ChunkManager* chunkManager);
 };
 
 struct Player : public SolidObjects {
     glm::vec3 delta;
+    glm::vec3 previousPosition; // Position at the start of the last tick
+    glm::vec3 renderPosition;   // Interpolated between ticks, used for drawing
     glm::vec3 right;
     float fallingTime;
+    // Playback times of the walk and smash clips, see puppet_anim.lua
     float walkingTime;
     float smashTime;
 
     MeshModel* playerModel;
-    JointNode* leftThigh, *rightThigh;
-    JointNode* leftArm, *rightArm;
+    int animation; // Instance in the game's AnimationBatch, -1 if none
 
     Player();
 
     void loadModel();
-    void loadJoints(SceneNode* node);
-
-    void render(glm::mat4 view);
-    void renderShadow(glm::mat4 view);
+    glm::mat4 getModelMatrix();
 
     virtual void updateRotation(float delta) override;
     virtual void updatePosition(ChunkManager* chunkManager, Audio* audio);
     void updateDelta(glm::vec3 d);
-
-    void animate();
+    void interpolate(float alpha);
 };
 
-struct Enemy : public Objects {
+// Wanders around a home point, walking the same cycle as the player
+struct Enemy : public SolidObjects {
+    glm::vec3 delta;
+    glm::vec3 previousPosition;
+    glm::vec3 renderPosition;
+    glm::vec3 home;
+    float turnRate;
+    float walkingTime;
+
+    MeshModel* model;
+    int animation;
+
+    Enemy(glm::vec3 home, float rotation, float turnRate);
+    virtual ~Enemy();
+
+    void loadModel();
+    glm::mat4 getModelMatrix();
 
+    void updatePosition(ChunkManager* chunkManager);
+    void interpolate(float alpha);
 };
 
 struct Camera : public Objects {
@@ -0,0 +1,142 @@
+/*
+ * Checks the GPU particle backend against the CPU one.
+ *
+ * Opens a hidden window, steps both backends from the same spawns and
+ * compares every live particle with its twin. Run from the Game directory:
+ *
+ *     $ ./ParticleChecker
+ *
+ * The exit status is 1 if their particles drift apart or no GL context can
+ * be created.
+ */
+
+#include "GLUtils.hpp"
+#include "ParticlePool.hpp"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+extern "C" {
+    int gl3wInit(void);
+}
+
+// Largest distance a GPU particle may be from its CPU twin, the backends
+// round differently but integrate the same way
+#define PARTICLE_BACKEND_TOLERANCE 1e-3f
+
+// NULL if there is no display
+static GLFWwindow* createHiddenContext() {
+    if (glfwInit() == GL_FALSE) {
+        return NULL;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "ParticleCheck", NULL, NULL);
+    if (window == NULL) {
+        glfwTerminate();
+        return NULL;
+    }
+    glfwMakeContextCurrent(window);
+    gl3wInit();
+    return window;
+}
+
+// Steps the CPU and GPU particle backends from the same spawns, the first
+// half expiring on the way, and returns the largest distance between a live
+// particle and its twin, or -1 if the backends disagree on which are alive.
+// The red channel carries each particle's spawn index.
+static float compareParticleBackends(int spawns, float delta) {
+    ParticlePool* cpu = new ParticlePool();
+    GpuParticles* gpu = new GpuParticles(spawns);
+
+    auto spawn = [&](int first, int last) {
+        for (int i = first; i < last; i++) {
+            glm::vec3 loc = glm::vec3(rand() % 64, rand() % 32, rand() % 64);
+            glm::vec3 v = glm::vec3(rand() % 9 - 4, rand() % 9, rand() % 9 - 4);
+            glm::vec4 c = glm::vec4((float)i / spawns, 1, 1, 1);
+            cpu->addParticle(loc, v, c, 0.25f);
+            gpu->addParticle(loc, v, c, 0.25f);
+        }
+    };
+    auto step = [&](float seconds) {
+        for (int tick = 0; tick < (int)(seconds / delta); tick++) {
+            cpu->update(glm::vec3(0), delta);
+            gpu->updateParticles(glm::vec3(0), delta);
+        }
+    };
+    spawn(0, spawns / 2);
+    step(PARTICLE_LIFE * 0.75f);
+    spawn(spawns / 2, spawns);
+    step(PARTICLE_LIFE * 0.5f);
+
+    vector<float> positions(4 * cpu->getCount());
+    vector<float> colors(4 * cpu->getCount());
+    int live = cpu->pack(positions.data(), colors.data());
+    vector<int> twin(spawns, -1);
+    for (int n = 0; n < live; n++) {
+        twin[(int)lround(colors[4 * n] * spawns)] = n;
+    }
+
+    vector<float> state;
+    gpu->readState(state);
+    float largest = 0;
+    int gpuLive = 0;
+    for (int i = 0; i < gpu->getUsed() && largest >= 0; i++) {
+        const float* particle = &state[i * GPU_PARTICLE_FLOATS];
+        if (particle[3] == 0) {
+            continue;
+        }
+        gpuLive++;
+        int n = twin[(int)lround(particle[8] * spawns)];
+        if (n < 0) {
+            largest = -1;
+            break;
+        }
+        glm::vec3 cpuPos = glm::vec3(positions[4 * n], positions[4 * n + 1], positions[4 * n + 2]);
+        largest = max(largest, glm::length(cpuPos - glm::vec3(particle[0], particle[1], particle[2])));
+    }
+    if (gpuLive != live) {
+        largest = -1;
+    }
+
+    delete gpu;
+    delete cpu;
+    return largest;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        fprintf(stderr, "Usage: %s\n", argv[0]);
+        return 1;
+    }
+    GLFWwindow* context = createHiddenContext();
+    if (context == NULL) {
+        fprintf(stderr, "No GL context, GPU particles not checked\n");
+        return 1;
+    }
+
+    srand(0);
+    float difference = compareParticleBackends(10000, 1.0f / 60);
+    bool match = difference >= 0 && difference <= PARTICLE_BACKEND_TOLERANCE;
+    if (difference < 0) {
+        fprintf(stderr, "GPU particles do not match the CPU ones: different particles are alive\n");
+    } else if (!match) {
+        fprintf(stderr, "GPU particles do not match the CPU ones: positions apart by %g\n", difference);
+    } else {
+        printf("GPU particles match the CPU ones within %g\n", difference);
+    }
+
+    glfwDestroyWindow(context);
+    glfwTerminate();
+    return match ? 0 : 1;
+}
@@ -0,0 +1,294 @@
+#include "ParticlePool.hpp"
+#include "ChunkManager.hpp"
+#include "Profiler.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define PARTICLE_SORT_MASK (PARTICLE_SORT_BUCKETS - 1)
+// Only the top 22 bits of the distance are sorted on, that is still 13
+// mantissa bits which is far finer than blending order needs
+#define PARTICLE_SORT_DROP_BITS (32 - PARTICLE_SORT_PASSES * PARTICLE_SORT_BITS)
+
+ParticlePool::ParticlePool() : count(0), world(NULL), collision(ParticleCollision::NONE), sorting(false) {
+    // The SIMD loop reads up to three slots past the live range
+    memset(px, 0, sizeof(px));
+    memset(py, 0, sizeof(py));
+    memset(pz, 0, sizeof(pz));
+    memset(vx, 0, sizeof(vx));
+    memset(vy, 0, sizeof(vy));
+    memset(vz, 0, sizeof(vz));
+    memset(life, 0, sizeof(life));
+    memset(cameraDist, 0, sizeof(cameraDist));
+}
+
+// Advances the simulation by one tick
+void ParticlePool::update(glm::vec3 cameraPos, float delta) {
+    integrate(cameraPos, delta);
+    if (world != NULL && collision != ParticleCollision::NONE) {
+        PROFILE_ZONE("ParticlePool::collide");
+        collide(delta);
+    }
+    removeDead();
+}
+
+void ParticlePool::setCollision(ChunkManager* world, ParticleCollision mode) {
+    this->world = world;
+    collision = mode;
+}
+
+void ParticlePool::setSorting(bool on) {
+    sorting = on;
+}
+
+void ParticlePool::integrate(glm::vec3 cameraPos, float delta) {
+    // simulate falling
+    float fall = PARTICLE_GRAVITY * delta * 0.5f;
+
+#if defined(__SSE2__)
+    const __m128 dt = _mm_set1_ps(delta);
+    const __m128 dv = _mm_set1_ps(fall);
+    const __m128 cx = _mm_set1_ps(cameraPos.x);
+    const __m128 cy = _mm_set1_ps(cameraPos.y);
+    const __m128 cz = _mm_set1_ps(cameraPos.z);
+
+    for (int i = 0; i < count; i += 4) {
+        __m128 velY = _mm_add_ps(_mm_load_ps(vy + i), dv);
+        _mm_store_ps(vy + i, velY);
+
+        __m128 x = _mm_add_ps(_mm_load_ps(px + i), _mm_mul_ps(_mm_load_ps(vx + i), dt));
+        __m128 y = _mm_add_ps(_mm_load_ps(py + i), _mm_mul_ps(velY, dt));
+        __m128 z = _mm_add_ps(_mm_load_ps(pz + i), _mm_mul_ps(_mm_load_ps(vz + i), dt));
+        _mm_store_ps(px + i, x);
+        _mm_store_ps(py + i, y);
+        _mm_store_ps(pz + i, z);
+
+        _mm_store_ps(life + i, _mm_sub_ps(_mm_load_ps(life + i), dt));
+
+        __m128 dx = _mm_sub_ps(x, cx);
+        __m128 dy = _mm_sub_ps(y, cy);
+        __m128 dz = _mm_sub_ps(z, cz);
+        __m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        _mm_store_ps(cameraDist + i, _mm_sqrt_ps(dist2));
+    }
+#else
+    for (int i = 0; i < count; i++) {
+        vy[i] += fall;
+        px[i] += vx[i] * delta;
+        py[i] += vy[i] * delta;
+        pz[i] += vz[i] * delta;
+        life[i] -= delta;
+
+        float dx = px[i] - cameraPos.x;
+        float dy = py[i] - cameraPos.y;
+        float dz = pz[i] - cameraPos.z;
+        cameraDist[i] = sqrtf(dx * dx + dy * dy + dz * dz);
+    }
+#endif
+}
+
+// Rounds four floats down to ints, valid while they fit in an int
+#if defined(__SSE2__)
+static inline __m128i floor4(__m128 v) {
+    __m128i truncated = _mm_cvttps_epi32(v);
+    // Truncation rounds negative values up, the compare mask is -1 there
+    __m128 roundedUp = _mm_cmpgt_ps(_mm_cvtepi32_ps(truncated), v);
+    return _mm_add_epi32(truncated, _mm_castps_si128(roundedUp));
+}
+#endif
+
+// Looks up the cell every particle moved into with one batched query, then
+// resolves the few that hit a solid block
+void ParticlePool::collide(float delta) {
+#if defined(__SSE2__)
+    for (int i = 0; i < count; i += 4) {
+        _mm_store_si128((__m128i*)(cellX + i), floor4(_mm_load_ps(px + i)));
+        _mm_store_si128((__m128i*)(cellY + i), floor4(_mm_load_ps(py + i)));
+        _mm_store_si128((__m128i*)(cellZ + i), floor4(_mm_load_ps(pz + i)));
+    }
+#else
+    for (int i = 0; i < count; i++) {
+        cellX[i] = (int)floorf(px[i]);
+        cellY[i] = (int)floorf(py[i]);
+        cellZ[i] = (int)floorf(pz[i]);
+    }
+#endif
+
+    world->solidBlocks(cellX, cellY, cellZ, count, solid);
+
+    for (int i = 0; i < count; i++) {
+        if (!solid[i]) {
+            continue;
+        }
+
+        if (collision == ParticleCollision::KILL) {
+            life[i] = 0;
+            continue;
+        }
+
+        // Step back to where the particle was before this tick
+        float oldX = px[i] - vx[i] * delta;
+        float oldY = py[i] - vy[i] * delta;
+        float oldZ = pz[i] - vz[i] * delta;
+
+        if (collision == ParticleCollision::STOP) {
+            vx[i] = vy[i] = vz[i] = 0;
+        } else {
+            // Reflect the axes along which the particle changed cell
+            if ((int)floorf(oldX) != cellX[i]) vx[i] = -vx[i] * PARTICLE_RESTITUTION;
+            if ((int)floorf(oldY) != cellY[i]) vy[i] = -vy[i] * PARTICLE_RESTITUTION;
+            if ((int)floorf(oldZ) != cellZ[i]) vz[i] = -vz[i] * PARTICLE_RESTITUTION;
+        }
+        px[i] = oldX;
+        py[i] = oldY;
+        pz[i] = oldZ;
+    }
+}
+
+void ParticlePool::removeDead() {
+    int i = 0;
+    while (i < count) {
+        if (life[i] > 0.0f) {
+            i++;
+        } else {
+            count--;
+            move(count, i);
+        }
+    }
+}
+
+void ParticlePool::move(int from, int to) {
+    px[to] = px[from];
+    py[to] = py[from];
+    pz[to] = pz[from];
+    vx[to] = vx[from];
+    vy[to] = vy[from];
+    vz[to] = vz[from];
+    life[to] = life[from];
+    cameraDist[to] = cameraDist[from];
+    size[to] = size[from];
+    r[to] = r[from];
+    g[to] = g[from];
+    b[to] = b[from];
+    a[to] = a[from];
+}
+
+// LSD radix sort on the float bits of the distance, which order the same as
+// the floats since distances are never negative. Keys are inverted so the
+// farthest particle comes first.
+void ParticlePool::sortByDistance() {
+#if defined(__SSE2__)
+    const __m128i ones = _mm_set1_epi32(-1);
+    for (int i = 0; i < count; i += 4) {
+        __m128i bits = _mm_castps_si128(_mm_load_ps(cameraDist + i));
+        __m128i key = _mm_srli_epi32(_mm_xor_si128(bits, ones), PARTICLE_SORT_DROP_BITS);
+        _mm_store_si128((__m128i*)(keys + i), key);
+    }
+#else
+    for (int i = 0; i < count; i++) {
+        unsigned int bits;
+        memcpy(&bits, &cameraDist[i], sizeof(bits));
+        keys[i] = ~bits >> PARTICLE_SORT_DROP_BITS;
+    }
+#endif
+
+    // Both histograms are built in one read of the keys
+    memset(offsets, 0, sizeof(offsets));
+    for (int i = 0; i < count; i++) {
+        unsigned int key = keys[i];
+        offsets[0][key & PARTICLE_SORT_MASK]++;
+        offsets[1][key >> PARTICLE_SORT_BITS]++;
+    }
+
+    unsigned int* keyIn = keys;
+    unsigned int* keyOut = keysTmp;
+    int* orderIn = NULL; // Identity until the first pass that moves anything
+    int* orderOut = order;
+    for (int pass = 0; pass < PARTICLE_SORT_PASSES; pass++) {
+        int shift = pass * PARTICLE_SORT_BITS;
+        int* offset = offsets[pass];
+        // Every key shares this digit, the pass would not change the order
+        if (offset[(keyIn[0] >> shift) & PARTICLE_SORT_MASK] == count) {
+            continue;
+        }
+
+        int sum = 0;
+        for (int bucket = 0; bucket < PARTICLE_SORT_BUCKETS; bucket++) {
+            int n = offset[bucket];
+            offset[bucket] = sum;
+            sum += n;
+        }
+        for (int i = 0; i < count; i++) {
+            int slot = offset[(keyIn[i] >> shift) & PARTICLE_SORT_MASK]++;
+            keyOut[slot] = keyIn[i];
+            orderOut[slot] = orderIn != NULL ? orderIn[i] : i;
+        }
+        std::swap(keyIn, keyOut);
+        orderIn = orderOut;
+        orderOut = orderOut == order ? orderTmp : order;
+    }
+
+    if (orderIn == NULL) {
+        for (int i = 0; i < count; i++) {
+            order[i] = i;
+        }
+    } else if (orderIn != order) {
+        memcpy(order, orderIn, count * sizeof(int));
+    }
+}
+
+int ParticlePool::pack(float* position_data, float* color_data) {
+    const int* indices = NULL;
+    if (sorting && count > 1) {
+        PROFILE_ZONE("ParticlePool::sort");
+        sortByDistance();
+        indices = order;
+    }
+
+    for (int n = 0; n < count; n++) {
+        int i = indices != NULL ? indices[n] : n;
+        position_data[4 * n + 0] = px[i];
+        position_data[4 * n + 1] = py[i];
+        position_data[4 * n + 2] = pz[i];
+        position_data[4 * n + 3] = size[i];
+
+        color_data[4 * n + 0] = r[i];
+        color_data[4 * n + 1] = g[i];
+        color_data[4 * n + 2] = b[i];
+        color_data[4 * n + 3] = a[i];
+    }
+    return count;
+}
+
+void ParticlePool::addParticle(glm::vec3 loc, glm::vec3 v, glm::vec4 c, float s) {
+    if (count == MAX_PARTICLES) {
+        return;
+    }
+
+    int slot = count++;
+    px[slot] = loc.x;
+    py[slot] = loc.y;
+    pz[slot] = loc.z;
+    vx[slot] = v.x;
+    vy[slot] = v.y;
+    vz[slot] = v.z;
+    life[slot] = PARTICLE_LIFE;
+    size[slot] = s;
+    r[slot] = c.r;
+    g[slot] = c.g;
+    b[slot] = c.b;
+    a[slot] = c.a;
+}
+
+void ParticlePool::clear() {
+    count = 0;
+}
+
+int ParticlePool::getCount() const {
+    return count;
+}
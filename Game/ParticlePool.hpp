@@ -0,0 +1,86 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Must stay a multiple of 4, update() processes particles in groups of four
+#define MAX_PARTICLES 100000
+#define PARTICLE_LIFE 2.0f
+#define PARTICLE_GRAVITY -9.81f
+// Fraction of the velocity kept when bouncing off a block
+#define PARTICLE_RESTITUTION 0.5f
+// Radix sort by camera distance, PARTICLE_SORT_BITS per pass
+#define PARTICLE_SORT_BITS 11
+#define PARTICLE_SORT_BUCKETS (1 << PARTICLE_SORT_BITS)
+#define PARTICLE_SORT_PASSES 2
+
+class ChunkManager;
+
+// What happens to a particle that moves into a solid block
+enum class ParticleCollision {
+    NONE,
+    BOUNCE,
+    STOP,
+    KILL
+};
+
+// CPU side particle simulation, rendering is done by Particles in GLUtils.
+// Particles are stored as structure of arrays and kept in a dense range
+// [0, count): spawning appends, dying swaps the last particle into the hole.
+class ParticlePool {
+public:
+    ParticlePool();
+
+    void update(glm::vec3 cameraPos, float delta);
+
+    // Collision against the world's blocks, off by default
+    void setCollision(ChunkManager* world, ParticleCollision mode);
+    // Makes pack() order particles back to front by camera distance
+    void setSorting(bool on);
+
+    // Dropped when the pool is full
+    void addParticle(glm::vec3 loc, glm::vec3 v, glm::vec4 c, float size);
+    void clear();
+    int getCount() const;
+
+    // Writes live particles as (x, y, z, size) and (r, g, b, a), returns the count
+    int pack(float* position_data, float* color_data);
+
+private:
+    void integrate(glm::vec3 cameraPos, float delta);
+    void collide(float delta);
+    void removeDead();
+    void move(int from, int to);
+    // Fills order with live particle indices, farthest first
+    void sortByDistance();
+
+    int count;
+
+    ChunkManager* world;
+    ParticleCollision collision;
+    bool sorting;
+
+    alignas(16) float px[MAX_PARTICLES];
+    alignas(16) float py[MAX_PARTICLES];
+    alignas(16) float pz[MAX_PARTICLES];
+    alignas(16) float vx[MAX_PARTICLES];
+    alignas(16) float vy[MAX_PARTICLES];
+    alignas(16) float vz[MAX_PARTICLES];
+    alignas(16) float life[MAX_PARTICLES];
+    alignas(16) float cameraDist[MAX_PARTICLES];
+    float size[MAX_PARTICLES];
+    float r[MAX_PARTICLES];
+    float g[MAX_PARTICLES];
+    float b[MAX_PARTICLES];
+    float a[MAX_PARTICLES];
+
+    // Scratch space for collision and sorting
+    alignas(16) int cellX[MAX_PARTICLES];
+    alignas(16) int cellY[MAX_PARTICLES];
+    alignas(16) int cellZ[MAX_PARTICLES];
+    unsigned char solid[MAX_PARTICLES];
+    alignas(16) unsigned int keys[MAX_PARTICLES];
+    unsigned int keysTmp[MAX_PARTICLES];
+    int order[MAX_PARTICLES];
+    int orderTmp[MAX_PARTICLES];
+    int offsets[PARTICLE_SORT_PASSES][PARTICLE_SORT_BUCKETS];
+};
@@ -0,0 +1,266 @@
+#include "Profiler.hpp"
+
+#include <imgui/imgui.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Single producer ring buffer, written only by its owning thread. head counts
+// every event ever written; readers copy a range and then re-check head to
+// drop entries that were overwritten while copying.
+struct ThreadBuffer {
+    std::string name;
+    std::atomic<uint64_t> head;
+    ProfileEvent events[PROFILER_EVENTS_PER_THREAD];
+};
+
+static ThreadBuffer* threadBuffers[PROFILER_MAX_THREADS];
+static std::atomic<int> numThreadBuffers(0);
+static std::mutex registerMutex;
+
+// Frame boundaries recorded by the main thread
+static uint64_t frameStart[PROFILER_MAX_FRAMES];
+static uint64_t frameCount = 0;
+
+static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+std::atomic<bool> Profiler::enabled(false);
+
+static ThreadBuffer* getThreadBuffer() {
+    static thread_local ThreadBuffer* buffer = NULL;
+    if (buffer == NULL) {
+        std::lock_guard<std::mutex> lock(registerMutex);
+        int index = numThreadBuffers.load(std::memory_order_relaxed);
+        if (index >= PROFILER_MAX_THREADS) {
+            return NULL;
+        }
+
+        buffer = new ThreadBuffer();
+        buffer->name = "thread " + std::to_string(index);
+        buffer->head.store(0, std::memory_order_relaxed);
+        threadBuffers[index] = buffer;
+        numThreadBuffers.store(index + 1, std::memory_order_release);
+    }
+    return buffer;
+}
+
+void Profiler::setEnabled(bool on) {
+    enabled.store(on, std::memory_order_relaxed);
+}
+
+uint64_t Profiler::now() {
+    // Offset by one so 0 can mean "not recording"
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - epoch).count() + 1;
+}
+
+uint32_t& Profiler::threadDepth() {
+    static thread_local uint32_t depth = 0;
+    return depth;
+}
+
+void Profiler::beginFrame() {
+    frameStart[frameCount % PROFILER_MAX_FRAMES] = now();
+    frameCount++;
+}
+
+void Profiler::setThreadName(const char* name) {
+    ThreadBuffer* buffer = getThreadBuffer();
+    if (buffer != NULL) {
+        std::lock_guard<std::mutex> lock(registerMutex);
+        buffer->name = name;
+    }
+}
+
+void Profiler::record(const char* name, uint64_t start, uint64_t end, uint32_t depth) {
+    ThreadBuffer* buffer = getThreadBuffer();
+    if (buffer == NULL) {
+        return;
+    }
+
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    ProfileEvent& event = buffer->events[head % PROFILER_EVENTS_PER_THREAD];
+    event.name = name;
+    event.start = start;
+    event.end = end;
+    event.depth = depth;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+// Copies the events of one thread that ended inside [from, to)
+static void readEvents(ThreadBuffer* buffer, uint64_t from, uint64_t to, std::vector<ProfileEvent>& out) {
+    uint64_t head = buffer->head.load(std::memory_order_acquire);
+    uint64_t first = head > PROFILER_EVENTS_PER_THREAD ? head - PROFILER_EVENTS_PER_THREAD : 0;
+
+    std::vector<ProfileEvent> copy;
+    copy.reserve(head - first);
+    for (uint64_t i = first; i < head; i++) {
+        copy.push_back(buffer->events[i % PROFILER_EVENTS_PER_THREAD]);
+    }
+
+    // Anything the writer lapped while we copied is garbage, including the
+    // slot of the event it may be writing but has not published yet
+    uint64_t newHead = buffer->head.load(std::memory_order_acquire);
+    uint64_t valid = newHead >= PROFILER_EVENTS_PER_THREAD ? newHead - PROFILER_EVENTS_PER_THREAD + 1 : 0;
+    for (uint64_t i = std::max(first, valid); i < head; i++) {
+        const ProfileEvent& event = copy[i - first];
+        if (event.end >= from && event.end < to) {
+            out.push_back(event);
+        }
+    }
+}
+
+bool Profiler::exportChromeTrace(const std::string& path) {
+    FILE* out = fopen(path.c_str(), "w");
+    if (out == NULL) {
+        return false;
+    }
+
+    fprintf(out, "{\"traceEvents\":[\n");
+    bool first = true;
+    int threads = numThreadBuffers.load(std::memory_order_acquire);
+    for (int t = 0; t < threads; t++) {
+        ThreadBuffer* buffer = threadBuffers[t];
+        std::string name;
+        {
+            std::lock_guard<std::mutex> lock(registerMutex);
+            name = buffer->name;
+        }
+        fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",\n", t, name.c_str());
+        first = false;
+
+        std::vector<ProfileEvent> events;
+        readEvents(buffer, 0, UINT64_MAX, events);
+        for (const ProfileEvent& event : events) {
+            fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                event.name, t, event.start / 1000.0, (event.end - event.start) / 1000.0);
+        }
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    return true;
+}
+
+static ImU32 zoneColor(const char* name) {
+    // Stable colour per zone name
+    unsigned hash = 2166136261u;
+    for (const char* c = name; *c; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+    return ImColor::HSV((hash % 360) / 360.0f, 0.5f, 0.8f);
+}
+
+void Profiler::drawWindow(bool* open) {
+    static int frameOffset = 0;
+    static float frameTimes[PROFILER_MAX_FRAMES];
+    static std::string exportStatus;
+
+    ImGui::Begin("Profiler", open, ImVec2(600, 400));
+
+    bool on = isEnabled();
+    if (ImGui::Checkbox("Record", &on)) {
+        setEnabled(on);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Export Chrome trace")) {
+        exportStatus = exportChromeTrace("profile_trace.json") ?
+            "Wrote profile_trace.json" : "Could not write profile_trace.json";
+    }
+    if (!exportStatus.empty()) {
+        ImGui::SameLine();
+        ImGui::Text("%s", exportStatus.c_str());
+    }
+
+    // The newest frame is still running, only show completed ones
+    int completed = (int)std::min<uint64_t>(frameCount > 0 ? frameCount - 1 : 0, PROFILER_MAX_FRAMES - 1);
+    if (completed == 0) {
+        ImGui::Text("No frames recorded");
+        ImGui::End();
+        return;
+    }
+
+    for (int i = 0; i < completed; i++) {
+        uint64_t frame = frameCount - 1 - completed + i;
+        uint64_t start = frameStart[frame % PROFILER_MAX_FRAMES];
+        uint64_t end = frameStart[(frame + 1) % PROFILER_MAX_FRAMES];
+        frameTimes[i] = (end - start) / 1e6f;
+    }
+    ImGui::PlotHistogram("Frame ms", frameTimes, completed, 0, NULL, 0.0f, 33.3f, ImVec2(0, 60));
+
+    frameOffset = std::min(frameOffset, completed - 1);
+    ImGui::SliderInt("Frames ago", &frameOffset, 0, completed - 1);
+
+    uint64_t frame = frameCount - 2 - frameOffset;
+    uint64_t frameBegin = frameStart[frame % PROFILER_MAX_FRAMES];
+    uint64_t frameEnd = frameStart[(frame + 1) % PROFILER_MAX_FRAMES];
+    double frameMs = (frameEnd - frameBegin) / 1e6;
+    ImGui::Text("Frame %llu: %.3f ms", (unsigned long long)frame, frameMs);
+
+    // Flame view, one lane per thread, one row per nesting depth
+    std::map<std::string, double> totals;
+    const float rowHeight = ImGui::GetTextLineHeight() + 4;
+    float width = ImGui::GetContentRegionAvailWidth();
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+
+    int threads = numThreadBuffers.load(std::memory_order_acquire);
+    for (int t = 0; t < threads; t++) {
+        std::vector<ProfileEvent> events;
+        readEvents(threadBuffers[t], frameBegin, frameEnd, events);
+        if (events.empty()) {
+            continue;
+        }
+
+        uint32_t maxDepth = 0;
+        for (const ProfileEvent& event : events) {
+            maxDepth = std::max(maxDepth, event.depth);
+        }
+
+        std::string threadName;
+        {
+            std::lock_guard<std::mutex> lock(registerMutex);
+            threadName = threadBuffers[t]->name;
+        }
+
+        ImGui::Text("%s", threadName.c_str());
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        float laneHeight = (maxDepth + 1) * rowHeight;
+        drawList->AddRectFilled(origin, ImVec2(origin.x + width, origin.y + laneHeight), 0x40000000);
+
+        for (const ProfileEvent& event : events) {
+            uint64_t start = std::max(event.start, frameBegin);
+            float x0 = origin.x + width * (float)((start - frameBegin) / (double)(frameEnd - frameBegin));
+            float x1 = origin.x + width * (float)((event.end - frameBegin) / (double)(frameEnd - frameBegin));
+            x1 = std::max(x1, x0 + 1);
+            float y0 = origin.y + event.depth * rowHeight;
+            ImVec2 a = ImVec2(x0, y0);
+            ImVec2 b = ImVec2(x1, y0 + rowHeight - 1);
+
+            drawList->AddRectFilled(a, b, zoneColor(event.name));
+            if (x1 - x0 > 40) {
+                drawList->PushClipRect(ImVec4(a.x, a.y, b.x, b.y));
+                drawList->AddText(ImVec2(x0 + 2, y0 + 2), 0xFF000000, event.name);
+                drawList->PopClipRect();
+            }
+
+            double ms = (event.end - event.start) / 1e6;
+            if (ImGui::IsMouseHoveringRect(a, b)) {
+                ImGui::SetTooltip("%s\n%.3f ms", event.name, ms);
+            }
+            totals[threadName + " / " + event.name] += ms;
+        }
+        ImGui::Dummy(ImVec2(width, laneHeight));
+    }
+
+    if (ImGui::CollapsingHeader("Zone totals")) {
+        for (const auto& total : totals) {
+            ImGui::Text("%8.3f ms  %s", total.second, total.first.c_str());
+        }
+    }
+
+    ImGui::End();
+}
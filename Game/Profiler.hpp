@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/*
+ * Lightweight CPU profiler.
+ *
+ * Scoped zones are recorded into a lock-free ring buffer owned by the thread
+ * that records them, so any thread can be instrumented without contention.
+ * Recording is off until Profiler::setEnabled(true); a disabled zone costs one
+ * relaxed atomic load. Define DISABLE_PROFILER to compile the zones out.
+ *
+ *     void Game::draw() {
+ *         PROFILE_ZONE("draw");
+ *         ...
+ *     }
+ */
+
+#define PROFILER_MAX_FRAMES 120
+#define PROFILER_EVENTS_PER_THREAD 16384
+#define PROFILER_MAX_THREADS 16
+
+struct ProfileEvent {
+    const char* name; // Must be a string literal or otherwise outlive the profiler
+    uint64_t start;   // Nanoseconds since the profiler epoch
+    uint64_t end;
+    uint32_t depth;
+};
+
+class Profiler {
+public:
+    static bool isEnabled() {
+        return enabled.load(std::memory_order_relaxed);
+    }
+    static void setEnabled(bool on);
+
+    static uint64_t now();
+
+    // Marks the start of a new frame, called once per frame from the main thread
+    static void beginFrame();
+
+    static void setThreadName(const char* name);
+    static void record(const char* name, uint64_t start, uint64_t end, uint32_t depth);
+
+    // Draws the frame history and flame view of the selected frame
+    static void drawWindow(bool* open);
+
+    static bool exportChromeTrace(const std::string& path);
+
+    static uint32_t& threadDepth();
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+class ProfileZone {
+public:
+    ProfileZone(const char* name) : name(name), start(0), depth(0) {
+        if (Profiler::isEnabled()) {
+            start = Profiler::now();
+            depth = Profiler::threadDepth()++;
+        }
+    }
+
+    ~ProfileZone() {
+        if (start != 0) {
+            Profiler::threadDepth()--;
+            Profiler::record(name, start, Profiler::now(), depth);
+        }
+    }
+
+private:
+    const char* name;
+    uint64_t start;
+    uint32_t depth;
+};
+
+#ifdef DISABLE_PROFILER
+#define PROFILE_ZONE(name)
+#else
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#endif
@@ -0,0 +1,81 @@
+#include "RenderTargetPool.hpp"
+
+#include <iostream>
+
+RenderTargetPool::RenderTargetPool() : frame(0) {
+}
+
+RenderTargetPool::~RenderTargetPool() {
+    for (Target& target : targets) {
+        delete target.frameBuffer;
+    }
+}
+
+FrameBuffer* RenderTargetPool::acquire(int width, int height, const std::string& format) {
+    Target* resizable = NULL;
+    for (Target& target : targets) {
+        if (target.inUse || target.format != format) {
+            continue;
+        }
+        Texture* texture = target.frameBuffer->texture;
+        if (texture->getWidth() == width && texture->getHeight() == height) {
+            target.inUse = true;
+            target.lastUsed = frame;
+            return target.frameBuffer;
+        }
+        resizable = &target;
+    }
+
+    if (resizable != NULL) {
+        resizable->frameBuffer->texture->resize(width, height);
+        resizable->inUse = true;
+        resizable->lastUsed = frame;
+        return resizable->frameBuffer;
+    }
+
+    Target target;
+    target.frameBuffer = new FrameBuffer(new Texture(width, height, format));
+    target.format = format;
+    target.inUse = true;
+    target.lastUsed = frame;
+    targets.push_back(target);
+    return target.frameBuffer;
+}
+
+void RenderTargetPool::release(FrameBuffer* frameBuffer) {
+    for (Target& target : targets) {
+        if (target.frameBuffer == frameBuffer) {
+            target.inUse = false;
+            target.lastUsed = frame;
+            return;
+        }
+    }
+    std::cout << "Released a frame buffer not owned by the pool" << std::endl;
+}
+
+void RenderTargetPool::endFrame() {
+    frame++;
+    for (size_t i = 0; i < targets.size();) {
+        if (!targets[i].inUse && frame - targets[i].lastUsed > RENDER_TARGET_MAX_IDLE) {
+            delete targets[i].frameBuffer;
+            targets[i] = targets.back();
+            targets.pop_back();
+        } else {
+            i++;
+        }
+    }
+}
+
+int RenderTargetPool::getCount() {
+    return targets.size();
+}
+
+// Drivers store both 24 bit depth and RGB8 in 4 bytes per texel
+size_t RenderTargetPool::getMemoryUsage() {
+    size_t bytes = 0;
+    for (Target& target : targets) {
+        Texture* texture = target.frameBuffer->texture;
+        bytes += (size_t)texture->getWidth() * texture->getHeight() * 4;
+    }
+    return bytes;
+}
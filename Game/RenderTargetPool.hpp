@@ -0,0 +1,54 @@
+#pragma once
+
+#include "GLUtils.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Idle targets are freed after this many frames without use
+#define RENDER_TARGET_MAX_IDLE 60
+
+/*
+ * Owns every offscreen frame buffer, keyed by size and format ("color" or
+ * "depth" as for Texture).
+ *
+ * acquire() hands out an idle target of that key, resizes an idle one of the
+ * same format, or creates a new one. Targets kept for the whole run are
+ * simply never released; per frame targets are released once their last
+ * reader has drawn, so later passes can reuse them. Targets sized from the
+ * window follow it by being acquired with the new size, the old ones are
+ * resized or freed once idle.
+ *
+ *     FrameBuffer* target = pool.acquire(width, height, "color");
+ *     ... render into it, sample it ...
+ *     pool.release(target);
+ *     ...
+ *     pool.endFrame();
+ */
+class RenderTargetPool {
+public:
+    RenderTargetPool();
+    ~RenderTargetPool();
+
+    FrameBuffer* acquire(int width, int height, const std::string& format);
+    void release(FrameBuffer* target);
+
+    // Frees targets idle for more than RENDER_TARGET_MAX_IDLE frames
+    void endFrame();
+
+    int getCount();
+    // Estimated bytes of GPU memory held by all targets
+    size_t getMemoryUsage();
+
+private:
+    struct Target {
+        FrameBuffer* frameBuffer;
+        std::string format;
+        bool inUse;
+        uint64_t lastUsed;
+    };
+
+    std::vector<Target> targets;
+    uint64_t frame;
+};
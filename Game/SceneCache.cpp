@@ -0,0 +1,266 @@
+#include "SceneCache.hpp"
+#include "AssetPack.hpp"
+#include "GeometryNode.hpp"
+#include "JointNode.hpp"
+#include "Utils.hpp"
+#include "scene_lua.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#define SCENE_SNAPSHOT_MAGIC "SCEN"
+#define SCENE_SNAPSHOT_VERSION 1
+#define SCENE_SNAPSHOT_EXTENSION ".scene"
+
+std::map<std::string, SceneTemplate*> SceneCache::templates;
+std::mutex SceneCache::templatesLock;
+
+struct SnapshotHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t numNodes;
+    uint32_t stringsSize;
+};
+
+static uint32_t addString(std::string& strings, const std::string& s) {
+    uint32_t offset = strings.size();
+    strings.append(s);
+    strings.push_back('\0');
+    return offset;
+}
+
+SceneTemplate* SceneTemplate::fromTree(const SceneNode* root) {
+    SceneTemplate* scene = new SceneTemplate();
+    if (root == NULL) {
+        return scene;
+    }
+
+    // Same walk as FlatScene::build, children keep their list order
+    std::vector<std::pair<const SceneNode*, int>> stack;
+    stack.push_back(std::make_pair(root, -1));
+    while (!stack.empty()) {
+        const SceneNode* node = stack.back().first;
+        int parent = stack.back().second;
+        stack.pop_back();
+
+        Node record;
+        memset(&record, 0, sizeof(record));
+        record.type = (uint32_t)node->m_nodeType;
+        record.parent = parent;
+        record.name = addString(scene->strings, node->m_name);
+        memcpy(record.trans, glm::value_ptr(node->trans), sizeof(record.trans));
+        memcpy(record.invtrans, glm::value_ptr(node->invtrans), sizeof(record.invtrans));
+
+        if (node->m_nodeType == NodeType::JointNode) {
+            const JointNode* joint = static_cast<const JointNode*>(node);
+            record.jointX[0] = joint->m_joint_x.min;
+            record.jointX[1] = joint->m_joint_x.init;
+            record.jointX[2] = joint->m_joint_x.max;
+            record.jointY[0] = joint->m_joint_y.min;
+            record.jointY[1] = joint->m_joint_y.init;
+            record.jointY[2] = joint->m_joint_y.max;
+        }
+        if (node->m_nodeType == NodeType::GeometryNode) {
+            const GeometryNode* geometry = static_cast<const GeometryNode*>(node);
+            record.meshId = addString(scene->strings, geometry->meshId);
+            for (int i = 0; i < 3; i++) {
+                record.kd[i] = geometry->material.kd[i];
+                record.ks[i] = geometry->material.ks[i];
+            }
+            record.shininess = geometry->material.shininess;
+        } else {
+            record.meshId = addString(scene->strings, "");
+        }
+
+        int index = scene->nodes.size();
+        scene->nodes.push_back(record);
+        for (auto it = node->children.rbegin(); it != node->children.rend(); ++it) {
+            stack.push_back(std::make_pair(*it, index));
+        }
+    }
+    return scene;
+}
+
+SceneNode* SceneTemplate::instantiate() const {
+    std::vector<SceneNode*> created(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const Node& record = nodes[i];
+        const char* name = &strings[record.name];
+
+        SceneNode* node;
+        switch ((NodeType)record.type) {
+            case NodeType::JointNode: {
+                JointNode* joint = new JointNode(name);
+                joint->set_joint_x(record.jointX[0], record.jointX[1], record.jointX[2]);
+                joint->set_joint_y(record.jointY[0], record.jointY[1], record.jointY[2]);
+                node = joint;
+                break;
+            }
+            case NodeType::GeometryNode: {
+                GeometryNode* geometry = new GeometryNode(&strings[record.meshId], name);
+                geometry->material.kd = glm::make_vec3(record.kd);
+                geometry->material.ks = glm::make_vec3(record.ks);
+                geometry->material.shininess = record.shininess;
+                node = geometry;
+                break;
+            }
+            default:
+                node = new SceneNode(name);
+                break;
+        }
+        node->trans = glm::make_mat4(record.trans);
+        node->invtrans = glm::make_mat4(record.invtrans);
+
+        created[i] = node;
+        if (record.parent >= 0) {
+            created[record.parent]->add_child(node);
+        }
+    }
+    return created.empty() ? NULL : created[0];
+}
+
+void SceneTemplate::toBytes(std::vector<char>& out) const {
+    SnapshotHeader header;
+    memcpy(header.magic, SCENE_SNAPSHOT_MAGIC, 4);
+    header.version = SCENE_SNAPSHOT_VERSION;
+    header.numNodes = nodes.size();
+    header.stringsSize = strings.size();
+
+    out.resize(sizeof(header) + nodes.size() * sizeof(Node) + strings.size());
+    memcpy(&out[0], &header, sizeof(header));
+    memcpy(&out[sizeof(header)], nodes.data(), nodes.size() * sizeof(Node));
+    memcpy(&out[sizeof(header) + nodes.size() * sizeof(Node)], strings.data(), strings.size());
+}
+
+bool SceneTemplate::save(const std::string& path) const {
+    FILE* out = fopen(path.c_str(), "wb");
+    if (out == NULL) {
+        return false;
+    }
+
+    std::vector<char> bytes;
+    toBytes(bytes);
+    fwrite(bytes.data(), 1, bytes.size(), out);
+
+    bool ok = !ferror(out);
+    fclose(out);
+    return ok;
+}
+
+SceneTemplate* SceneTemplate::fromBytes(const void* bytes, size_t size, const std::string& source) {
+    const char* data = (const char*)bytes;
+    SnapshotHeader header;
+    bool ok = size >= sizeof(header);
+    if (ok) {
+        memcpy(&header, data, sizeof(header));
+        ok = memcmp(header.magic, SCENE_SNAPSHOT_MAGIC, 4) == 0
+            && header.version == SCENE_SNAPSHOT_VERSION
+            && size == sizeof(header) + header.numNodes * sizeof(Node) + header.stringsSize;
+    }
+    if (!ok) {
+        std::cerr << "Error loading " << source << ": not a scene snapshot" << std::endl;
+        return NULL;
+    }
+
+    SceneTemplate* scene = new SceneTemplate();
+    const char* nodeData = data + sizeof(header);
+    scene->nodes.resize(header.numNodes);
+    memcpy(scene->nodes.data(), nodeData, header.numNodes * sizeof(Node));
+    scene->strings.assign(nodeData + header.numNodes * sizeof(Node), header.stringsSize);
+
+    // Names must stay inside the blob and parents come before children
+    for (size_t i = 0; i < scene->nodes.size(); i++) {
+        const Node& record = scene->nodes[i];
+        if (record.name >= header.stringsSize || record.meshId >= header.stringsSize
+                || record.parent >= (int32_t)i || (record.parent < 0 && i > 0)
+                || record.type > (uint32_t)NodeType::JointNode) {
+            std::cerr << "Error loading " << source << ": corrupt scene snapshot" << std::endl;
+            delete scene;
+            return NULL;
+        }
+    }
+    if (!scene->strings.empty() && scene->strings.back() != '\0') {
+        std::cerr << "Error loading " << source << ": corrupt scene snapshot" << std::endl;
+        delete scene;
+        return NULL;
+    }
+    return scene;
+}
+
+SceneTemplate* SceneTemplate::load(const std::string& path) {
+    FILE* in = fopen(path.c_str(), "rb");
+    if (in == NULL) {
+        return NULL;
+    }
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+
+    std::vector<char> data(size > 0 ? size : 0);
+    bool ok = size > 0 && fread(&data[0], 1, size, in) == (size_t)size;
+    fclose(in);
+    if (!ok) {
+        std::cerr << "Error loading " << path << ": not a scene snapshot" << std::endl;
+        return NULL;
+    }
+    return fromBytes(data.data(), data.size(), path);
+}
+
+int SceneTemplate::getNumNodes() const {
+    return nodes.size();
+}
+
+const SceneTemplate* SceneCache::get(const std::string& file) {
+    // Held through the import so two threads never load the same file
+    std::lock_guard<std::mutex> lock(templatesLock);
+    auto found = templates.find(file);
+    if (found != templates.end()) {
+        return found->second;
+    }
+
+    SceneTemplate* scene = NULL;
+    time_t fileTime = getFileModifiedTime(file);
+    const AssetPack* pack = AssetPack::getGamePack();
+    const AssetPack::Entry* cooked = pack != NULL ? pack->find(file, AssetType::Scene, fileTime) : NULL;
+    if (cooked != NULL) {
+        scene = SceneTemplate::fromBytes(pack->getData(cooked), cooked->size, file);
+    }
+
+    std::string snapshot = file + SCENE_SNAPSHOT_EXTENSION;
+    // Seconds are the resolution, so a snapshot from the same second as an
+    // edit is taken as stale
+    time_t snapshotTime = getFileModifiedTime(snapshot);
+    if (scene == NULL && snapshotTime != 0 && snapshotTime > fileTime) {
+        scene = SceneTemplate::load(snapshot);
+    }
+
+    if (scene == NULL) {
+        SceneNode* root = import_lua(file);
+        if (root == NULL) {
+            return NULL;
+        }
+        scene = SceneTemplate::fromTree(root);
+        delete root;
+        // Only a speed up, a read only asset directory just means Lua next time
+        scene->save(snapshot);
+    }
+
+    templates[file] = scene;
+    return scene;
+}
+
+SceneNode* SceneCache::instantiate(const std::string& file) {
+    const SceneTemplate* scene = get(file);
+    return scene != NULL ? scene->instantiate() : NULL;
+}
+
+void SceneCache::clear() {
+    std::lock_guard<std::mutex> lock(templatesLock);
+    for (auto& entry : templates) {
+        delete entry.second;
+    }
+    templates.clear();
+}
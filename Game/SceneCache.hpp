@@ -0,0 +1,75 @@
+#pragma once
+
+#include "SceneNode.hpp"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * An imported scene file kept as plain records in parent before child
+ * order, with every name in one string blob. It never changes once built,
+ * characters get their own SceneNode tree from instantiate().
+ *
+ * The records are also the snapshot format, so save() and load() are a
+ * header plus the two arrays.
+ */
+class SceneTemplate {
+public:
+    struct Node {
+        uint32_t type;   // NodeType
+        int32_t parent;  // -1 for the root
+        uint32_t name;   // Offsets into the string blob
+        uint32_t meshId;
+        float trans[16];
+        float invtrans[16];
+        float jointX[3]; // min, init, max
+        float jointY[3];
+        float kd[3];
+        float ks[3];
+        float shininess;
+    };
+
+    // NULL root gives an empty template
+    static SceneTemplate* fromTree(const SceneNode* root);
+
+    // A new tree owned by the caller, NULL if the template is empty
+    SceneNode* instantiate() const;
+
+    bool save(const std::string& path) const;
+    // Read in one go, NULL if the file is missing or not a snapshot
+    static SceneTemplate* load(const std::string& path);
+
+    // The snapshot in memory, as cooked into asset packs. source names the
+    // bytes in error messages.
+    void toBytes(std::vector<char>& out) const;
+    static SceneTemplate* fromBytes(const void* data, size_t size, const std::string& source);
+
+    int getNumNodes() const;
+
+private:
+    std::vector<Node> nodes;
+    std::string strings;
+};
+
+/*
+ * Imports every scene file once and hands out copies of it. A binary
+ * snapshot is written next to the file on the first import ("puppet.lua" is
+ * cached as "puppet.lua.scene") and read instead of running Lua for as long
+ * as it is newer than the file. A scene cooked into the game's asset pack
+ * is used before either. Safe to call from the asset loader's threads.
+ */
+class SceneCache {
+public:
+    // Stays valid until clear()
+    static const SceneTemplate* get(const std::string& file);
+    // NULL if the file could not be imported
+    static SceneNode* instantiate(const std::string& file);
+    static void clear();
+
+private:
+    static std::map<std::string, SceneTemplate*> templates;
+    static std::mutex templatesLock;
+};
@@ -18,10 +18,11 @@ unsigned int SceneNode::nodeInstanceCount = 0;
 
 //---------------------------------------------------------------------------------------
 SceneNode::SceneNode(const std::string& name)
-  : m_name(name),
-	m_nodeType(NodeType::SceneNode),
+  : isSelected(false),
 	trans(mat4()),
-	isSelected(false),
+	dirty(true),
+	m_nodeType(NodeType::SceneNode),
+	m_name(name),
 	m_nodeId(nodeInstanceCount++)
 {
 
@@ -30,10 +31,11 @@ SceneNode::SceneNode(const std::string& name)
 //---------------------------------------------------------------------------------------
 // Deep copy
 SceneNode::SceneNode(const SceneNode & other)
-	: m_nodeType(other.m_nodeType),
-	  m_name(other.m_name),
-	  trans(other.trans),
-	  invtrans(other.invtrans)
+	: trans(other.trans),
+	  invtrans(other.invtrans),
+	  dirty(true),
+	  m_nodeType(other.m_nodeType),
+	  m_name(other.m_name)
 {
 	for(SceneNode * child : other.children) {
 		this->children.push_front(new SceneNode(*child));
@@ -51,6 +53,7 @@ SceneNode::~SceneNode() {
 void SceneNode::set_transform(const glm::mat4& m) {
 	trans = m;
 	invtrans = m;
+	dirty = true;
 }
 
 //---------------------------------------------------------------------------------------
@@ -92,16 +95,19 @@ void SceneNode::rotate(char axis, float angle) {
 	}
 	mat4 rot_matrix = glm::rotate(degreesToRadians(angle), rot_axis);
 	trans = rot_matrix * trans;
+	dirty = true;
 }
 
 //---------------------------------------------------------------------------------------
 void SceneNode::scale(const glm::vec3 & amount) {
 	trans = glm::scale(amount) * trans;
+	dirty = true;
 }
 
 //---------------------------------------------------------------------------------------
 void SceneNode::translate(const glm::vec3& amount) {
 	trans = glm::translate(amount) * trans;
+	dirty = true;
 }
 
 
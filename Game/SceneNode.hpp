@@ -47,6 +47,9 @@ public:
     // Transformations
     glm::mat4 trans;
     glm::mat4 invtrans;
+    // Set when the local transform changes, a FlatScene clears it once it
+    // has picked the change up. Writing trans directly must set it too.
+    bool dirty;
     
     std::list<SceneNode*> children;
 
@@ -0,0 +1,45 @@
+#include "SimulationClock.hpp"
+
+SimulationClock::SimulationClock(double tickSeconds, int maxTicksPerFrame) :
+    tickSeconds(tickSeconds),
+    accumulator(0),
+    maxTicksPerFrame(maxTicksPerFrame),
+    tickCount(0) {
+}
+
+int SimulationClock::advance(double frameSeconds) {
+    if (frameSeconds < 0) {
+        frameSeconds = 0;
+    }
+    accumulator += frameSeconds;
+
+    int ticks = (int)(accumulator / tickSeconds);
+    if (ticks > maxTicksPerFrame) {
+        // Too far behind (hitch, breakpoint), drop the backlog instead of
+        // spiraling into longer and longer frames
+        ticks = maxTicksPerFrame;
+        accumulator = 0;
+    } else {
+        accumulator -= ticks * tickSeconds;
+    }
+
+    tickCount += ticks;
+    return ticks;
+}
+
+void SimulationClock::reset() {
+    accumulator = 0;
+    tickCount = 0;
+}
+
+double SimulationClock::getTickSeconds() const {
+    return tickSeconds;
+}
+
+float SimulationClock::getAlpha() const {
+    return (float)(accumulator / tickSeconds);
+}
+
+unsigned long SimulationClock::getTickCount() const {
+    return tickCount;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+// Simulation rate, every game system advances in steps of this size
+#define SIMULATION_TICK_RATE 60
+#define SIMULATION_TICK_SECONDS (1.0 / SIMULATION_TICK_RATE)
+
+/*
+ * Fixed timestep clock. Real frame time is fed into an accumulator which is
+ * drained in whole ticks, so game speed does not depend on the frame rate.
+ * The fraction of a tick left in the accumulator is used to interpolate the
+ * rendered state between the last two ticks.
+ */
+class SimulationClock {
+public:
+    SimulationClock(double tickSeconds = SIMULATION_TICK_SECONDS, int maxTicksPerFrame = 5);
+
+    // Adds frameSeconds of real time and returns the number of ticks to run
+    int advance(double frameSeconds);
+    void reset();
+
+    double getTickSeconds() const;
+    float getAlpha() const;
+    unsigned long getTickCount() const;
+
+private:
+    double tickSeconds;
+    double accumulator;
+    int maxTicksPerFrame;
+    unsigned long tickCount;
+};
@@ -0,0 +1,133 @@
+#include "StreamBuffer.hpp"
+
+#include "cs488-framework/GlErrorCheck.hpp"
+
+#include <cstring>
+
+// GL 4.4 / ARB_buffer_storage, not part of the gl3w headers
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+typedef void (APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+static BufferStorageProc getBufferStorage() {
+    static bool checked = false;
+    static BufferStorageProc proc = NULL;
+    if (!checked) {
+        checked = true;
+
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        bool available = major > 4 || (major == 4 && minor >= 4);
+
+        GLint extensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+        for (GLint i = 0; i < extensions && !available; i++) {
+            const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            available = strcmp(name, "GL_ARB_buffer_storage") == 0;
+        }
+
+        if (available) {
+            proc = (BufferStorageProc)gl3wGetProcAddress("glBufferStorage");
+        }
+    }
+    return proc;
+}
+
+StreamBuffer::StreamBuffer(GLenum target, GLsizeiptr regionSize)
+    : target(target), regionSize(regionSize), region(0), persistent(NULL)
+{
+    for (int i = 0; i < STREAM_BUFFER_FRAMES; i++) {
+        fences[i] = 0;
+    }
+
+    GLsizeiptr size = regionSize * STREAM_BUFFER_FRAMES;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+
+    BufferStorageProc bufferStorage = getBufferStorage();
+    if (bufferStorage != NULL) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        bufferStorage(target, size, NULL, flags);
+        persistent = (char*)glMapBufferRange(target, 0, size, flags);
+        if (persistent == NULL) {
+            // Immutable storage cannot be respecified, start over with a new name
+            glDeleteBuffers(1, &buffer);
+            glGenBuffers(1, &buffer);
+            glBindBuffer(target, buffer);
+        }
+    }
+    if (persistent == NULL) {
+        glBufferData(target, size, NULL, GL_STREAM_DRAW);
+    }
+    CHECK_GL_ERRORS;
+}
+
+StreamBuffer::~StreamBuffer() {
+    for (int i = 0; i < STREAM_BUFFER_FRAMES; i++) {
+        if (fences[i] != 0) {
+            glDeleteSync(fences[i]);
+        }
+    }
+    if (persistent != NULL) {
+        glBindBuffer(target, buffer);
+        glUnmapBuffer(target);
+    }
+    glDeleteBuffers(1, &buffer);
+}
+
+void* StreamBuffer::map() {
+    region = (region + 1) % STREAM_BUFFER_FRAMES;
+
+    GLsync sync = fences[region];
+    if (sync != 0) {
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        while (true) {
+            GLenum status = glClientWaitSync(sync, flags, 1000000);
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED || status == GL_WAIT_FAILED) {
+                break;
+            }
+            flags = 0;
+        }
+        glDeleteSync(sync);
+        fences[region] = 0;
+    }
+
+    if (persistent != NULL) {
+        return persistent + region * regionSize;
+    }
+
+    // The fence above already guarantees the GPU is done with this region
+    glBindBuffer(target, buffer);
+    return glMapBufferRange(target, region * regionSize, regionSize,
+        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+}
+
+GLintptr StreamBuffer::unmap(GLsizeiptr bytesWritten) {
+    if (persistent == NULL) {
+        glBindBuffer(target, buffer);
+        if (bytesWritten > 0) {
+            glFlushMappedBufferRange(target, 0, bytesWritten);
+        }
+        glUnmapBuffer(target);
+    }
+    return region * regionSize;
+}
+
+void StreamBuffer::fence() {
+    if (fences[region] != 0) {
+        glDeleteSync(fences[region]);
+    }
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLuint StreamBuffer::getBuffer() const {
+    return buffer;
+}
+
+bool StreamBuffer::isPersistent() const {
+    return persistent != NULL;
+}
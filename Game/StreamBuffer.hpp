@@ -0,0 +1,46 @@
+#pragma once
+
+#include "cs488-framework/OpenGLImport.hpp"
+
+#define STREAM_BUFFER_FRAMES 3
+
+/*
+ * Ring of STREAM_BUFFER_FRAMES regions in one GL buffer for data rewritten
+ * every frame. The CPU writes one region while the GPU may still read the
+ * previous ones; a fence per region makes map() wait only if the GPU is
+ * more than two frames behind.
+ *
+ * With GL_ARB_buffer_storage the buffer stays persistently mapped, otherwise
+ * each region is mapped unsynchronized. Neither path orphans the buffer or
+ * goes through a driver side copy.
+ *
+ *     float* data = (float*)stream.map();
+ *     ... write up to the region size ...
+ *     GLintptr offset = stream.unmap(bytesWritten);
+ *     ... draw reading from offset ...
+ *     stream.fence();
+ */
+class StreamBuffer {
+public:
+    StreamBuffer(GLenum target, GLsizeiptr regionSize);
+    ~StreamBuffer();
+
+    // NULL if the region cannot be mapped, skip the upload then without
+    // calling unmap()
+    void* map();
+    // Returns the byte offset of the region just written
+    GLintptr unmap(GLsizeiptr bytesWritten);
+    // Call after the draws reading the current region have been issued
+    void fence();
+
+    GLuint getBuffer() const;
+    bool isPersistent() const;
+
+private:
+    GLenum target;
+    GLuint buffer;
+    GLsizeiptr regionSize;
+    int region;
+    char* persistent;
+    GLsync fences[STREAM_BUFFER_FRAMES];
+};
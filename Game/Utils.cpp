@@ -1,10 +1,22 @@
 #include "Utils.hpp"
 #include <iostream>
 
+#include <sys/stat.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
 std::string getAssetFilePath(std::string fileName) {
     return "Assets/" + fileName;
 }
 
+time_t getFileModifiedTime(const std::string& path) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return 0;
+    }
+    return info.st_mtime;
+}
+
 glm::vec3 lerp(glm::vec3 a, glm::vec3 b, float t) {
     return (1-t)*a + t*b;
 }
@@ -69,6 +81,93 @@ glm::mat4 getBiasMatrix(glm::mat4& m) {
     return biasMatrix * m;
 }
 
+// Gribb and Hartmann plane extraction, normals point inside
+Frustum::Frustum(const glm::mat4& VP) {
+    glm::mat4 m = glm::transpose(VP);
+    planes[0] = m[3] + m[0];
+    planes[1] = m[3] - m[0];
+    planes[2] = m[3] + m[1];
+    planes[3] = m[3] - m[1];
+    planes[4] = m[3] + m[2];
+    planes[5] = m[3] - m[2];
+}
+
+bool Frustum::intersects(const glm::vec3& min, const glm::vec3& max) const {
+    for (int i = 0; i < 6; i++) {
+        const glm::vec4& plane = planes[i];
+        // The corner furthest along the plane normal
+        glm::vec3 corner = glm::vec3(
+            plane.x > 0 ? max.x : min.x,
+            plane.y > 0 ? max.y : min.y,
+            plane.z > 0 ? max.z : min.z);
+        if (glm::dot(glm::vec3(plane), corner) + plane.w < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+ShadowBox::ShadowBox() :
+    minX(-1), maxX(1), minY(-1), maxY(1), minZ(-1), maxZ(1), radius(0), farDistance(0) {
+}
+
+bool ShadowBox::update(const glm::mat4& cameraView, float fov, float aspect, float near, float far,
+                       glm::vec3 lightDirection, int mapSize, float padding) {
+    farDistance = far;
+
+    glm::mat4 inverseSlice = glm::inverse(glm::perspective(fov, aspect, near, far) * cameraView);
+    glm::vec3 corners[8];
+    glm::vec3 center = glm::vec3(0);
+    for (int i = 0; i < 8; i++) {
+        glm::vec4 corner = inverseSlice * glm::vec4(
+            (i & 1) ? 1 : -1, (i & 2) ? 1 : -1, (i & 4) ? 1 : -1, 1);
+        corners[i] = glm::vec3(corner) / corner.w;
+        center += corners[i] / 8.0f;
+    }
+
+    float sliceRadius = 0;
+    for (int i = 0; i < 8; i++) {
+        sliceRadius = glm::max(sliceRadius, glm::length(corners[i] - center));
+    }
+    // Rounded so float noise does not change the texel size between frames
+    float boxRadius = glm::ceil(sliceRadius * (1 + padding) * 16.0f) / 16.0f;
+
+    // The sun moves around the z axis, which keeps z usable as up
+    glm::vec3 up = glm::abs(lightDirection.z) > 0.99f ? glm::vec3(0, 1, 0) : glm::vec3(0, 0, 1);
+    glm::mat4 view = glm::lookAt(glm::vec3(0), -lightDirection, up);
+    glm::vec3 lightCenter = glm::vec3(view * glm::vec4(center, 1));
+
+    if (view == viewMatrix && boxRadius == radius &&
+        lightCenter.x - sliceRadius >= minX && lightCenter.x + sliceRadius <= maxX &&
+        lightCenter.y - sliceRadius >= minY && lightCenter.y + sliceRadius <= maxY &&
+        lightCenter.z - sliceRadius >= minZ && lightCenter.z + sliceRadius <= maxZ - SHADOW_CASTER_DISTANCE) {
+        return false;
+    }
+
+    viewMatrix = view;
+    radius = boxRadius;
+    float texel = 2 * radius / mapSize;
+    lightCenter.x = glm::floor(lightCenter.x / texel) * texel;
+    lightCenter.y = glm::floor(lightCenter.y / texel) * texel;
+
+    minX = lightCenter.x - radius;
+    maxX = lightCenter.x + radius;
+    minY = lightCenter.y - radius;
+    maxY = lightCenter.y + radius;
+    // +z points towards the light
+    minZ = lightCenter.z - radius;
+    maxZ = lightCenter.z + radius + SHADOW_CASTER_DISTANCE;
+    return true;
+}
+
+glm::mat4 ShadowBox::getViewProjection() const {
+    return glm::ortho(minX, maxX, minY, maxY, -maxZ, -minZ) * viewMatrix;
+}
+
+float ShadowBox::getFar() const {
+    return farDistance;
+}
+
 Audio::Audio() {
 #ifdef NOSOUND
 #else
@@ -94,6 +193,15 @@ Audio::Audio() {
         Mix_Volume(-1, MIX_MAX_VOLUME);
     }
 
+    backgroundMusic = NULL;
+    jumpSound = walkSound = rockSound = NULL;
+#endif
+}
+
+// Decoding the files needs no GL, the asset loader runs this on a worker
+void Audio::load() {
+#ifdef NOSOUND
+#else
     backgroundMusic = Mix_LoadMUS("Assets/hyrule-field.mid");
     if (backgroundMusic == NULL) {
         std::cout << "cannot load music" << std::endl;
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <ctime>
 #include <string>
 #include <glm/glm.hpp>
 
@@ -20,30 +21,59 @@ float easeOut(float x);
 // Utility Functions
 glm::vec3 getSunLightColor(float time);
 std::string getAssetFilePath(std::string fileName);
+// 0 when the file does not exist
+time_t getFileModifiedTime(const std::string& path);
 
 glm::mat4 getBiasMatrix(glm::mat4& m);
 
+// Planes of a view-projection matrix, for culling boxes against a camera or
+// a shadow cascade
+class Frustum {
+public:
+    Frustum(const glm::mat4& VP);
+    bool intersects(const glm::vec3& min, const glm::vec3& max) const;
+private:
+    glm::vec4 planes[6];
+};
+
+// How far towards the light a shadow box reaches past its slice, so casters
+// outside the view still shadow it
+#define SHADOW_CASTER_DISTANCE 100.0f
+
 // Calculation class to get bounding box for shadow
 // Original code from ThinMatrix: https://www.youtube.com/watch?v=o6zDfDkOFIc&index=38&list=PLRIWtICgwaX0u7Rf9zkZhLoLuZVfUksDP&t=974s
-// TODO: implement this
+// The box bounds the sphere around one slice of the camera frustum, so its size
+// does not change as the camera turns, and its position is snapped to whole
+// shadow map texels so shadows do not shimmer as the camera moves.
+// With padding the box is grown by that fraction and kept in place until the
+// slice leaves it, which lets a cached shadow map stay valid over many frames.
 class ShadowBox {
 public:
+    ShadowBox();
+
+    // near and far are view distances of the slice, returns true if the box moved
+    bool update(const glm::mat4& cameraView, float fov, float aspect, float near, float far,
+                glm::vec3 lightDirection, int mapSize, float padding = 0.0f);
+
+    glm::mat4 getViewProjection() const;
+    float getFar() const;
 private:
     float minX, maxX;
     float minY, maxY;
     float minZ, maxZ;
 
-    float farHeight, farWidth;
-    float nearWidth, nearHeight;
+    float radius;
+    float farDistance;
 
     glm::mat4 viewMatrix;
-
 };
 
 class Audio {
 public:
+    // Opens the mixer, nothing plays until load()
     Audio();
     ~Audio();
+    void load();
 
     void playBackground();
     void playJump();
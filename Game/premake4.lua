@@ -47,6 +47,57 @@ if os.get() == "linux" then
     }
 end
 
+-- Libraries for the tools that run without a window or GL context
+if os.get() == "macosx" then
+    headlessLinkLibs = {
+        "cs488-framework",
+        "imgui",
+        "lua",
+        "lodepng"
+    }
+    headlessLinkOptionList = { "-framework OpenGL" }
+end
+
+if os.get() == "linux" then
+    -- GL is only linked for the gl3w loader symbols, no context is created
+    headlessLinkLibs = {
+        "cs488-framework",
+        "imgui",
+        "lua",
+        "GL",
+        "stdc++",
+        "dl",
+        "pthread",
+        "lodepng"
+    }
+end
+
+-- Game sources that do not need a window, shared by the headless tools
+headlessFiles = {
+    "Animation.cpp",
+    "AssetLoader.cpp",
+    "AssetPack.cpp",
+    "Chunk.cpp",
+    "ChunkManager.cpp",
+    "FlatScene.cpp",
+    "GeometryNode.cpp",
+    "GLState.cpp",
+    "GLUtils.cpp",
+    "JointNode.cpp",
+    "ModelBatch.cpp",
+    "Objects.cpp",
+    "ParticlePool.cpp",
+    "Perlin.cpp",
+    "Profiler.cpp",
+    "RenderTargetPool.cpp",
+    "SceneCache.cpp",
+    "SceneNode.cpp",
+    "SimulationClock.cpp",
+    "StreamBuffer.cpp",
+    "Utils.cpp",
+    "scene_lua.cpp"
+}
+
 -- Build Options:
 if os.get() == "macosx" then
     linkOptionList = { "-framework IOKit", "-framework Cocoa", "-framework CoreVideo", "-framework OpenGL" }
@@ -83,3 +134,107 @@ solution "CS488-Projects"
     configuration "Release"
         defines { "NDEBUG" }
         flags { "Optimize" }
+
+    -- Runs the simulation without a window, for CI and profiling hosts
+    project "Headless"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        objdir "build/Headless"
+        targetdir "."
+        targetname "HeadlessRunner" -- Headless/ holds the sources
+        buildoptions { "-std=c++11" }
+        defines { "NOSOUND" }
+        libdirs (libDirectories)
+        links (headlessLinkLibs)
+        linkoptions (headlessLinkOptionList)
+        includedirs (includeDirList)
+        includedirs { "." }
+        files (headlessFiles)
+        files { "Headless/*.cpp" }
+
+    configuration "Debug"
+        defines { "DEBUG" }
+        flags { "Symbols" }
+
+    configuration "Release"
+        defines { "NDEBUG" }
+        flags { "Optimize" }
+
+    -- Microbenchmarks of the game's hot paths
+    project "Benchmark"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        objdir "build/Benchmark"
+        targetdir "."
+        targetname "BenchmarkRunner" -- Benchmark/ holds the sources
+        buildoptions { "-std=c++11" }
+        defines { "NOSOUND" }
+        libdirs (libDirectories)
+        links (headlessLinkLibs)
+        linkoptions (headlessLinkOptionList)
+        includedirs (includeDirList)
+        includedirs { "." }
+        files (headlessFiles)
+        files { "Benchmark/*.cpp" }
+
+    configuration "Debug"
+        defines { "DEBUG" }
+        flags { "Symbols" }
+
+    configuration "Release"
+        defines { "NDEBUG" }
+        flags { "Optimize" }
+
+    -- Cooks the assets into the pack the game maps at startup
+    project "Cooker"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        objdir "build/Cooker"
+        targetdir "."
+        targetname "AssetCooker" -- Cooker/ holds the sources
+        buildoptions { "-std=c++11" }
+        defines { "NOSOUND" }
+        libdirs (libDirectories)
+        links (headlessLinkLibs)
+        linkoptions (headlessLinkOptionList)
+        includedirs (includeDirList)
+        includedirs { "." }
+        files (headlessFiles)
+        files { "Cooker/*.cpp" }
+
+    configuration "Debug"
+        defines { "DEBUG" }
+        flags { "Symbols" }
+
+    configuration "Release"
+        defines { "NDEBUG" }
+        flags { "Optimize" }
+
+    -- Checks the GPU particles against the CPU ones in a hidden window
+    project "ParticleCheck"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        objdir "build/ParticleCheck"
+        targetdir "."
+        targetname "ParticleChecker" -- ParticleCheck/ holds the sources
+        buildoptions { "-std=c++11" }
+        defines { "NOSOUND" }
+        libdirs (libDirectories)
+        links (linkLibs)
+        linkoptions (linkOptionList)
+        includedirs (includeDirList)
+        includedirs { "." }
+        files (headlessFiles)
+        files { "ParticleCheck/*.cpp" }
+
+    configuration "Debug"
+        defines { "DEBUG" }
+        flags { "Symbols" }
+
+    configuration "Release"
+        defines { "NDEBUG" }
+        flags { "Optimize" }
@@ -80,6 +80,11 @@ struct gr_material_ud {
   Material* material;
 };
 
+// The "userdata" type for an animation clip.
+struct gr_clip_ud {
+  AnimationClip* clip;
+};
+
 // Create a node
 extern "C"
 int gr_node_cmd(lua_State* L)
@@ -198,6 +203,63 @@ int gr_material_cmd(lua_State* L)
   return 1;
 }
 
+// Create an animation clip
+extern "C"
+int gr_clip_cmd(lua_State* L)
+{
+  GRLUA_DEBUG_CALL;
+
+  gr_clip_ud* data = (gr_clip_ud*)lua_newuserdata(L, sizeof(gr_clip_ud));
+  data->clip = 0;
+
+  const char* name = luaL_checkstring(L, 1);
+  double duration = luaL_checknumber(L, 2);
+  bool loop = lua_toboolean(L, 3);
+  data->clip = new AnimationClip(name, duration, loop);
+
+  luaL_getmetatable(L, "gr.clip");
+  lua_setmetatable(L, -2);
+
+  return 1;
+}
+
+// Add a keyframed joint angle curve to a clip
+extern "C"
+int gr_clip_channel_cmd(lua_State* L)
+{
+  GRLUA_DEBUG_CALL;
+
+  gr_clip_ud* selfdata = (gr_clip_ud*)luaL_checkudata(L, 1, "gr.clip");
+  luaL_argcheck(L, selfdata != 0, 1, "Clip expected");
+
+  const char* joint = luaL_checkstring(L, 2);
+
+  const char* axis_string = luaL_checkstring(L, 3);
+  luaL_argcheck(L, axis_string
+                && std::strlen(axis_string) == 1, 3, "Single character expected");
+  char axis = std::tolower(axis_string[0]);
+  luaL_argcheck(L, axis == 'x' || axis == 'y', 3, "Axis must be x or y");
+
+  luaL_checktype(L, 4, LUA_TTABLE);
+  luaL_checktype(L, 5, LUA_TTABLE);
+  int numKeys = luaL_len(L, 4);
+  luaL_argcheck(L, numKeys > 0 && luaL_len(L, 5) == numKeys, 5, "One angle per key time expected");
+
+  std::vector<float> times(numKeys), angles(numKeys);
+  for (int i = 1; i <= numKeys; i++) {
+    lua_rawgeti(L, 4, i);
+    times[i - 1] = luaL_checknumber(L, -1);
+    lua_rawgeti(L, 5, i);
+    angles[i - 1] = luaL_checknumber(L, -1);
+    lua_pop(L, 2);
+    luaL_argcheck(L, i == 1 || times[i - 1] > times[i - 2], 4, "Key times must increase");
+  }
+
+  selfdata->clip->addChannel(joint, axis == 'x' ? JointAxis::X : JointAxis::Y, times, angles);
+
+  return 0;
+}
+
 // Add a child to a node
 extern "C"
 int gr_node_add_child_cmd(lua_State* L)
@@ -342,6 +404,7 @@ static const luaL_Reg grlib_functions[] = {
   {"joint", gr_joint_cmd},
   {"mesh", gr_mesh_cmd},
   {"material", gr_material_cmd},
+  {"clip", gr_clip_cmd},
   {0, 0}
 };
 
@@ -367,11 +430,15 @@ static const luaL_Reg grlib_node_methods[] = {
   {0, 0}
 };
 
-// This function calls the lua interpreter to do the actual importing
-SceneNode* import_lua(const std::string& filename)
+// Member functions for "gr.clip" objects.
+static const luaL_Reg grlib_clip_methods[] = {
+  {"channel", gr_clip_channel_cmd},
+  {0, 0}
+};
+
+// Starts a lua interpreter with the gr library loaded
+static lua_State* open_scene_state()
 {
-  GRLUA_DEBUG("Importing scene from " << filename);
-  
   // Start a lua interpreter
   lua_State* L = luaL_newstate();
 
@@ -393,10 +460,29 @@ SceneNode* import_lua(const std::string& filename)
 
   luaL_setfuncs(L, grlib_node_methods, 0);
 
+  // Set up the metatable for gr.clip, popped again so gr.node's becomes
+  // the gr table below
+  luaL_newmetatable(L, "gr.clip");
+  lua_pushstring(L, "__index");
+  lua_pushvalue(L, -2);
+  lua_settable(L, -3);
+  luaL_setfuncs(L, grlib_clip_methods, 0);
+  lua_pop(L, 1);
+
   // Load the gr functions
   luaL_setfuncs(L, grlib_functions, 0);
   lua_setglobal(L, "gr");
 
+  return L;
+}
+
+// This function calls the lua interpreter to do the actual importing
+SceneNode* import_lua(const std::string& filename)
+{
+  GRLUA_DEBUG("Importing scene from " << filename);
+
+  lua_State* L = open_scene_state();
+
   GRLUA_DEBUG("Parsing the scene");
   // Now parse the actual scene
   if (luaL_loadfile(L, filename.c_str()) || lua_pcall(L, 0, 1, 0)) {
@@ -424,3 +510,39 @@ SceneNode* import_lua(const std::string& filename)
   // And return the node
   return node;
 }
+
+// Same as import_lua, but the script returns a table of clips
+std::vector<AnimationClip*> import_lua_clips(const std::string& filename)
+{
+  GRLUA_DEBUG("Importing clips from " << filename);
+
+  std::vector<AnimationClip*> clips;
+  lua_State* L = open_scene_state();
+
+  if (luaL_loadfile(L, filename.c_str()) || lua_pcall(L, 0, 1, 0)) {
+    std::cerr << "Error loading " << filename << ": " << lua_tostring(L, -1) << std::endl;
+    lua_close(L);
+    return clips;
+  }
+
+  if (!lua_istable(L, -1)) {
+    std::cerr << "Error loading " << filename << ": Must return a table of clips." << std::endl;
+    lua_close(L);
+    return clips;
+  }
+
+  int numClips = luaL_len(L, -1);
+  for (int i = 1; i <= numClips; i++) {
+    lua_rawgeti(L, -1, i);
+    gr_clip_ud* data = (gr_clip_ud*)luaL_testudata(L, -1, "gr.clip");
+    if (data != 0 && data->clip != 0) {
+      clips.push_back(data->clip);
+    } else {
+      std::cerr << "Error loading " << filename << ": entry " << i << " is not a clip." << std::endl;
+    }
+    lua_pop(L, 1);
+  }
+
+  lua_close(L);
+  return clips;
+}
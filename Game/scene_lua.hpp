@@ -1,7 +1,12 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include "Animation.hpp"
 #include "SceneNode.hpp"
 
 SceneNode * import_lua(const std::string & filename);
 
+// The file returns a table of gr.clip objects, empty on errors
+std::vector<AnimationClip*> import_lua_clips(const std::string & filename);
+
@@ -14,5 +14,9 @@ struct BatchInfo {
 	// Number of indices to be rendered for this batch.
 	unsigned int numIndices;
 
+	// Added to every index of this batch, so indices stay local to the mesh
+	// and fit in 16 bits.
+	int baseVertex;
+
 };
 
@@ -5,10 +5,19 @@ using namespace std;
 #include "cs488-framework/Exception.hpp"
 #include "cs488-framework/ObjFileDecoder.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
 
 //----------------------------------------------------------------------------------------
 // Default constructor
 MeshConsolidator::MeshConsolidator()
+	: m_numVertexBytes(0),
+	  m_vertexStride(0),
+	  m_shortIndices(false),
+	  m_quantizedNormals(false)
 {
 
 }
@@ -21,50 +30,96 @@ MeshConsolidator::~MeshConsolidator()
 }
 
 //----------------------------------------------------------------------------------------
-template <typename T>
-static void appendVector (
-		std::vector<T> & dest,
-		const std::vector<T> & source
-) {
-	// Increase capacity to hold source.size() more elements
-	dest.reserve(dest.size() + source.size());
-
-	dest.insert(dest.end(), source.begin(), source.end());
-}
-
-
-//----------------------------------------------------------------------------------------
-MeshConsolidator::MeshConsolidator(
-		std::initializer_list<ObjFilePath> objFileList
-) {
+namespace {
 
+struct DecodedMesh {
 	MeshId meshId;
 	vector<vec3> positions;
 	vector<vec3> normals;
-	BatchInfo batchInfo;
-	unsigned long indexOffset(0);
+	vector<unsigned int> indices;
+};
 
-    for(const ObjFilePath & objFile : objFileList) {
-	    ObjFileDecoder::decode(objFile.c_str(), meshId, positions, normals);
+int16_t quantize(float value) {
+	value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+	return (int16_t)lroundf(value * 32767.0f);
+}
 
-	    uint numIndices = positions.size();
+}
 
-	    if (numIndices != normals.size()) {
-		    throw Exception("Error within MeshConsolidator: "
+//----------------------------------------------------------------------------------------
+MeshConsolidator::MeshConsolidator(
+		const std::vector<ObjFilePath> & objFileList,
+		unsigned int flags
+) {
+	// Everything is decoded first so the block is allocated once at its
+	// final size.
+	vector<DecodedMesh> meshes(objFileList.size());
+	vector<vec2> uvCoords;
+	size_t numVertices(0);
+	size_t numIndices(0);
+	size_t largestMesh(0);
+
+	size_t i(0);
+	for(const ObjFilePath & objFile : objFileList) {
+		DecodedMesh & mesh = meshes[i++];
+		ObjFileDecoder::decodeIndexed(objFile.c_str(), mesh.meshId,
+			mesh.positions, mesh.normals, uvCoords, mesh.indices);
+
+		if (mesh.positions.size() != mesh.normals.size()) {
+			throw Exception("Error within MeshConsolidator: "
 					"positions.size() != normals.size()\n");
-	    }
-
-	    batchInfo.startIndex = indexOffset;
-	    batchInfo.numIndices = numIndices;
-
-	    m_batchInfoMap[meshId] = batchInfo;
-
-	    appendVector(m_vertexPositionData, positions);
-	    appendVector(m_vertexNormalData, normals);
-
-	    indexOffset += numIndices;
-    }
-
+		}
+
+		numVertices += mesh.positions.size();
+		numIndices += mesh.indices.size();
+		largestMesh = std::max(largestMesh, mesh.positions.size());
+	}
+
+	m_shortIndices = (flags & MESH_SHORT_INDICES) && largestMesh <= 65536;
+	m_quantizedNormals = (flags & MESH_QUANTIZED_NORMALS) != 0;
+	m_vertexStride = 3 * sizeof(float) + (m_quantizedNormals ? 4 * sizeof(int16_t) : 3 * sizeof(float));
+	m_numVertexBytes = numVertices * m_vertexStride;
+	size_t indexSize = m_shortIndices ? sizeof(uint16_t) : sizeof(uint32_t);
+	m_data.resize(m_numVertexBytes + numIndices * indexSize);
+
+	unsigned char * vertex = m_data.data();
+	unsigned char * index = m_data.data() + m_numVertexBytes;
+	BatchInfo batchInfo;
+	int baseVertex(0);
+	unsigned int indexOffset(0);
+
+	for (const DecodedMesh & mesh : meshes) {
+		for (size_t v = 0; v < mesh.positions.size(); v++) {
+			memcpy(vertex, &mesh.positions[v].x, 3 * sizeof(float));
+			if (m_quantizedNormals) {
+				int16_t normal[4] = {
+					quantize(mesh.normals[v].x), quantize(mesh.normals[v].y), quantize(mesh.normals[v].z), 0
+				};
+				memcpy(vertex + 3 * sizeof(float), normal, sizeof(normal));
+			} else {
+				memcpy(vertex + 3 * sizeof(float), &mesh.normals[v].x, 3 * sizeof(float));
+			}
+			vertex += m_vertexStride;
+		}
+
+		for (unsigned int value : mesh.indices) {
+			if (m_shortIndices) {
+				uint16_t shortValue = value;
+				memcpy(index, &shortValue, sizeof(shortValue));
+			} else {
+				memcpy(index, &value, sizeof(value));
+			}
+			index += indexSize;
+		}
+
+		batchInfo.startIndex = indexOffset;
+		batchInfo.numIndices = mesh.indices.size();
+		batchInfo.baseVertex = baseVertex;
+		m_batchInfoMap[mesh.meshId] = batchInfo;
+
+		indexOffset += mesh.indices.size();
+		baseVertex += mesh.positions.size();
+	}
 }
 
 //----------------------------------------------------------------------------------------
@@ -75,25 +130,44 @@ void MeshConsolidator::getBatchInfoMap (
 }
 
 //----------------------------------------------------------------------------------------
-// Returns the starting memory location for vertex position data.
-const float * MeshConsolidator::getVertexPositionDataPtr() const {
-	return &(m_vertexPositionData[0].x);
+// Returns the starting memory location of the vertices and indices.
+const void * MeshConsolidator::getDataPtr() const {
+	return m_data.data();
+}
+
+//----------------------------------------------------------------------------------------
+// Returns the total number of bytes of vertex and index data.
+size_t MeshConsolidator::getNumDataBytes() const {
+	return m_data.size();
+}
+
+//----------------------------------------------------------------------------------------
+// Returns the number of bytes of vertex data, which start the block.
+size_t MeshConsolidator::getNumVertexBytes() const {
+	return m_numVertexBytes;
+}
+
+//----------------------------------------------------------------------------------------
+size_t MeshConsolidator::getIndexOffset() const {
+	return m_numVertexBytes;
+}
+
+//----------------------------------------------------------------------------------------
+size_t MeshConsolidator::getVertexStride() const {
+	return m_vertexStride;
 }
 
 //----------------------------------------------------------------------------------------
-// Returns the starting memory location for vertex normal data.
-const float * MeshConsolidator::getVertexNormalDataPtr() const {
-    return &(m_vertexNormalData[0].x);
+size_t MeshConsolidator::getNormalOffset() const {
+	return 3 * sizeof(float);
 }
 
 //----------------------------------------------------------------------------------------
-// Returns the total number of bytes of all vertex position data.
-size_t MeshConsolidator::getNumVertexPositionBytes() const {
-	return m_vertexPositionData.size() * sizeof(vec3);
+bool MeshConsolidator::hasShortIndices() const {
+	return m_shortIndices;
 }
 
 //----------------------------------------------------------------------------------------
-// Returns the total number of bytes of all vertex normal data.
-size_t MeshConsolidator::getNumVertexNormalBytes() const {
-	return m_vertexNormalData.size() * sizeof(vec3);
+bool MeshConsolidator::hasQuantizedNormals() const {
+	return m_quantizedNormals;
 }
@@ -4,7 +4,6 @@
 
 #include <glm/glm.hpp>
 
-#include <initializer_list>
 #include <vector>
 #include <unordered_map>
 #include <string>
@@ -19,38 +18,66 @@ typedef std::string ObjFilePath;
 
 
 // BatchInfoMap is an associative container that maps a unique MeshId to a BatchInfo
-// object. Each BatchInfo object contains an index offset and the number of indices
-// required to render the mesh with identifier MeshId.
+// object. Each BatchInfo object contains an index offset, the number of indices
+// and the base vertex required to render the mesh with identifier MeshId.
 typedef std::unordered_map<MeshId, BatchInfo>  BatchInfoMap;
 
 
+// Storage options for the consolidated data, combined with |
+enum MeshConsolidatorFlags {
+	// Indices are unsigned shorts, used only if every mesh has at most
+	// 65536 vertices.
+	MESH_SHORT_INDICES = 1,
+
+	// Normals are 3 signed shorts (normalized, plus one of padding) instead
+	// of 3 floats.
+	MESH_QUANTIZED_NORMALS = 2
+};
+
+
 /*
 * Class for consolidating all vertex data within a list of .obj files.
+*
+* Each mesh is indexed with duplicate vertices merged. All meshes share one
+* block of memory: the interleaved vertices (position as 3 floats, then the
+* normal) followed by the indices, so it can be uploaded as a single buffer.
 */
 class MeshConsolidator {
 public:
 	MeshConsolidator();
 
-	MeshConsolidator(std::initializer_list<ObjFilePath>  objFileList);
+	MeshConsolidator(const std::vector<ObjFilePath> & objFileList, unsigned int flags = 0);
 
 	~MeshConsolidator();
 
-	const float * getVertexPositionDataPtr() const;
+	// The whole block, vertices first.
+	const void * getDataPtr() const;
+
+	size_t getNumDataBytes() const;
 
-	const float * getVertexNormalDataPtr() const;
+	size_t getNumVertexBytes() const;
 
-	size_t getNumVertexPositionBytes() const;
+	// Offset of the indices within the block.
+	size_t getIndexOffset() const;
 
-	size_t getNumVertexNormalBytes() const;
+	// Bytes from one vertex to the next, and from a vertex to its normal.
+	size_t getVertexStride() const;
+
+	size_t getNormalOffset() const;
+
+	bool hasShortIndices() const;
+
+	bool hasQuantizedNormals() const;
 
 	void getBatchInfoMap(BatchInfoMap & batchInfoMap) const;
 
 
 private:
-	std::vector<glm::vec3> m_vertexPositionData;
-	std::vector<glm::vec3> m_vertexNormalData;
+	std::vector<unsigned char> m_data;
+	size_t m_numVertexBytes;
+	size_t m_vertexStride;
+	bool m_shortIndices;
+	bool m_quantizedNormals;
 
 	BatchInfoMap m_batchInfoMap;
 };
-
-
@@ -1,15 +1,328 @@
 #include "ObjFileDecoder.hpp"
 using namespace glm;
 
-#include <fstream>
-#include <sstream>
-#include <iostream>
+#include <cstdio>
 #include <cstring>
+#include <sstream>
+#include <unordered_map>
 using namespace std;
 
 #include "cs488-framework/Exception.hpp"
 
 
+namespace {
+
+// One triangle corner, as indices into the parsed attribute lists
+struct Corner {
+	int position;
+	int uvCoord;  // -1 if the face has none
+	int normal;
+
+	bool operator == (const Corner & other) const {
+		return position == other.position && uvCoord == other.uvCoord && normal == other.normal;
+	}
+};
+
+struct CornerHash {
+	size_t operator () (const Corner & c) const {
+		return (size_t)c.position * 73856093u ^ (size_t)c.uvCoord * 19349663u ^ (size_t)c.normal * 83492791u;
+	}
+};
+
+struct ObjData {
+	string objectName;
+	vector<vec3> positions;
+	vector<vec3> normals;
+	// Generated for corners without a normal, kept apart so that "vn" indices
+	// only count the file's normals. Corners refer to them as -2 - index.
+	vector<vec3> faceNormals;
+	vector<vec2> uvCoords;
+	vector<Corner> corners; // Three per triangle
+
+	const vec3 & normal(int index) const {
+		return index >= 0 ? normals[index] : faceNormals[-2 - index];
+	}
+};
+
+const double powersOfTen[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+class Parser {
+public:
+	Parser(const char * path, const char * begin, const char * end)
+		: path(path), p(begin), end(end), line(1) { }
+
+	void parse(ObjData & data);
+
+private:
+	bool atLineEnd() const {
+		return p == end || *p == '\n' || *p == '\r' || *p == '#';
+	}
+
+	void skipSpaces() {
+		while (p != end && (*p == ' ' || *p == '\t')) {
+			p++;
+		}
+	}
+
+	void skipLine() {
+		while (p != end && *p != '\n') {
+			p++;
+		}
+		if (p != end) {
+			p++;
+		}
+		line++;
+	}
+
+	void fail(const char * message) const {
+		stringstream errorMessage;
+		errorMessage << "Error in .obj file " << path << " line " << line << ": " << message << endl;
+		throw Exception(errorMessage.str());
+	}
+
+	float parseFloat();
+	int parseIndex(int count);
+	void parseFace(ObjData & data);
+
+	const char * path;
+	const char * p;
+	const char * end;
+	int line;
+};
+
+// Decimal floats with an optional exponent. Up to 19 significant digits are
+// exact, which is plenty for the 6 or so that exporters write.
+float Parser::parseFloat() {
+	skipSpaces();
+	bool negative = false;
+	if (p != end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+
+	unsigned long long mantissa = 0;
+	int exponent = 0;
+	int digits = 0;
+	bool any = false;
+	for (; p != end && *p >= '0' && *p <= '9'; p++, any = true) {
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += mantissa != 0;
+		} else {
+			exponent++;
+		}
+	}
+	if (p != end && *p == '.') {
+		p++;
+		for (; p != end && *p >= '0' && *p <= '9'; p++, any = true) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0;
+				exponent--;
+			}
+		}
+	}
+	if (!any) {
+		fail("number expected");
+	}
+	if (p != end && (*p == 'e' || *p == 'E')) {
+		p++;
+		bool negativeExponent = false;
+		if (p != end && (*p == '-' || *p == '+')) {
+			negativeExponent = *p == '-';
+			p++;
+		}
+		int value = 0;
+		for (; p != end && *p >= '0' && *p <= '9'; p++) {
+			value = value < 10000 ? value * 10 + (*p - '0') : value;
+		}
+		exponent += negativeExponent ? -value : value;
+	}
+
+	double result = (double)mantissa;
+	while (exponent > 22) {
+		result *= 1e22;
+		exponent -= 22;
+	}
+	while (exponent < -22) {
+		result /= 1e22;
+		exponent += 22;
+	}
+	result = exponent >= 0 ? result * powersOfTen[exponent] : result / powersOfTen[-exponent];
+	return (float)(negative ? -result : result);
+}
+
+// Resolves 1 based and negative (from the end) indices to 0 based ones
+int Parser::parseIndex(int count) {
+	bool negative = false;
+	if (p != end && *p == '-') {
+		negative = true;
+		p++;
+	}
+	int value = 0;
+	bool any = false;
+	for (; p != end && *p >= '0' && *p <= '9'; p++, any = true) {
+		value = value * 10 + (*p - '0');
+	}
+	if (!any) {
+		fail("index expected");
+	}
+
+	int index = negative ? count - value : value - 1;
+	if (value == 0 || index < 0 || index >= count) {
+		fail("index out of range");
+	}
+	return index;
+}
+
+void Parser::parseFace(ObjData & data) {
+	Corner first = {0, 0, 0};
+	Corner previous = first;
+	int numCorners = 0;
+
+	skipSpaces();
+	while (!atLineEnd()) {
+		Corner corner;
+		corner.position = parseIndex(data.positions.size());
+		corner.uvCoord = -1;
+		corner.normal = -1;
+		if (p != end && *p == '/') {
+			p++;
+			if (p != end && *p != '/') {
+				corner.uvCoord = parseIndex(data.uvCoords.size());
+			}
+			if (p != end && *p == '/') {
+				p++;
+				corner.normal = parseIndex(data.normals.size());
+			}
+		}
+
+		if (numCorners >= 2) {
+			Corner triangle[3] = {first, previous, corner};
+			// Corners without a normal get the triangle's face normal
+			if (first.normal < 0 || previous.normal < 0 || corner.normal < 0) {
+				vec3 a = data.positions[first.position];
+				vec3 b = data.positions[previous.position];
+				vec3 c = data.positions[corner.position];
+				vec3 n = cross(b - a, c - a);
+				float length = glm::length(n);
+				data.faceNormals.push_back(length > 0 ? n / length : vec3(0, 1, 0));
+				for (Corner & t : triangle) {
+					if (t.normal < 0) {
+						t.normal = -1 - (int)data.faceNormals.size();
+					}
+				}
+			}
+			data.corners.insert(data.corners.end(), triangle, triangle + 3);
+		}
+		if (numCorners == 0) {
+			first = corner;
+		}
+		previous = corner;
+		numCorners++;
+		skipSpaces();
+	}
+	if (numCorners < 3) {
+		fail("face with fewer than 3 vertices");
+	}
+}
+
+void Parser::parse(ObjData & data) {
+	while (p != end) {
+		skipSpaces();
+		if (atLineEnd()) {
+			skipLine();
+			continue;
+		}
+
+		char c0 = *p;
+		char c1 = p + 1 != end ? p[1] : '\n';
+		if (c0 == 'v' && (c1 == ' ' || c1 == '\t')) {
+			p++;
+			vec3 vertex;
+			vertex.x = parseFloat();
+			vertex.y = parseFloat();
+			vertex.z = parseFloat();
+			data.positions.push_back(vertex);
+
+		} else if (c0 == 'v' && c1 == 'n') {
+			p += 2;
+			vec3 normal;
+			normal.x = parseFloat();
+			normal.y = parseFloat();
+			normal.z = parseFloat();
+			data.normals.push_back(normal);
+
+		} else if (c0 == 'v' && c1 == 't') {
+			p += 2;
+			vec2 textureCoord;
+			textureCoord.s = parseFloat();
+			skipSpaces();
+			textureCoord.t = atLineEnd() ? 0.0f : parseFloat();
+			data.uvCoords.push_back(textureCoord);
+
+		} else if (c0 == 'f' && (c1 == ' ' || c1 == '\t')) {
+			p++;
+			parseFace(data);
+
+		} else if (c0 == 'o' && (c1 == ' ' || c1 == '\t')) {
+			p++;
+			skipSpaces();
+			const char * start = p;
+			while (p != end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {
+				p++;
+			}
+			data.objectName.assign(start, p);
+		}
+		// Groups, materials, smoothing and anything unknown are ignored
+		skipLine();
+	}
+}
+
+void readObjFile(const char * objFilePath, ObjData & data) {
+	FILE * in = fopen(objFilePath, "rb");
+	if (in == NULL) {
+		stringstream errorMessage;
+		errorMessage << "Unable to open .obj file " << objFilePath
+			<< " within method ObjFileDecoder::decode" << endl;
+
+		throw Exception(errorMessage.str().c_str());
+	}
+
+	fseek(in, 0, SEEK_END);
+	long size = ftell(in);
+	fseek(in, 0, SEEK_SET);
+	vector<char> contents(size > 0 ? size : 0);
+	size_t read = size > 0 ? fread(&contents[0], 1, size, in) : 0;
+	fclose(in);
+	if (size < 0 || read != (size_t)size) {
+		stringstream errorMessage;
+		errorMessage << "Error reading .obj file " << objFilePath << endl;
+		throw Exception(errorMessage.str());
+	}
+
+	const char * begin = contents.empty() ? NULL : &contents[0];
+	Parser parser(objFilePath, begin, begin + contents.size());
+	parser.parse(data);
+
+	if (data.objectName.empty()) {
+		// No 'o' object name tag defined in .obj file, so use the file name
+		// minus the '.obj' ending as the objectName.
+		const char * ptr = strrchr(objFilePath, '/');
+		data.objectName.assign(ptr != NULL ? ptr + 1 : objFilePath);
+		size_t pos = data.objectName.find('.');
+		if (pos != string::npos) {
+			data.objectName.resize(pos);
+		}
+	}
+}
+
+} // namespace
+
+
 //---------------------------------------------------------------------------------------
 void ObjFileDecoder::decode(
 		const char * objFilePath,
@@ -18,137 +331,24 @@ void ObjFileDecoder::decode(
         std::vector<vec3> & normals,
         std::vector<vec2> & uvCoords
 ) {
+	ObjData data;
+	readObjFile(objFilePath, data);
+	objectName = data.objectName;
 
 	// Empty containers, and start fresh before inserting data from .obj file
 	positions.clear();
 	normals.clear();
 	uvCoords.clear();
+	positions.reserve(data.corners.size());
+	normals.reserve(data.corners.size());
 
-    ifstream in(objFilePath, std::ios::in);
-    in.exceptions(std::ifstream::badbit);
-
-    if (!in) {
-        stringstream errorMessage;
-        errorMessage << "Unable to open .obj file " << objFilePath
-            << " within method ObjFileDecoder::decode" << endl;
-
-        throw Exception(errorMessage.str().c_str());
-    }
-
-    string currentLine;
-    int positionIndexA, positionIndexB, positionIndexC;
-    int normalIndexA, normalIndexB, normalIndexC;
-    int uvCoordIndexA, uvCoordIndexB, uvCoordIndexC;
-    vector<vec3> temp_positions;
-    vector<vec3> temp_normals;
-    vector<vec2> temp_uvCoords;
-
-	objectName = "";
-
-    while (!in.eof()) {
-        try {
-            getline(in, currentLine);
-        } catch (const ifstream::failure &e) {
-            in.close();
-            stringstream errorMessage;
-            errorMessage << "Error calling getline() -- " << e.what() << endl;
-            throw Exception(errorMessage.str());
-        }
-	    if (currentLine.substr(0, 2) == "o ") {
-		    // Get entire line excluding first 2 chars.
-		    istringstream s(currentLine.substr(2));
-		    s >> objectName;
-
-
-	    } else if (currentLine.substr(0, 2) == "v ") {
-            // Vertex data on this line.
-            // Get entire line excluding first 2 chars.
-            istringstream s(currentLine.substr(2));
-            glm::vec3 vertex;
-            s >> vertex.x;
-            s >> vertex.y;
-            s >> vertex.z;
-            temp_positions.push_back(vertex);
-
-        } else if (currentLine.substr(0, 3) == "vn ") {
-            // Normal data on this line.
-            // Get entire line excluding first 2 chars.
-            istringstream s(currentLine.substr(2));
-            vec3 normal;
-            s >> normal.x;
-            s >> normal.y;
-            s >> normal.z;
-            temp_normals.push_back(normal);
-
-        } else if (currentLine.substr(0, 3) == "vt ") {
-            // Texture coordinate data on this line.
-            // Get entire line excluding first 2 chars.
-            istringstream s(currentLine.substr(2));
-            vec2 textureCoord;
-            s >> textureCoord.s;
-            s >> textureCoord.t;
-            temp_uvCoords.push_back(textureCoord);
-
-        } else if (currentLine.substr(0, 2) == "f ") {
-            // Face index data on this line.
-
-            int index;
-
-            // sscanf will return the number of matched index values it found
-            // from the pattern.
-            int numberOfIndexMatches = sscanf(currentLine.c_str(), "f %d/%d/%d",
-                                              &index, &index, &index);
-
-            if (numberOfIndexMatches == 3) {
-                // Line contains indices of the pattern vertex/uv-cord/normal.
-                sscanf(currentLine.c_str(), "f %d/%d/%d %d/%d/%d %d/%d/%d",
-                       &positionIndexA, &uvCoordIndexA, &normalIndexA,
-                       &positionIndexB, &uvCoordIndexB, &normalIndexB,
-                       &positionIndexC, &uvCoordIndexC, &normalIndexC);
-
-                // .obj file uses indices that start at 1, so subtract 1 so they start at 0.
-                uvCoordIndexA--;
-                uvCoordIndexB--;
-                uvCoordIndexC--;
-
-                uvCoords.push_back(temp_uvCoords[uvCoordIndexA]);
-                uvCoords.push_back(temp_uvCoords[uvCoordIndexB]);
-                uvCoords.push_back(temp_uvCoords[uvCoordIndexC]);
-
-            } else {
-                // Line contains indices of the pattern vertex//normal.
-                sscanf(currentLine.c_str(), "f %d//%d %d//%d %d//%d",
-		               &positionIndexA, &normalIndexA,
-                       &positionIndexB, &normalIndexB,
-                       &positionIndexC, &normalIndexC);
-            }
-
-            positionIndexA--;
-            positionIndexB--;
-            positionIndexC--;
-            normalIndexA--;
-            normalIndexB--;
-            normalIndexC--;
-
-            positions.push_back(temp_positions[positionIndexA]);
-            positions.push_back(temp_positions[positionIndexB]);
-            positions.push_back(temp_positions[positionIndexC]);
-
-            normals.push_back(temp_normals[normalIndexA]);
-            normals.push_back(temp_normals[normalIndexB]);
-            normals.push_back(temp_normals[normalIndexC]);
-        }
-    }
-
-    in.close();
-
-	if (objectName.compare("") == 0) {
-		// No 'o' object name tag defined in .obj file, so use the file name
-		// minus the '.obj' ending as the objectName.
-		const char * ptr = strrchr(objFilePath, '/');
-		objectName.assign(ptr+1);
-		size_t pos = objectName.find('.');
-		objectName.resize(pos);
+	bool hasUvCoords = !data.uvCoords.empty();
+	for (const Corner & corner : data.corners) {
+		positions.push_back(data.positions[corner.position]);
+		normals.push_back(data.normal(corner.normal));
+		if (hasUvCoords) {
+			uvCoords.push_back(corner.uvCoord >= 0 ? data.uvCoords[corner.uvCoord] : vec2(0.0f));
+		}
 	}
 }
 
@@ -162,3 +362,38 @@ void ObjFileDecoder::decode(
     std::vector<vec2> uvCoords;
     decode(objFilePath, objectName, positions, normals, uvCoords);
 }
+
+//---------------------------------------------------------------------------------------
+void ObjFileDecoder::decodeIndexed(
+		const char * objFilePath,
+		std::string & objectName,
+        std::vector<vec3> & positions,
+        std::vector<vec3> & normals,
+        std::vector<vec2> & uvCoords,
+        std::vector<unsigned int> & indices
+) {
+	ObjData data;
+	readObjFile(objFilePath, data);
+	objectName = data.objectName;
+
+	positions.clear();
+	normals.clear();
+	uvCoords.clear();
+	indices.clear();
+	indices.reserve(data.corners.size());
+
+	bool hasUvCoords = !data.uvCoords.empty();
+	unordered_map<Corner, unsigned int, CornerHash> unique;
+	unique.reserve(data.corners.size());
+	for (const Corner & corner : data.corners) {
+		auto inserted = unique.insert(make_pair(corner, (unsigned int)positions.size()));
+		if (inserted.second) {
+			positions.push_back(data.positions[corner.position]);
+			normals.push_back(data.normal(corner.normal));
+			if (hasUvCoords) {
+				uvCoords.push_back(corner.uvCoord >= 0 ? data.uvCoords[corner.uvCoord] : vec2(0.0f));
+			}
+		}
+		indices.push_back(inserted.first->second);
+	}
+}
@@ -4,6 +4,12 @@
 #include <vector>
 #include <string>
 
+/*
+ * Wavefront .obj reader. The whole file is read in one block and parsed in
+ * place. Faces may have any number of corners (they are split into a
+ * triangle fan), indices may be negative (relative to the end of the list so
+ * far), and a corner without a normal gets its triangle's face normal.
+ */
 class ObjFileDecoder {
 public:
 
@@ -16,7 +22,8 @@ public:
 	* [out] objectName - name given to object.
 	* [out] positions - positions given in (x,y,z) model space.
 	* [out] normals - normals given in (x,y,z) model space.
-	* [out] uvCoords - texture coordinates in (u,v) parameter space.
+	* [out] uvCoords - texture coordinates in (u,v) parameter space, empty if
+	*       the file has none.
 	*/
     static void decode(
 		    const char * objFilePath,
@@ -44,6 +51,28 @@ public:
             std::vector<glm::vec3> & normals
     );
 
+
+	/**
+	* Same as decode(), but each distinct position/uv/normal combination is
+	* stored once and the triangles index into it.
+	*
+	* [in] objFilePath - path to .obj file
+	* [out] objectName - name given to object.
+	* [out] positions - positions given in (x,y,z) model space, one per unique vertex.
+	* [out] normals - normals given in (x,y,z) model space, one per unique vertex.
+	* [out] uvCoords - texture coordinates, one per unique vertex, or empty if
+	*       the file has none.
+	* [out] indices - three per triangle, into the arrays above.
+	*/
+    static void decodeIndexed(
+		    const char * objFilePath,
+			std::string & objectName,
+            std::vector<glm::vec3> & positions,
+            std::vector<glm::vec3> & normals,
+            std::vector<glm::vec2> & uvCoords,
+            std::vector<unsigned int> & indices
+    );
+
 };
 
 
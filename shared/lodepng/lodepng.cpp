@@ -37,6 +37,13 @@ Rename this file to lodepng.cpp to use it for C++, or to lodepng.c to use it for
 #include <fstream>
 #endif /*LODEPNG_COMPILE_CPP*/
 
+/*SSE2 is used for unfiltering when the target has it, define LODEPNG_NO_SSE2 to always use the plain C code*/
+#if !defined(LODEPNG_NO_SSE2) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define LODEPNG_SSE2
+#include <emmintrin.h>
+#include <string.h>
+#endif /*LODEPNG_SSE2*/
+
 #if defined(_MSC_VER) && (_MSC_VER >= 1310) /*Visual Studio: A few warning types are not desired here.*/
 #pragma warning( disable : 4244 ) /*implicit conversions: not warned by gcc -Wall -Wextra and requires too much casts*/
 #pragma warning( disable : 4996 ) /*VS does not like fopen, but fopen_s is not standard C so unusable here*/
@@ -453,6 +460,36 @@ static unsigned readBitsFromStream(size_t* bitpointer, const unsigned char* bits
   }
   return result;
 }
+
+/*
+returns the bits from bitpointer on, lsb first, at least 25 of them. Bits past the end of
+the stream (bitlength in bits, a multiple of 8) read as zero. Whole bytes are loaded at
+once, this is what lets the decoder take codes and extra bits in one step.
+*/
+static unsigned peekBitsFromStream(size_t bitpointer, const unsigned char* bitstream, size_t bitlength)
+{
+  size_t start = bitpointer >> 3, bytelength = bitlength >> 3, i;
+  unsigned result = 0;
+  if(start + 4 <= bytelength)
+  {
+    result = (unsigned)bitstream[start] | ((unsigned)bitstream[start + 1] << 8u)
+           | ((unsigned)bitstream[start + 2] << 16u) | ((unsigned)bitstream[start + 3] << 24u);
+  }
+  else
+  {
+    for(i = 0; start + i < bytelength; ++i) result |= (unsigned)bitstream[start + i] << (8u * i);
+  }
+  return result >> (bitpointer & 0x7);
+}
+
+/*same as readBitsFromStream for nbits up to 25 that the caller checked to be inside the stream*/
+static unsigned readBitsFromStreamFast(size_t* bitpointer, const unsigned char* bitstream,
+                                       size_t nbits, size_t bitlength)
+{
+  unsigned result = peekBitsFromStream(*bitpointer, bitstream, bitlength) & ((1u << nbits) - 1u);
+  (*bitpointer) += nbits;
+  return result;
+}
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 /* ////////////////////////////////////////////////////////////////////////// */
@@ -505,6 +542,7 @@ typedef struct HuffmanTree
   unsigned* lengths; /*the lengths of the codes of the 1d-tree*/
   unsigned maxbitlen; /*maximum number of bits a single code can get*/
   unsigned numcodes; /*number of symbols in the alphabet = number of codes*/
+  unsigned short* table; /*decoder only: symbol << 4 | length of the code the next FIRSTBITS bits start with*/
 } HuffmanTree;
 
 /*function used for debug purposes to draw the tree in ascii art with C++*/
@@ -525,6 +563,7 @@ static void HuffmanTree_init(HuffmanTree* tree)
   tree->tree2d = 0;
   tree->tree1d = 0;
   tree->lengths = 0;
+  tree->table = 0;
 }
 
 static void HuffmanTree_cleanup(HuffmanTree* tree)
@@ -532,6 +571,7 @@ static void HuffmanTree_cleanup(HuffmanTree* tree)
   lodepng_free(tree->tree2d);
   lodepng_free(tree->tree1d);
   lodepng_free(tree->lengths);
+  lodepng_free(tree->table);
 }
 
 /*the tree representation used by the decoder. return value is error*/
@@ -915,6 +955,42 @@ static unsigned generateFixedDistanceTree(HuffmanTree* tree)
 
 #ifdef LODEPNG_COMPILE_DECODER
 
+/*number of input bits looked up at once by huffmanDecodeSymbol, most literal and distance codes are shorter*/
+#define FIRSTBITS 9u
+
+/*
+the lookup table used by the decoder, made by walking tree2d for every value of the next
+FIRSTBITS input bits, so that it decodes exactly what walking the tree bit by bit would.
+Entries of codes that are longer, or of walks that leave the tree, have length 0 and the
+decoder walks the tree for those. return value is error.
+*/
+static unsigned HuffmanTree_makeTable(HuffmanTree* tree)
+{
+  unsigned index, i;
+
+  tree->table = (unsigned short*)lodepng_malloc((1u << FIRSTBITS) * sizeof(unsigned short));
+  if(!tree->table) return 83; /*alloc fail*/
+
+  for(index = 0; index != (1u << FIRSTBITS); ++index)
+  {
+    unsigned treepos = 0;
+    tree->table[index] = 0;
+    for(i = 0; i != FIRSTBITS; ++i)
+    {
+      unsigned ct = tree->tree2d[(treepos << 1) + ((index >> i) & 1u)];
+      if(ct < tree->numcodes)
+      {
+        tree->table[index] = (unsigned short)((ct << 4) | (i + 1));
+        break;
+      }
+      treepos = ct - tree->numcodes;
+      if(treepos >= tree->numcodes) break;
+    }
+  }
+
+  return 0;
+}
+
 /*
 returns the code, or (unsigned)(-1) if error happened
 inbitlength is the length of the complete buffer, in bits (so its byte length times 8)
@@ -923,6 +999,16 @@ static unsigned huffmanDecodeSymbol(const unsigned char* in, size_t* bp,
                                     const HuffmanTree* codetree, size_t inbitlength)
 {
   unsigned treepos = 0, ct;
+  if(codetree->table)
+  {
+    unsigned entry = codetree->table[peekBitsFromStream(*bp, in, inbitlength) & ((1u << FIRSTBITS) - 1u)];
+    unsigned length = entry & 15u;
+    if(length != 0 && *bp + length <= inbitlength)
+    {
+      (*bp) += length;
+      return entry >> 4;
+    }
+  }
   for(;;)
   {
     if(*bp >= inbitlength) return (unsigned)(-1); /*error: end of input memory reached without endcode*/
@@ -950,8 +1036,8 @@ static unsigned huffmanDecodeSymbol(const unsigned char* in, size_t* bp,
 static void getTreeInflateFixed(HuffmanTree* tree_ll, HuffmanTree* tree_d)
 {
   /*TODO: check for out of memory errors*/
-  generateFixedLitLenTree(tree_ll);
-  generateFixedDistanceTree(tree_d);
+  if(!generateFixedLitLenTree(tree_ll)) HuffmanTree_makeTable(tree_ll);
+  if(!generateFixedDistanceTree(tree_d)) HuffmanTree_makeTable(tree_d);
 }
 
 /*get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
@@ -998,6 +1084,8 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
 
     error = HuffmanTree_makeFromLengths(&tree_cl, bitlen_cl, NUM_CODE_LENGTH_CODES, 7);
     if(error) break;
+    error = HuffmanTree_makeTable(&tree_cl);
+    if(error) break;
 
     /*now we can use this tree to read the lengths for the tree that this function will return*/
     bitlen_ll = (unsigned*)lodepng_malloc(NUM_DEFLATE_CODE_SYMBOLS * sizeof(unsigned));
@@ -1089,7 +1177,11 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
     /*now we've finally got HLIT and HDIST, so generate the code trees, and the function is done*/
     error = HuffmanTree_makeFromLengths(tree_ll, bitlen_ll, NUM_DEFLATE_CODE_SYMBOLS, 15);
     if(error) break;
+    error = HuffmanTree_makeTable(tree_ll);
+    if(error) break;
     error = HuffmanTree_makeFromLengths(tree_d, bitlen_d, NUM_DISTANCE_SYMBOLS, 15);
+    if(error) break;
+    error = HuffmanTree_makeTable(tree_d);
 
     break; /*end of error-while*/
   }
@@ -1140,7 +1232,7 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
       /*part 2: get extra bits and add the value of that to length*/
       numextrabits_l = LENGTHEXTRA[code_ll - FIRST_LENGTH_CODE_INDEX];
       if((*bp + numextrabits_l) > inbitlength) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
-      length += readBitsFromStream(bp, in, numextrabits_l);
+      length += readBitsFromStreamFast(bp, in, numextrabits_l, inbitlength);
 
       /*part 3: get distance code*/
       code_d = huffmanDecodeSymbol(in, bp, &tree_d, inbitlength);
@@ -1160,7 +1252,7 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
       /*part 4: get extra bits from distance*/
       numextrabits_d = DISTANCEEXTRA[code_d];
       if((*bp + numextrabits_d) > inbitlength) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
-      distance += readBitsFromStream(bp, in, numextrabits_d);
+      distance += readBitsFromStreamFast(bp, in, numextrabits_d, inbitlength);
 
       /*part 5: fill in all the out[n] values based on the length and dist*/
       start = (*pos);
@@ -3895,6 +3987,101 @@ unsigned lodepng_inspect(unsigned* w, unsigned* h, LodePNGState* state,
   return state->error;
 }
 
+#ifdef LODEPNG_SSE2
+/*pixels of 3 or 4 bytes, in the low bytes of the register*/
+static __m128i loadPixel(const unsigned char* p, size_t bytewidth)
+{
+  int value = 0;
+  memcpy(&value, p, bytewidth);
+  return _mm_cvtsi32_si128(value);
+}
+
+static void storePixel(unsigned char* p, __m128i pixel, size_t bytewidth)
+{
+  int value = _mm_cvtsi128_si32(pixel);
+  memcpy(p, &value, bytewidth);
+}
+
+/*
+unfilterScanline with SSE2. The Up filter works 16 bytes at a time for any bytewidth,
+Sub, Average and Paeth depend on the pixel to the left so they work a pixel at a time,
+only for bytewidth 3 and 4 (8-bit RGB and RGBA). Every load happens before the store to
+the same pixel, so recon and scanline may still be the same memory.
+Returns 0 if the scanline is left to the plain C code.
+*/
+static unsigned unfilterScanlineSSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                     size_t bytewidth, unsigned char filterType, size_t length)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i a = zero; /*the unfiltered pixel to the left*/
+  size_t i;
+
+  if(filterType == 2 && precon)
+  {
+    for(i = 0; i + 16 <= length; i += 16)
+    {
+      __m128i x = _mm_loadu_si128((const __m128i*)&scanline[i]);
+      __m128i b = _mm_loadu_si128((const __m128i*)&precon[i]);
+      _mm_storeu_si128((__m128i*)&recon[i], _mm_add_epi8(x, b));
+    }
+    for(; i != length; ++i) recon[i] = scanline[i] + precon[i];
+    return 1;
+  }
+
+  if(bytewidth != 3 && bytewidth != 4) return 0;
+
+  if(filterType == 1)
+  {
+    for(i = 0; i != length; i += bytewidth)
+    {
+      a = _mm_add_epi8(a, loadPixel(&scanline[i], bytewidth));
+      storePixel(&recon[i], a, bytewidth);
+    }
+    return 1;
+  }
+  else if(filterType == 3 && precon)
+  {
+    const __m128i one = _mm_set1_epi8(1);
+    for(i = 0; i != length; i += bytewidth)
+    {
+      __m128i b = loadPixel(&precon[i], bytewidth);
+      /*_mm_avg_epu8 rounds up, (a + b) / 2 rounds down*/
+      __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+      a = _mm_add_epi8(loadPixel(&scanline[i], bytewidth), average);
+      storePixel(&recon[i], a, bytewidth);
+    }
+    return 1;
+  }
+  else if(filterType == 4 && precon)
+  {
+    /*the same choice as paethPredictor, in 16-bit lanes so the differences can't overflow*/
+    __m128i c = zero; /*the pixel above and to the left*/
+    for(i = 0; i != length; i += bytewidth)
+    {
+      __m128i b = _mm_unpacklo_epi8(loadPixel(&precon[i], bytewidth), zero);
+      __m128i x = _mm_unpacklo_epi8(loadPixel(&scanline[i], bytewidth), zero);
+      __m128i pa = _mm_sub_epi16(b, c);
+      __m128i pb = _mm_sub_epi16(a, c);
+      __m128i pc = _mm_add_epi16(pa, pb);
+      __m128i smallest, useA, useB, predictor;
+      pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+      pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+      pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+      smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+      useA = _mm_cmpeq_epi16(smallest, pa);
+      useB = _mm_andnot_si128(useA, _mm_cmpeq_epi16(smallest, pb));
+      predictor = _mm_or_si128(_mm_andnot_si128(_mm_or_si128(useA, useB), c),
+                               _mm_or_si128(_mm_and_si128(useA, a), _mm_and_si128(useB, b)));
+      a = _mm_and_si128(_mm_add_epi16(x, predictor), _mm_set1_epi16(0xff));
+      storePixel(&recon[i], _mm_packus_epi16(a, a), bytewidth);
+      c = b;
+    }
+    return 1;
+  }
+  return 0;
+}
+#endif /*LODEPNG_SSE2*/
+
 static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
                                  size_t bytewidth, unsigned char filterType, size_t length)
 {
@@ -3908,6 +4095,9 @@ static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scan
   */
 
   size_t i;
+#ifdef LODEPNG_SSE2
+  if(unfilterScanlineSSE2(recon, scanline, precon, bytewidth, filterType, length)) return 0;
+#endif /*LODEPNG_SSE2*/
   switch(filterType)
   {
     case 0: